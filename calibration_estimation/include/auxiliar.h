@@ -64,6 +64,10 @@ double norm(const std::vector<cv::Point2d> &p1,
             const std::vector<cv::Point2d> &p2,
             std::vector<double> *ind_error =0);
 
+/// \brief CSV field: s quoted (with doubled quotes) if it has a separator,
+/// a quote or a line break
+std::string csvField(const std::string &s);
+
 }
 
 #endif // AUXILIAR_H
@@ -0,0 +1,113 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#ifndef BAG_READER_H
+#define BAG_READER_H
+
+#include "view.h"
+
+#include <map>
+#include <deque>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace calib
+{
+
+class Data;
+class RobotState;
+
+/** BagReader
+*
+* Streaming ingestion of RobotMeasurements from a bag file: a reader thread
+* instantiates the messages and a pool of worker threads generates the views.
+* The heavy part of each message (images, debug features) is dropped as soon
+* as its view is generated, and at most 'window' raw messages are in flight
+* at any time, so the memory does not grow with the size of the bag.
+*
+*/
+class BagReader
+{
+public:
+  BagReader();
+  ~BagReader();
+
+  /// \brief Number of worker threads (<= 0: one per hardware core)
+  void setNumThreads(int num_threads) { num_threads_ = num_threads; }
+
+  /// \brief Maximum number of raw messages read but not yet processed
+  /// (0: two per worker thread)
+  void setWindow(std::size_t window) { window_ = window; }
+
+  /// \brief Read 'topic' from the bag and add the views to data (bag order).
+  /// The views are generated with RobotStates created from the URDF of
+  /// the data robot state. sample_id (optional) maps sample_id -> view index.
+  bool read(const std::string &filename,
+            const std::string &topic,
+            Data *data,
+            std::map<std::string, int> *sample_id = 0);
+
+private:
+  /// \brief Reader thread: push messages while the window has room
+  void readerLoop(const std::string &filename, const std::string &topic);
+
+  /// \brief Worker thread: pop messages and generate (stripped) views
+  void workerLoop(RobotState *robot_state);
+
+  int         num_threads_;
+  std::size_t window_;
+  std::size_t max_in_flight_; // window_ used by the current read()
+
+  const CalibrationContext *context_; // context of the views (data of read())
+
+  // shared state (protected by mutex_)
+  boost::mutex              mutex_;
+  boost::condition_variable not_full_;  // reader waits: in_flight_ < max_in_flight_
+  boost::condition_variable not_empty_; // workers wait: queue_ not empty / done_
+
+  std::deque<std::pair<std::size_t, Msg> > queue_;    // (bag index, message)
+  std::size_t                              in_flight_; // queued + processing
+  bool                                     done_;      // reader finished
+  bool                                     error_;     // bag or a view could not be read
+
+  std::map<std::size_t, View>        views_;      // bag index -> view
+  std::map<std::string, std::size_t> sample_id_;  // sample_id -> bag index
+};
+
+}
+
+#endif // BAG_READER_H
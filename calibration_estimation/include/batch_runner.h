@@ -0,0 +1,158 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include "optimization.h"
+#include "pose_initializer.h"
+
+#include <string>
+#include <vector>
+
+namespace calib
+{
+
+/// \brief One robot to calibrate
+struct BatchJob
+{
+  std::string              name;      // output files: <name>.urdf, <name>.json
+  std::string              urdf_file; // uncalibrated robot
+  std::string              bag_file;  // cal_measurements
+  std::vector<std::string> cameras;   // frame names, the first one is the reference
+  int                      threads;   // thread budget (solver, PnP, ingestion)
+};
+
+/// \brief Outcome of one BatchJob
+struct BatchJobResult
+{
+  BatchJobResult() : ok(false), num_views(0), rms(0), wall_time(0) {}
+
+  std::string name;
+  bool        ok;
+  std::string message;    // error description (ok == false)
+  std::size_t num_views;
+  double      rms;        // pixels, after the optimization
+  double      wall_time;  // seconds
+};
+
+/** BatchRunner
+*
+* Headless calibration of several robots (no ROS master, no /tf or markers).
+* Each job has its own RobotState, Data and Optimization, and runs on its own
+* thread with its thread budget; jobs are started in manifest order as soon
+* as the budget fits in the free cores.
+*
+* For each job it writes <output_dir>/<name>.urdf (the input URDF with the
+* joint origins of the calibrated cameras updated) and <name>.json (Profiler
+* report), plus <output_dir>/summary.csv for all the jobs. With joint offsets
+* (full-chain calibration) it also writes <name>_joint_offsets.yaml.
+*
+*/
+class BatchRunner
+{
+public:
+  BatchRunner();
+
+  /// \brief Total thread budget (<= 0: one per hardware core)
+  void setNumCores(int num_cores) { num_cores_ = num_cores; }
+
+  /// \brief Directory of the output files (created if it does not exist)
+  void setOutputDir(const std::string &output_dir) { output_dir_ = output_dir; }
+
+  /// \brief Cache the processed views of each job as <output_dir>/<name>.dataset
+  /// (see DatasetCache)
+  void setDatasetCache(bool dataset_cache) { dataset_cache_ = dataset_cache; }
+
+  /// \brief Options of every job (see Optimization); the thread budget of
+  /// the job overrides SolverOptions::num_threads
+  void setAnalyticJacobian(bool analytic_jacobian) { analytic_jacobian_ = analytic_jacobian; }
+  void setBoardPose(bool board_pose)                { board_pose_ = board_pose; }
+  void setFusedResiduals(bool fused_residuals)      { fused_residuals_ = fused_residuals; }
+  void setSolverOptions(const SolverOptions &solver_options) { solver_options_ = solver_options; }
+  void setPoseInitializer(const PoseInitializer &pose_initializer) { pose_initializer_ = pose_initializer; }
+  void setJointOffsets(const std::vector<std::string> &joints, const std::string &target_frame)
+  { joint_offsets_ = joints; chain_target_frame_ = target_frame; }
+
+  /// \brief Read a manifest: one job per line, '#' starts a comment
+  ///   name  urdf_file  bag_file  camera_0,camera_1,...  [threads]
+  /// Relative paths are relative to the manifest directory.
+  static bool readManifest(const std::string &filename, std::vector<BatchJob> *jobs);
+
+  /// \brief Run all the jobs, results in the same order as jobs.
+  /// It returns false if any job failed or the summary could not be written.
+  bool run(const std::vector<BatchJob> &jobs, std::vector<BatchJobResult> *results) const;
+
+  /// \brief Run one job with the given number of threads
+  BatchJobResult runJob(const BatchJob &job, int threads) const;
+
+  /// \brief Write the results as CSV, false (and ROS_ERROR) on failure
+  static bool writeSummary(const std::string &filename,
+                           const std::vector<BatchJobResult> &results);
+
+private:
+  int         num_cores_;
+  std::string output_dir_;
+  bool        dataset_cache_;
+
+  bool            analytic_jacobian_;
+  bool            board_pose_;
+  bool            fused_residuals_;
+  SolverOptions   solver_options_;
+  PoseInitializer pose_initializer_;
+
+  std::vector<std::string> joint_offsets_;       // see Optimization::setJointOffsets()
+  std::string              chain_target_frame_;
+};
+
+/// \brief Write the URDF 'xml' with the joint origins of the cameras (except
+/// the reference, cameras[0]) taken from robot_state (see Optimization::updateParam)
+bool writeCalibratedUrdf(const std::string &xml,
+                         RobotState *robot_state,
+                         const std::vector<std::string> &cameras,
+                         const std::string &filename);
+
+/// \brief Write the estimated joint offsets as YAML ('joint_offsets' map,
+/// joint name -> offset added to the measured position)
+bool writeJointOffsets(const std::vector<std::string> &joints,
+                       const std::vector<double> &offsets,
+                       const std::string &filename);
+
+}
+
+#endif // BATCH_RUNNER_H
@@ -0,0 +1,93 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+#ifndef CALIBRATION_CONTEXT_H
+#define CALIBRATION_CONTEXT_H
+
+#include "symbol_table.h"
+
+#include <string>
+#include <vector>
+
+namespace calib
+{
+
+class Markers;
+class RobotState;
+class TargetRegistry;
+
+/** CalibrationContext
+*
+* State shared by the views of one calibration: the robot, the markers,
+* the calibration targets and the cameras being calibrated with their
+* current parameters. Each Data owns one (its views point to it), so several
+* calibrations (different robots or camera subsets) can run concurrently
+* in the same process, each one with its own Data and Optimization.
+*
+* The camera frame names of the views are interned in 'frames', so the views
+* and the cameras being calibrated can be matched by frame id.
+*
+*/
+struct CalibrationContext
+{
+  CalibrationContext() : robot_state(0), markers(0), target_registry(0) {}
+
+  RobotState           *robot_state;     // kinematic of the views (shared)
+  Markers              *markers;         // visualization
+  const TargetRegistry *target_registry; // 0: PR2 checkerboards
+
+  std::vector<std::string> cameras;      // cameras to be calibrated (frame names)
+  std::vector<int>         camera_ids;   // cameras to be calibrated (frame ids)
+  std::vector<double *>    camera_rot;   // camera parameters (Optimization)
+  std::vector<double *>    camera_trans; // camera parameters (Optimization)
+
+  mutable SymbolTable      frames;       // camera frame name <-> frame id
+
+  /// \brief Set the cameras to be calibrated (cameras and camera_ids)
+  void setCameras(const std::vector<std::string> &camera_frames)
+  {
+    cameras = camera_frames;
+    camera_ids.clear();
+    for (std::size_t i = 0; i < cameras.size(); i++)
+      camera_ids.push_back(frames.intern(cameras[i]));
+  }
+};
+
+}
+
+#endif // CALIBRATION_CONTEXT_H
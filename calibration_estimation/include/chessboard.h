@@ -62,7 +62,7 @@ public:
   /// get functions
   int getWidth()      { return width_;}
   int getHeight()     { return height_;}
-  int getSquareSize() { return square_size_;}
+  float getSquareSize() { return square_size_;}
 
   /// set function
   void setSize(int width, int height, float square_size);
@@ -73,17 +73,34 @@ private:
   float square_size_;  // meters, e.i: 0.108 => 108 mm
 };
 
+/// \brief PnP methods for findChessboardPose
+/// PNP_ITERATIVE: solvePnP CV_ITERATIVE (it can start from rvec, tvec)
+/// PNP_EPNP:      solvePnP CV_EPNP
+/// PNP_PLANAR:    closed form from the board homography (planar board, Z=0),
+///                fast but without the non-linear refinement
+enum PnPMethod { PNP_ITERATIVE, PNP_EPNP, PNP_PLANAR };
+
 /// \brief Find chessboard pose using solvePnP
+/// If use_extrinsic_guess is true, rvec and tvec are the initial pose
+/// (PNP_ITERATIVE only). It returns the reprojection error.
 double findChessboardPose(cv::InputArray objectPoints,
                           cv::InputArray imagePoints,
                           cv::InputArray cameraMatrix,
                           cv::InputArray distCoeffs,
                           cv::OutputArray rvec,
                           cv::OutputArray tvec,
-                          cv::OutputArray proj_points2D =cv::noArray());
+                          cv::OutputArray proj_points2D =cv::noArray(),
+                          int method =PNP_ITERATIVE,
+                          bool use_extrinsic_guess =false);
 
-// TODO: read this information from the system.yaml
-void getCheckboardSize(const std::string &target_id, ChessBoard *cb);
+/// \brief Pose of a planar board (Z=0) from the homography between the board
+/// and the normalized image points
+void planarChessboardPose(cv::InputArray objectPoints,
+                          cv::InputArray imagePoints,
+                          cv::InputArray cameraMatrix,
+                          cv::InputArray distCoeffs,
+                          cv::OutputArray rvec,
+                          cv::OutputArray tvec);
 
 }
 
@@ -63,6 +63,7 @@ void cv2kdl(const cv::InputArray t, KDL::Vector   *translation);
 
 /// KDL <-> URDF
 void kdl2urdf(const KDL::Frame &frame, urdf::Pose *pose);
+void urdf2kdl(const urdf::Pose &pose, KDL::Frame *frame);
 
 
 /// Serialization & Deserialization
@@ -74,7 +75,7 @@ void deserialize(const double   out[3], cv::Point3d *in);
 void   serialize(const cv::Point2d &in, double out[2]);
 void deserialize(const double   out[2], cv::Point2d *in);
 
-// vector<Point3d> <-> vector<double*>
+// vector<Point3d> <-> vector<double*> (allocates, the caller owns the memory)
 void   serialize(const std::vector<cv::Point3d> &in, std::vector<double *> *out);
 void deserialize(const std::vector<double *>   &out, std::vector<cv::Point3d> *in);
 
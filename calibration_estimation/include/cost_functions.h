@@ -42,6 +42,7 @@
 #include "ceres/rotation.h"
 
 #include <opencv2/core/mat.hpp>
+#include <vector>
 
 #include "projection.h"
 
@@ -154,6 +155,481 @@ struct ReprojectionErrorWithQuaternions
 };
 
 
+/// Same residual as ReprojectionErrorWithQuaternions, but the jacobians are
+/// computed in closed form instead of using dual numbers (AutoDiff).
+/// The quaternion is normalized as in ceres::QuaternionRotatePoint, so the
+/// result matches the AutoDiff version.
+class ReprojectionErrorAnalytic : public ceres::SizedCostFunction<2, 4, 3, 3>
+{
+public:
+  ReprojectionErrorAnalytic(double observed_x, double observed_y,
+                            double fx, double fy, double cx, double cy)
+    : observed_x(observed_x), observed_y(observed_y),
+      fx(fx), fy(fy), cx(cx), cy(cy) {}
+
+  virtual ~ReprojectionErrorAnalytic() {}
+
+  virtual bool Evaluate(double const* const* parameters,
+                        double* residuals,
+                        double** jacobians) const
+  {
+    const double *q = parameters[0];
+    const double *t = parameters[1];
+    const double *X = parameters[2];
+
+    const double a = q[0], b = q[1], c = q[2], d = q[3];
+    const double aa = a*a, bb = b*b, cc = c*c, dd = d*d;
+    const double ab = a*b, ac = a*c, ad = a*d;
+    const double bc = b*c, bd = b*d, cd = c*d;
+
+    // R(q) = M(q) / |q|^2, so the quaternion does not need to be unit
+    const double M[9] = { aa + bb - cc - dd, 2.0*(bc - ad),     2.0*(bd + ac),
+                          2.0*(bc + ad),     aa - bb + cc - dd, 2.0*(cd - ab),
+                          2.0*(bd - ac),     2.0*(cd + ab),     aa - bb - cc + dd };
+    const double inv_n = 1.0 / (aa + bb + cc + dd);
+
+    // u = M(q) * X
+    const double u[3] = { M[0]*X[0] + M[1]*X[1] + M[2]*X[2],
+                          M[3]*X[0] + M[4]*X[1] + M[5]*X[2],
+                          M[6]*X[0] + M[7]*X[1] + M[8]*X[2] };
+
+    // p = R(q) * X + t
+    const double p[3] = { u[0]*inv_n + t[0],
+                          u[1]*inv_n + t[1],
+                          u[2]*inv_n + t[2] };
+
+    const double inv_z = 1.0 / p[2];
+    const double xp = p[0] * inv_z;
+    const double yp = p[1] * inv_z;
+
+    residuals[0] = fx * xp + cx - observed_x;
+    residuals[1] = fy * yp + cy - observed_y;
+
+    if (jacobians == NULL)
+      return true;
+
+    // d(residuals)/dp (2x3, row-major)
+    const double Jp[6] = { fx*inv_z, 0.0,      -fx*xp*inv_z,
+                           0.0,      fy*inv_z, -fy*yp*inv_z };
+
+    // rotation: dp/dq = (dM/dq * X) / |q|^2 - u * 2q / |q|^4
+    if (jacobians[0] != NULL)
+    {
+      const double du[12] = {
+        a*X[0] - d*X[1] + c*X[2],  b*X[0] + c*X[1] + d*X[2], -c*X[0] + b*X[1] + a*X[2], -d*X[0] - a*X[1] + b*X[2],
+        d*X[0] + a*X[1] - b*X[2],  c*X[0] - b*X[1] - a*X[2],  b*X[0] + c*X[1] + d*X[2],  a*X[0] - d*X[1] + c*X[2],
+       -c*X[0] + b*X[1] + a*X[2],  d*X[0] + a*X[1] - b*X[2], -a*X[0] + d*X[1] - c*X[2],  b*X[0] + c*X[1] + d*X[2] };
+
+      double dp_dq[12];
+      for (int i = 0; i < 3; i++)
+        for (int k = 0; k < 4; k++)
+          dp_dq[4*i + k] = 2.0 * inv_n * (du[4*i + k] - u[i] * q[k] * inv_n);
+
+      for (int r = 0; r < 2; r++)
+        for (int k = 0; k < 4; k++)
+          jacobians[0][4*r + k] = Jp[3*r + 0] * dp_dq[k]
+                                + Jp[3*r + 1] * dp_dq[4 + k]
+                                + Jp[3*r + 2] * dp_dq[8 + k];
+    }
+
+    // translation: dp/dt = I
+    if (jacobians[1] != NULL)
+    {
+      for (int i = 0; i < 6; i++)
+        jacobians[1][i] = Jp[i];
+    }
+
+    // point: dp/dX = R(q)
+    if (jacobians[2] != NULL)
+    {
+      for (int r = 0; r < 2; r++)
+        for (int k = 0; k < 3; k++)
+          jacobians[2][3*r + k] = inv_n * (Jp[3*r + 0] * M[k]
+                                         + Jp[3*r + 1] * M[3 + k]
+                                         + Jp[3*r + 2] * M[6 + k]);
+    }
+
+    return true;
+  }
+
+  // Factory to hide the construction of the CostFunction object from
+  // the client code.
+  static ceres::CostFunction* Create(const double observed_x,
+                                     const double observed_y,
+                                     const double fx,
+                                     const double fy,
+                                     const double cx,
+                                     const double cy)
+  {
+    return new ReprojectionErrorAnalytic(observed_x, observed_y, fx, fy, cx, cy);
+  }
+
+  double observed_x;
+  double observed_y;
+  double fx;
+  double fy;
+  double cx;
+  double cy;
+};
+
+
+/// Reprojection error of a board corner, with the view parameterized by the
+/// pose of the board (rotation, translation) in the frame of the reference
+/// camera, instead of free 3D points. The corner is the (fixed) board model
+/// point given by ChessBoard::generateCorners.
+struct BoardPoseReprojectionError
+{
+  BoardPoseReprojectionError(double observed_x, double observed_y,
+                             double fx, double fy, double cx, double cy,
+                             const double corner[3])
+    : observed_x(observed_x), observed_y(observed_y),
+      fx(fx), fy(fy), cx(cx), cy(cy)
+  {
+    this->corner[0] = corner[0];
+    this->corner[1] = corner[1];
+    this->corner[2] = corner[2];
+  }
+
+  template <typename T>
+  bool operator()(const T* const camera_rotation,
+                  const T* const camera_translation,
+                  const T* const board_rotation,
+                  const T* const board_translation,
+                  T *residuals) const
+  {
+    // corner in the reference camera frame
+    const T model[3] = { T(corner[0]), T(corner[1]), T(corner[2]) };
+    T point[3];
+    ceres::QuaternionRotatePoint(board_rotation, model, point);
+    point[0] += board_translation[0];
+    point[1] += board_translation[1];
+    point[2] += board_translation[2];
+
+    calc_residuals(observed_x, observed_y, fx, fy, cx, cy,      // data
+                   camera_rotation, camera_translation, point,  // parameters
+                   residuals);                                  // residuals
+
+    return true;
+  }
+
+  // Factory to hide the construction of the CostFunction object from
+  // the client code.
+  static ceres::CostFunction* Create(const double observed_x,
+                                     const double observed_y,
+                                     const double fx,
+                                     const double fy,
+                                     const double cx,
+                                     const double cy,
+                                     const double corner[3])
+  {
+    return (new ceres::AutoDiffCostFunction<BoardPoseReprojectionError, 2, 4, 3, 4, 3>(
+                new BoardPoseReprojectionError(observed_x, observed_y, fx, fy, cx, cy, corner)));
+  }
+
+  double observed_x;
+  double observed_y;
+  double fx;
+  double fy;
+  double cx;
+  double cy;
+  double corner[3];
+};
+
+
+/// Same residuals as BoardPoseReprojectionError, but for all the corners of
+/// one camera-view pair in a single block of 2*WIDTH*HEIGHT residuals, so
+/// ceres handles one block per camera-view instead of one per corner. The
+/// board to camera transformation is computed once for the block and the
+/// corners are projected in a fixed-size loop.
+template <int WIDTH, int HEIGHT>
+struct BoardViewReprojectionError
+{
+  enum { NUM_CORNERS = WIDTH * HEIGHT };
+
+  BoardViewReprojectionError(const double *observed,  // u0, v0, u1, v1, ...
+                             double fx, double fy, double cx, double cy,
+                             const double *corners)   // x0, y0, z0, x1, ...
+    : fx(fx), fy(fy), cx(cx), cy(cy)
+  {
+    for (int k = 0; k < 2*NUM_CORNERS; k++)
+      this->observed[k] = observed[k];
+    for (int k = 0; k < 3*NUM_CORNERS; k++)
+      this->corners[k] = corners[k];
+  }
+
+  template <typename T>
+  bool operator()(const T* const camera_rotation,
+                  const T* const camera_translation,
+                  const T* const board_rotation,
+                  const T* const board_translation,
+                  T *residuals) const
+  {
+    // board to camera: [R|t] = [Rc|tc] * [Rb|tb]
+    T Rc[9], Rb[9];
+    ceres::QuaternionToRotation(camera_rotation, Rc);
+    ceres::QuaternionToRotation(board_rotation, Rb);
+
+    T R[9], t[3];
+    for (int r = 0; r < 3; r++)
+    {
+      for (int c = 0; c < 3; c++)
+        R[3*r+c] = Rc[3*r]*Rb[c] + Rc[3*r+1]*Rb[3+c] + Rc[3*r+2]*Rb[6+c];
+
+      t[r] = Rc[3*r]*board_translation[0] + Rc[3*r+1]*board_translation[1] +
+             Rc[3*r+2]*board_translation[2] + camera_translation[r];
+    }
+
+    for (int j = 0; j < NUM_CORNERS; j++)
+    {
+      const double *M = &corners[3*j];
+      T px = R[0]*M[0] + R[1]*M[1] + R[2]*M[2] + t[0];
+      T py = R[3]*M[0] + R[4]*M[1] + R[5]*M[2] + t[1];
+      T pz = R[6]*M[0] + R[7]*M[1] + R[8]*M[2] + t[2];
+
+      residuals[2*j]   = T(fx) * (px / pz) + T(cx) - T(observed[2*j]);
+      residuals[2*j+1] = T(fy) * (py / pz) + T(cy) - T(observed[2*j+1]);
+    }
+
+    return true;
+  }
+
+  // Factory to hide the construction of the CostFunction object from
+  // the client code.
+  static ceres::CostFunction* Create(const double *observed,
+                                     const double fx,
+                                     const double fy,
+                                     const double cx,
+                                     const double cy,
+                                     const double *corners)
+  {
+    return (new ceres::AutoDiffCostFunction<BoardViewReprojectionError, 2*NUM_CORNERS, 4, 3, 4, 3>(
+                new BoardViewReprojectionError(observed, fx, fy, cx, cy, corners)));
+  }
+
+  double observed[2*NUM_CORNERS];
+  double fx;
+  double fy;
+  double cx;
+  double cy;
+  double corners[3*NUM_CORNERS];
+};
+
+/// \brief BoardViewReprojectionError for the PR2 board sizes (TargetRegistry)
+/// (7x6, 4x5). Returns NULL for other sizes (use one block per corner).
+inline ceres::CostFunction *createBoardViewReprojectionError(int width, int height,
+                                                             const double *observed,
+                                                             double fx, double fy,
+                                                             double cx, double cy,
+                                                             const double *corners)
+{
+  if (width == 7 && height == 6)
+    return BoardViewReprojectionError<7, 6>::Create(observed, fx, fy, cx, cy, corners);
+  if (width == 4 && height == 5)
+    return BoardViewReprojectionError<4, 5>::Create(observed, fx, fy, cx, cy, corners);
+
+  return NULL;
+}
+
+
+/// One moving joint of a KinematicChain: the fixed transform from the
+/// previous joint frame, the joint axis (unit, in its own frame), the joint
+/// position measured in the view (ChainMeasurement) and the index of its
+/// offset parameter block (-1: no offset, the measured position is used).
+struct ChainJoint
+{
+  double rotation[9];     // fixed transform (row-major rotation)
+  double translation[3];  // fixed transform (translation)
+  double axis[3];
+  bool   prismatic;       // translation along the axis (false: rotation)
+  double position;
+  int    offset;
+};
+
+/// Kinematic chain from the robot root to a link, for one view:
+/// T = A_0 * J_1(q_1 + d_1) * A_1 * ... * J_n(q_n + d_n) * A_n, where A_k are
+/// the fixed transforms, q_k the measured positions and d_k the offsets.
+struct KinematicChain
+{
+  std::vector<ChainJoint> joints;
+  double tip_rotation[9];     // A_n (row-major rotation)
+  double tip_translation[3];  // A_n (translation)
+};
+
+/// \brief [R|t] = [R|t] * [Ra|ta], with a constant (double) [Ra|ta]
+template <typename T>
+void composeFixed(const double Ra[9], const double ta[3], T R[9], T t[3])
+{
+  T R0[9];
+  for (int k = 0; k < 9; k++)
+    R0[k] = R[k];
+
+  for (int r = 0; r < 3; r++)
+  {
+    t[r] += R0[3*r]*ta[0] + R0[3*r+1]*ta[1] + R0[3*r+2]*ta[2];
+    for (int c = 0; c < 3; c++)
+      R[3*r+c] = R0[3*r]*Ra[c] + R0[3*r+1]*Ra[3+c] + R0[3*r+2]*Ra[6+c];
+  }
+}
+
+/// \brief Transform of the chain (root to tip) with the offsets parameter
+/// blocks (one double each), R row-major
+template <typename T>
+void chainTransform(const KinematicChain &chain, T const* const* offsets,
+                    T R[9], T t[3])
+{
+  for (int k = 0; k < 9; k++)
+    R[k] = T(k % 4 == 0 ? 1.0 : 0.0);
+  t[0] = t[1] = t[2] = T(0.0);
+
+  for (size_t i = 0; i < chain.joints.size(); i++)
+  {
+    const ChainJoint &joint = chain.joints[i];
+    composeFixed(joint.rotation, joint.translation, R, t);
+
+    T q = T(joint.position);
+    if (joint.offset >= 0)
+      q += offsets[joint.offset][0];
+
+    const double *a = joint.axis;
+    if (joint.prismatic)
+    {
+      // t += R * (axis * q)
+      for (int r = 0; r < 3; r++)
+        t[r] += (R[3*r]*a[0] + R[3*r+1]*a[1] + R[3*r+2]*a[2]) * q;
+    }
+    else
+    {
+      // R *= Rot(axis, q) = I + sin(q) [a]x + (1 - cos(q)) [a]x^2 (unit axis)
+      T s = sin(q);
+      T c = T(1.0) - cos(q);
+      T Rj[9] = { T(1.0) + c*(a[0]*a[0] - 1.0), c*a[0]*a[1] - s*a[2],          c*a[0]*a[2] + s*a[1],
+                  c*a[0]*a[1] + s*a[2],          T(1.0) + c*(a[1]*a[1] - 1.0), c*a[1]*a[2] - s*a[0],
+                  c*a[0]*a[2] - s*a[1],          c*a[1]*a[2] + s*a[0],          T(1.0) + c*(a[2]*a[2] - 1.0) };
+
+      T R0[9];
+      for (int k = 0; k < 9; k++)
+        R0[k] = R[k];
+      for (int r = 0; r < 3; r++)
+        for (int cc = 0; cc < 3; cc++)
+          R[3*r+cc] = R0[3*r]*Rj[cc] + R0[3*r+1]*Rj[3+cc] + R0[3*r+2]*Rj[6+cc];
+    }
+  }
+
+  composeFixed(chain.tip_rotation, chain.tip_translation, R, t);
+}
+
+/// Reprojection error of the board corners seen by camera i in one view,
+/// with the board rigidly attached to a link of the robot (e.g. the gripper)
+/// and the forward kinematic of the chains as part of the model:
+///
+///   p = [Rc|tc] * FK(camera 0)^-1 * FK(target) * [Rb|tb] * X
+///
+/// [Rc|tc] is camera i in the frame of camera 0 (as in the other residuals),
+/// [Rb|tb] the board in the target link frame, and the joints of both chains
+/// (root to camera 0, root to target link) can have an offset parameter
+/// block, so the joint offsets are estimated with exact derivatives.
+/// Parameter blocks: camera_rotation[4], camera_translation[3],
+/// board_rotation[4], board_translation[3], offset[1] x num_offsets.
+struct ChainReprojectionError
+{
+  ChainReprojectionError(const std::vector<double> &observed,  // u0, v0, u1, v1, ...
+                         const std::vector<double> &corners,   // x0, y0, z0, x1, ...
+                         double fx, double fy, double cx, double cy,
+                         const KinematicChain &camera_chain,
+                         const KinematicChain &target_chain)
+    : observed(observed), corners(corners), fx(fx), fy(fy), cx(cx), cy(cy),
+      camera_chain(camera_chain), target_chain(target_chain) {}
+
+  template <typename T>
+  bool operator()(T const* const* parameters, T *residuals) const
+  {
+    const T *camera_rotation    = parameters[0];
+    const T *camera_translation = parameters[1];
+    const T *board_rotation     = parameters[2];
+    const T *board_translation  = parameters[3];
+    T const* const* offsets     = parameters + 4;
+
+    // root to camera 0 and root to target link
+    T Ra[9], ta[3], Rt[9], tt[3];
+    chainTransform(camera_chain, offsets, Ra, ta);
+    chainTransform(target_chain, offsets, Rt, tt);
+
+    // target link in camera 0: [M|m] = [Ra|ta]^-1 * [Rt|tt]
+    T M[9], m[3];
+    for (int r = 0; r < 3; r++)
+    {
+      m[r] = Ra[r]*(tt[0] - ta[0]) + Ra[3+r]*(tt[1] - ta[1]) + Ra[6+r]*(tt[2] - ta[2]);
+      for (int c = 0; c < 3; c++)
+        M[3*r+c] = Ra[r]*Rt[c] + Ra[3+r]*Rt[3+c] + Ra[6+r]*Rt[6+c];
+    }
+
+    // board to camera i: [R|t] = [Rc|tc] * [M|m] * [Rb|tb]
+    T Rc[9], Rb[9];
+    ceres::QuaternionToRotation(camera_rotation, Rc);
+    ceres::QuaternionToRotation(board_rotation, Rb);
+
+    T MRb[9], Mtb[3];
+    for (int r = 0; r < 3; r++)
+    {
+      Mtb[r] = M[3*r]*board_translation[0] + M[3*r+1]*board_translation[1] +
+               M[3*r+2]*board_translation[2] + m[r];
+      for (int c = 0; c < 3; c++)
+        MRb[3*r+c] = M[3*r]*Rb[c] + M[3*r+1]*Rb[3+c] + M[3*r+2]*Rb[6+c];
+    }
+
+    T R[9], t[3];
+    for (int r = 0; r < 3; r++)
+    {
+      t[r] = Rc[3*r]*Mtb[0] + Rc[3*r+1]*Mtb[1] + Rc[3*r+2]*Mtb[2] + camera_translation[r];
+      for (int c = 0; c < 3; c++)
+        R[3*r+c] = Rc[3*r]*MRb[c] + Rc[3*r+1]*MRb[3+c] + Rc[3*r+2]*MRb[6+c];
+    }
+
+    for (size_t j = 0; 2*j < observed.size(); j++)
+    {
+      const double *X = &corners[3*j];
+      T px = R[0]*X[0] + R[1]*X[1] + R[2]*X[2] + t[0];
+      T py = R[3]*X[0] + R[4]*X[1] + R[5]*X[2] + t[1];
+      T pz = R[6]*X[0] + R[7]*X[1] + R[8]*X[2] + t[2];
+
+      residuals[2*j]   = T(fx) * (px / pz) + T(cx) - T(observed[2*j]);
+      residuals[2*j+1] = T(fy) * (py / pz) + T(cy) - T(observed[2*j+1]);
+    }
+
+    return true;
+  }
+
+  // Factory to hide the construction of the CostFunction object from
+  // the client code.
+  static ceres::CostFunction* Create(const ChainReprojectionError &error,
+                                     int num_offsets)
+  {
+    ceres::DynamicAutoDiffCostFunction<ChainReprojectionError, 4> *cost_function =
+      new ceres::DynamicAutoDiffCostFunction<ChainReprojectionError, 4>(
+        new ChainReprojectionError(error));
+
+    cost_function->AddParameterBlock(4);  // camera_rotation
+    cost_function->AddParameterBlock(3);  // camera_translation
+    cost_function->AddParameterBlock(4);  // board_rotation
+    cost_function->AddParameterBlock(3);  // board_translation
+    for (int k = 0; k < num_offsets; k++)
+      cost_function->AddParameterBlock(1);
+    cost_function->SetNumResiduals(error.observed.size());
+
+    return cost_function;
+  }
+
+  std::vector<double> observed;
+  std::vector<double> corners;
+  double fx;
+  double fy;
+  double cx;
+  double cy;
+  KinematicChain camera_chain;
+  KinematicChain target_chain;
+};
+
+
 // not optimazing points
 struct ReprojectionErrorWithQuaternions2
 {
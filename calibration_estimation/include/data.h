@@ -39,6 +39,8 @@
 #define DATA_H
 
 #include "view.h"
+#include "observation_store.h"
+#include "pose_initializer.h"
 
 namespace calib
 {
@@ -51,6 +53,8 @@ class RobotState;
 * Data manipulater: it can be inside the optimazer but it will also used
 * for visualization.
 *
+* It owns the CalibrationContext of its views, so it is not copyable.
+*
 */
 class Data
 {
@@ -58,12 +62,63 @@ public:
   Data();
   ~Data();
 
-  static void setRobotState(RobotState *robot_state);
-  static void setMarkers(Markers *markers_);
+  void setRobotState(RobotState *robot_state);
+  void setMarkers(Markers *markers);
+  void setTargetRegistry(const TargetRegistry *target_registry);
+
+  /// \brief Context shared by the views (robot state, targets, cameras)
+  CalibrationContext &context() { return context_; }
+  const CalibrationContext &context() const { return context_; }
 
   /// \brief Add one RobotMeasurement
   void addMeasurement(const Msg &msg);
 
+  /// \brief Add several RobotMeasurements, generating the views in parallel.
+  /// Each thread uses its own RobotState (created from the context URDF)
+  /// and the views are added in the same order as 'msgs'.
+  /// num_threads <= 0 means one thread per hardware core.
+  void addMeasurements(const std::vector<Msg> &msgs, int num_threads = 0);
+
+  /// \brief Process the views in joint-space proximity order (false by
+  /// default): addMeasurements(), updateViews() and DatasetCache. The views
+  /// keep the order of the messages.
+  void setViewOrdering(bool view_ordering)
+  { view_ordering_ = view_ordering; view_order_.clear(); }
+  bool getViewOrdering() const { return view_ordering_; }
+
+  /// \brief Processing order of msgs (indexes): jointSpaceOrder() if view
+  /// ordering is enabled, otherwise the same order
+  void processingOrder(const std::vector<Msg> &msgs,
+                       std::vector<std::size_t> *order) const;
+
+  /// \brief Greedy nearest neighbour tour of msgs in joint space, starting at
+  /// msgs[0], so consecutive views change as few joints as possible (the
+  /// distance is the number of joints that differ by more than tolerance,
+  /// ties broken by L1 norm). O(n^2 J) for n messages and J joints, run once
+  /// when the views are added.
+  static void jointSpaceOrder(const std::vector<Msg> &msgs,
+                              std::vector<std::size_t> *order,
+                              double tolerance = 1e-9);
+
+  /// \brief Append the processing order of the new views [first, size())
+  /// to the stored one used by updateViews(). 'order' is relative to first
+  /// (as returned by processingOrder()); without it, it is computed from the
+  /// view messages.
+  void orderViews(std::size_t first, const std::vector<std::size_t> &order);
+  void orderViews(std::size_t first);
+
+  /// \brief Bring the views [first, size()) up to date (kinematics and
+  /// calc_error()) with the context robot state and cameras, see
+  /// setViewOrdering()
+  void updateViews(std::size_t first = 0);
+
+  /// \brief Board pose initialization used by addMeasurement(s) and BagReader
+  void setPoseInitializer(const PoseInitializer &pose_initializer)
+  { pose_initializer_ = pose_initializer; }
+
+  /// \brief Rebuild the observation table for the given cameras (frame names)
+  void buildObservations(const std::vector<std::string> &cameras);
+
   /// \brief Publish View (checkerboards, /tf, joint angles)
   void showView(std::size_t id);
   void showView(std::size_t id, const std::vector<std::string> &camera_frames);
@@ -72,14 +127,12 @@ public:
   std::size_t size() { return view_.size(); }
 
   /// \brief Clear views
-  void clear() { view_.clear(); }
-
-  // static members
-  static Markers    *markers_;
-  static RobotState *robot_state_;
+  void clear() { view_.clear(); view_order_.clear(); }
 
   // public members
   std::vector<View> view_;
+  ObservationStore  observations_;  // buildObservations(), same order as view_
+  PoseInitializer   pose_initializer_;
 
 // private:
   /// \brief Update robot state with the measured joint angles
@@ -95,6 +148,19 @@ public:
                        const std::string &frame1,
                        const std::string &frame2,
                        cv::Mat *modif_points);
+
+private:
+  CalibrationContext context_;
+  bool               view_ordering_; // see setViewOrdering()
+  std::vector<std::size_t> view_order_; // processing order of view_, see orderViews()
+
+  /// \brief Append the processing order of the views [first, last),
+  /// ordering [0, first) too if it is missing
+  void orderRange(std::size_t first, std::size_t last);
+
+  // non-copyable (the views point to context_)
+  Data(const Data &);
+  Data &operator=(const Data &);
 };
 
 }
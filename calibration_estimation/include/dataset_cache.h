@@ -0,0 +1,108 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+
+#ifndef DATASET_CACHE_H
+#define DATASET_CACHE_H
+
+#include <map>
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace calib
+{
+
+class Data;
+
+/** DatasetCache
+*
+* Binary cache of the processed views of a bag: the measurement messages
+* without the debug payload (chains, camera infos, image points) and the
+* initial board poses found with solvePnP (rvec, tvec, error and expected
+* points of each camera). It is written after the first ingestion and read
+* (memory-mapped) on later runs, so the bag is not parsed again and solvePnP
+* is not repeated. The file is valid only for the bag it was created from
+* (bag hash), for the same ingestion configuration (config hash: PnP method,
+* FK seed and target definitions) and for the same format version.
+*
+* Layout (host byte order):
+*   header: magic[8] "CALIBDS", version (uint32), num_views (uint32),
+*           bag_hash (uint64), config_hash (uint64)
+*   view:   msg_size (uint32), msg (ROS serialization), num_cams (uint32),
+*           and for each camera: rvec[3], tvec[3], error (double),
+*           num_points (uint32), expected points (2 x num_points doubles)
+*
+*/
+class DatasetCache
+{
+public:
+  static const boost::uint32_t VERSION = 2;
+
+  explicit DatasetCache(const std::string &filename);
+  ~DatasetCache();
+
+  /// \brief Hash of a bag file: its size, device, inode and modification
+  /// time, and its first and last MiB (where rosbag keeps the header and the
+  /// index), so it is cheap to compute. A copied or touched bag is parsed
+  /// again. Returns 0 if the file cannot be read.
+  static boost::uint64_t hashFile(const std::string &filename);
+
+  /// \brief Hash of the ingestion configuration of data: PnP method and FK
+  /// seed of its PoseInitializer, and its targets (PR2 checkerboards if the
+  /// context has no TargetRegistry)
+  static boost::uint64_t hashConfig(const Data &data);
+
+  /// \brief Write all the views of data. Returns false on error or if a
+  /// view has no initial board poses (nothing is written then).
+  bool write(boost::uint64_t bag_hash, const Data &data);
+
+  /// \brief Add the cached views to data (if the file exists, has the same
+  /// version and was created from the same bag with the same configuration,
+  /// see hashConfig()). The views are completed
+  /// with the robot state of data as in generateView(), but without solvePnP.
+  /// sample_id (optional) maps sample_id -> view index.
+  bool load(boost::uint64_t bag_hash,
+            Data *data,
+            std::map<std::string, int> *sample_id = 0);
+
+private:
+  std::string filename_;
+};
+
+}
+
+#endif // DATASET_CACHE_H
@@ -38,6 +38,8 @@
 #ifndef JOINT_STATE_H
 #define JOINT_STATE_H
 
+#include "symbol_table.h"
+
 #include <vector>
 #include <string>
 #include <map>
@@ -45,6 +47,13 @@
 namespace calib
 {
 
+/** JointState
+*
+* Joint positions, stored in a flat vector indexed by joint index (the joint
+* names are interned by initString(), in the given order). The name-based
+* methods are kept for convenience, the index-based ones avoid the lookups.
+*
+*/
 class JointState
 {
 public:
@@ -70,15 +79,38 @@ public:
   bool update(const std::vector<std::string> &joint_name,
               const std::vector<double>      &position);
 
-  /// \brief get Joint Names vector
+  /// \brief Update one joint position by joint index (see getJointIndex())
+  bool update(int joint_idx, double position);
+
+  /// \brief Joint index (-1 if the joint does not exist)
+  int getJointIndex(const std::string &joint_name) const { return joint_symbols_.find(joint_name); }
+
+  /// \brief Joint name of a joint index
+  const std::string &getJointNameByIndex(int joint_idx) const { return joint_symbols_.name(joint_idx); }
+
+  /// \brief Number of joints (indexes are 0 .. getNrOfJoints()-1)
+  std::size_t getNrOfJoints() const { return position_.size(); }
+
+  /// \brief Joint position by joint index
+  double getPosition(int joint_idx) const { return position_[joint_idx]; }
+
+  /// \brief get Joint Names vector (joint index order)
   void getJointNames(std::vector<std::string> *joint_name) const;
 
-  /// \brief get Joint Positions vector
+  /// \brief get Joint Positions vector (joint index order)
   void getJointPositions(std::vector<double> *joint_position) const;
-  const JointStateType &getJointPositions() const { return joint_positions_; }
+  const std::vector<double> &getPositions() const { return position_; }
+
+  /// \brief get Joint Positions by name
+  JointStateType getJointPositions() const;
+
+  /// \brief Counter incremented every time the joint positions change
+  unsigned long getRevision() const { return revision_; }
 
 protected:
-  JointStateType joint_positions_;
+  SymbolTable         joint_symbols_; // joint name <-> joint index
+  std::vector<double> position_;      // joint index -> position
+  unsigned long       revision_;
 };
 
 }
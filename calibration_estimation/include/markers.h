@@ -51,6 +51,14 @@ namespace calib
 cv::Scalar chooseRandomColor();
 cv::Scalar chooseColor(int i);
 
+/** Markers
+*
+* MarkerArray of the checkerboards. Publishing is coalesced: the timer
+* (publish_frequency, default 50 Hz) only publishes when the markers have
+* changed since the last publish. In headless mode nothing is published
+* unless flush() is called.
+*
+*/
 class Markers
 {
 public:
@@ -71,6 +79,15 @@ public:
   void puslish();
   void puslish(const ros::TimerEvent &e);
 
+  /// \brief Publish now if there are changes (also in headless mode)
+  void flush();
+
+  /// \brief Stop (true) or resume (false) the periodic publishing
+  void setHeadless(bool headless);
+
+  /// \brief Number of MarkerArrays published
+  std::size_t getPublishCount() const { return publish_count_; }
+
 protected:
   /// \brief Set markers properties
   void setMarkers(const int id,  // needed for MarkerArray
@@ -84,6 +101,9 @@ protected:
   void points2markers(const cv::Mat &board_measured_pts_3D,
                     visualization_msgs::Marker *marker);
 
+  /// \brief Timer: publish only if the markers changed
+  void publishChanges(const ros::TimerEvent &e);
+
 private:
   ros::NodeHandle nh_;
   ros::Publisher  publisher_;
@@ -94,6 +114,10 @@ private:
   visualization_msgs::MarkerArray marker_array_;
 
   std::size_t current_id_; // using same id override previous markers
+
+  bool        dirty_;         // changed since the last publish
+  bool        headless_;      // no periodic publishing
+  std::size_t publish_count_;
 };
 
 
@@ -0,0 +1,114 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+
+#ifndef OBSERVATION_STORE_H
+#define OBSERVATION_STORE_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace calib
+{
+
+class View;
+
+/** ObservationStore
+*
+* Dataset-wide table of the 2D observations, stored by columns: for each
+* observation k, view(k), camera(k), corner(k) and the measured pixel
+* (u(k), v(k)). The rows of a view are contiguous, [viewBegin(v), viewEnd(v)),
+* and sorted by camera and then by corner, so the residuals, the errors and
+* the triangulation run over plain arrays instead of the per-View containers.
+* The cameras are the ones being calibrated (same index as the camera
+* parameter blocks) and their intrinsics are kept in a per-camera table.
+*
+*/
+class ObservationStore
+{
+public:
+  ObservationStore();
+  ~ObservationStore();
+
+  /// \brief Forget all observations and set the cameras (frame names)
+  void clear(const std::vector<std::string> &cameras);
+
+  /// \brief Append the observations of the next view (views must be added in
+  /// order). Cameras of the view not in the list are ignored.
+  void addView(const View &view);
+
+  /// \brief Sizes
+  std::size_t size() const       { return view_.size(); }
+  std::size_t numViews() const   { return view_begin_.size() - 1; }
+  std::size_t numCameras() const { return cameras_.size(); }
+
+  /// \brief Rows of view 'v'
+  std::size_t viewBegin(std::size_t v) const { return view_begin_[v]; }
+  std::size_t viewEnd(std::size_t v) const   { return view_begin_[v+1]; }
+
+  /// \brief Columns
+  int    view(std::size_t k) const   { return view_[k]; }
+  int    camera(std::size_t k) const { return camera_[k]; }
+  int    corner(std::size_t k) const { return corner_[k]; }
+  double u(std::size_t k) const      { return u_[k]; }
+  double v(std::size_t k) const      { return v_[k]; }
+
+  /// \brief Camera table (intrinsics: fx, fy, cx, cy)
+  const std::string &cameraFrame(std::size_t c) const { return cameras_[c]; }
+  const double *intrinsics(std::size_t c) const { return &intrinsics_[4*c]; }
+  bool hasIntrinsics(std::size_t c) const { return has_intrinsics_[c] != 0; }
+
+private:
+  // observation columns
+  std::vector<int>    view_;
+  std::vector<int>    camera_;
+  std::vector<int>    corner_;
+  std::vector<double> u_;
+  std::vector<double> v_;
+
+  std::vector<std::size_t> view_begin_;  // numViews()+1 (first row of each view)
+
+  // camera table
+  std::vector<std::string> cameras_;
+  std::vector<double>      intrinsics_;      // 4 x numCameras()
+  std::vector<char>        has_intrinsics_;  // set by the first view seeing it
+};
+
+}
+
+#endif // OBSERVATION_STORE_H
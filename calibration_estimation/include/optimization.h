@@ -40,6 +40,12 @@
 
 #include "data.h"
 #include "cost_functions.h"
+#include "parameter_store.h"
+#include "profiler.h"
+
+#include <ros/node_handle.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace calib
 {
@@ -47,6 +53,29 @@ namespace calib
 class RobotState;
 class Markers;
 
+/** SolverOptions
+*
+* Ceres solver configuration. 'linear_solver' can be "auto", "dense_qr",
+* "dense_schur", "sparse_schur" or "iterative_schur" (with SCHUR_JACOBI
+* preconditioner). In "auto" mode the linear solver is chosen from the
+* problem size (see Optimization::autoLinearSolver()).
+* num_threads <= 0 means one thread per hardware core.
+*
+*/
+struct SolverOptions
+{
+  SolverOptions();
+
+  /// \brief Read options from ROS params (e.g. ~solver/linear_solver)
+  void readParam(const ros::NodeHandle &n);
+
+  std::string linear_solver;
+  int         num_threads;
+  int         max_num_iterations;
+  double      function_tolerance;
+  bool        minimizer_progress_to_stdout;
+};
+
 class Optimization
 {
 public:
@@ -61,20 +90,110 @@ public:
   /// \brief Set vector of 'cameras_id' to be calibrated
   void setCamerasCalib(const std::vector<std::string> &cameras);
 
-  /// \brief Check is the state is valid
+  /// \brief Use closed-form jacobians (ReprojectionErrorAnalytic) instead of
+  /// AutoDiff (ReprojectionErrorWithQuaternions). Default: true
+  void setAnalyticJacobian(bool analytic_jacobian);
+
+  /// \brief Parameterize each view by the 6-DoF pose of the board (the corners
+  /// are the fixed board model) instead of free 3D points. Default: false
+  void setBoardPose(bool board_pose);
+
+  /// \brief In board pose mode, use one residual block per camera-view
+  /// (BoardViewReprojectionError) when the camera sees the whole board and
+  /// the board size has a specialization. Default: true
+  void setFusedResiduals(bool fused_residuals);
+
+  /// \brief Full-chain calibration: estimate an offset for each of these
+  /// joints together with the cameras. The board is rigidly attached to
+  /// 'target_frame' (e.g. the gripper) and each camera-view is one
+  /// ChainReprojectionError block (exact derivatives through the forward
+  /// kinematic). No joints (default): camera transformations only.
+  void setJointOffsets(const std::vector<std::string> &joints,
+                       const std::string &target_frame);
+
+  /// \brief Estimated joint offsets (same order as setJointOffsets()), also
+  /// applied to the RobotState forward kinematic (RobotState::setJointOffset()).
+  /// Empty without full-chain calibration.
+  void getJointOffsets(std::vector<double> *offsets) const;
+  const std::vector<std::string> &getJointOffsetNames() const { return joint_offsets_; }
+
+  /// \brief Kinematic chain from the root to link_idx. positions: measured
+  /// joint positions (joint index); offset_idx: offset parameter of each
+  /// joint (-1: none, the RobotState offset is added to the position)
+  static void buildChain(const RobotState &robot_state, int link_idx,
+                         const std::vector<double> &positions,
+                         const std::vector<int> &offset_idx,
+                         KinematicChain *chain);
+
+  /// \brief Linear solver of the "auto" mode. The views (board poses, 6
+  /// params) and points (3 params) are eliminated, leaving the reduced camera
+  /// system (7 params per camera):
+  ///  - "iterative_schur": too many residual blocks or eliminated parameters
+  ///    to build the reduced system explicitly
+  ///  - "sparse_schur": large reduced camera system
+  ///  - "dense_schur": otherwise
+  static std::string autoLinearSolver(std::size_t num_cameras,
+                                      std::size_t num_board_poses,
+                                      std::size_t num_points,
+                                      std::size_t num_residual_blocks);
+
+  /// \brief Set ceres solver configuration
+  void setSolverOptions(const SolverOptions &solver_options);
+
+  /// \brief Mutex of the Data views and the RobotState (0: none). run() and
+  /// runIncremental() hold it, except during the ceres solve, so other
+  /// threads can add views meanwhile (online calibration)
+  void setDataMutex(boost::mutex *data_mutex) { data_mutex_ = data_mutex; }
+
+  /// \brief Check is the state is valid (markers are optional: without them
+  /// nothing is shown, e.g. batch calibration without a ROS master)
   bool valid();
 
   /// \brief Run optimization process
   void run();
 
+  /// \brief Incremental (online) optimization: the views added to Data since
+  /// the last call are added to the existing problem as new residual blocks,
+  /// and the solver starts from the current camera parameters (warm start).
+  /// Only the new views are updated afterwards. The first call (without a
+  /// previous run()) initializes everything.
+  void runIncremental();
+
+  /// \brief Phases and solver iterations of the last run() (or of all the
+  /// runIncremental() calls)
+  const Profiler &getProfiler() const { return profiler_; }
+  void setProfilerLabel(const std::string &label) { profiler_.setLabel(label); }
+
 // private:
   void initialization();
   void addResiduals();
+  void addResiduals(std::size_t v);  // only view 'v'
   void solver();
-  void updateParam();
-//   void calcError();
+  void updateParam(std::size_t first_view = 0);  // views [first_view, size)
 
+  /// \brief RMS reprojection error (pixels) of the observations in the
+  /// problem, also per camera if camera_rms is given
+  double reprojectionError(std::vector<double> *camera_rms = 0);
+
+  /// \brief Triangulate the board corners of all the views (or view 'v')
+  /// from the observation table, saved in view.triang_pts_3D_
   void triangulation();
+  void triangulation(std::size_t v, const std::vector<cv::Matx34d> &Ps);
+
+  /// \brief K*[R|t] of each camera, from the current parameters
+  void projectionMatrices(std::vector<cv::Matx34d> *Ps);
+
+  /// \brief Full-chain residuals of view 'v' (see setJointOffsets())
+  void addChainResiduals(std::size_t v);
+
+  /// \brief Initial board pose in the target frame, from the first view
+  /// with a board pose of the reference camera
+  bool initTargetPose();
+
+  /// \brief Translate solver_options_ into ceres options, choosing the linear
+  /// solver from the number of cameras, views and points in "auto" mode
+  void configureSolver(ceres::Solver::Options *options);
+
 
 private:
   RobotState *robot_state_;
@@ -83,11 +202,47 @@ private:
 
   std::vector<std::string> cameras_;  // cameras to be calibrated (frame name)
 
-  ceres::Problem problem_;
+  bool analytic_jacobian_;            // cost function selection
+  bool board_pose_;                   // view parameterization: board pose / points
+  bool fused_residuals_;              // board pose: one block per camera-view
+  SolverOptions solver_options_;
+
+  // full-chain calibration (setJointOffsets())
+  std::vector<std::string> joint_offsets_;    // joints with an offset
+  std::string              target_frame_;     // link carrying the board
+  std::vector<int>         joint_offset_idx_; // joint index -> offset (-1: none)
+
+  boost::scoped_ptr<ceres::Problem> problem_;  // new problem for each run()
+  std::size_t num_views_added_;                // views already in problem_
+  boost::mutex *data_mutex_;                   // setDataMutex()
+
+  Profiler profiler_;                 // phase timing and solver telemetry
+
+  // parameter blocks memory (reused across run() calls)
+  ParameterStore parameters_;
 
-  std::vector<std::vector<double *> > param_point_3D_;
+  // pointers to the blocks inside parameters_
+  std::vector<std::vector<double *> > param_point_3D_;  // view -> points (empty: not used)
   std::vector<double *>               param_camera_rot_;
   std::vector<double *>               param_camera_trans_;
+  std::vector<double *>               param_board_rot_;    // view -> board pose
+  std::vector<double *>               param_board_trans_;  // (0: not used)
+  std::vector<double *>               param_joint_offset_; // offset -> block
+  double                             *param_target_rot_;   // board in target_frame_
+  double                             *param_target_trans_; // (0: not used)
+
+  // full-chain residual blocks (for reprojectionError())
+  struct ChainBlock
+  {
+    ChainBlock(int camera, const ChainReprojectionError &error,
+               const std::vector<double *> &parameters)
+      : camera(camera), error(error), parameters(parameters) {}
+
+    int                    camera;
+    ChainReprojectionError error;
+    std::vector<double *>  parameters;
+  };
+  std::vector<ChainBlock> chain_blocks_;
 };
 
 }
@@ -0,0 +1,128 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+
+#ifndef PARAMETER_STORE_H
+#define PARAMETER_STORE_H
+
+#include <vector>
+#include <cstddef>
+#include <opencv2/core/core.hpp>
+
+namespace calib
+{
+
+/** ParameterStore
+*
+* Arena for the optimization parameter blocks. Cameras are kept in two
+* contiguous buffers (rotations: 4 doubles, translations: 3 doubles) and the
+* 3D points of each view are stored contiguously (3 doubles per corner) in
+* large chunks, as are the board poses (7 doubles, used when the views are
+* parameterized by the pose of the board). Joint offsets (full-chain
+* calibration) are one double each. Adding blocks never moves the
+* previous ones, so the pointers given to ceres remain valid. clear() keeps
+* the memory for the next run, which is only released on destruction.
+*
+*/
+class ParameterStore
+{
+public:
+  ParameterStore();
+  ~ParameterStore();
+
+  /// \brief Forget all blocks (allocated memory is reused)
+  void clear();
+
+  /// \brief Allocate 'num_cameras' camera blocks (previous values are lost)
+  void setNumCameras(std::size_t num_cameras);
+
+  /// \brief Copy the points of a new view in the arena, return the view index
+  std::size_t addView(const std::vector<cv::Point3d> &points);
+
+  /// \brief New board pose (rotation[4], translation[3]), return its index
+  std::size_t addBoardPose();
+
+  /// \brief Allocate 'num_offsets' joint offset blocks (zero)
+  void setNumJointOffsets(std::size_t num_offsets) { joint_offset_.assign(num_offsets, 0.0); }
+
+  /// \brief Parameter blocks (camera: rotation[4], translation[3]; point[3])
+  double *cameraRotation(std::size_t camera)    { return &camera_rot_[4*camera]; }
+  double *cameraTranslation(std::size_t camera) { return &camera_trans_[3*camera]; }
+  double *point(std::size_t view, std::size_t corner) { return view_begin_[view] + 3*corner; }
+  double *boardRotation(std::size_t board)    { return board_begin_[board]; }
+  double *boardTranslation(std::size_t board) { return board_begin_[board] + 4; }
+  double *jointOffset(std::size_t offset)     { return &joint_offset_[offset]; }
+
+  /// \brief Sizes
+  std::size_t numCameras() const { return camera_rot_.size() / 4; }
+  std::size_t numViews() const   { return view_begin_.size(); }
+  std::size_t numPoints(std::size_t view) const { return view_size_[view]; }
+  std::size_t numBoardPoses() const { return board_begin_.size(); }
+  std::size_t numJointOffsets() const { return joint_offset_.size(); }
+
+  /// \brief Pointers to the blocks (as used by View and ceres)
+  void getCameraBlocks(std::vector<double *> *camera_rot,
+                       std::vector<double *> *camera_trans);
+  void getPointBlocks(std::size_t view, std::vector<double *> *points);
+
+private:
+  /// \brief Reserve 'size' contiguous doubles (new chunk if needed)
+  double *allocate(std::size_t size);
+
+private:
+  std::vector<double> camera_rot_;    // 4 x num_cameras
+  std::vector<double> camera_trans_;  // 3 x num_cameras
+  std::vector<double> joint_offset_;  // 1 x num_offsets
+
+  std::vector<double *>    chunks_;       // point memory (owned)
+  std::vector<std::size_t> chunk_size_;   // doubles in each chunk
+  std::size_t              chunk_idx_;    // current chunk
+  std::size_t              chunk_used_;   // doubles used in the current chunk
+
+  std::vector<double *>    view_begin_;   // view -> first point
+  std::vector<std::size_t> view_size_;    // view -> number of points
+
+  std::vector<double *>    board_begin_;  // board -> rotation, translation
+
+  // non-copyable (it owns the chunks)
+  ParameterStore(const ParameterStore &);
+  ParameterStore &operator=(const ParameterStore &);
+};
+
+}
+
+#endif // PARAMETER_STORE_H
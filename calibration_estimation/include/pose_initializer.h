@@ -0,0 +1,92 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+#ifndef POSE_INITIALIZER_H
+#define POSE_INITIALIZER_H
+
+#include "view.h"
+
+#include <string>
+#include <vector>
+
+namespace calib
+{
+
+/** PoseInitializer
+*
+* Dataset-level board pose initialization: solves the PnP problem of every
+* (view, camera) pair with a pool of worker threads. The reference camera
+* (index 0) of each view is solved first; the other cameras of the view are
+* then seeded with the board pose predicted from the reference camera through
+* the forward kinematic, so PNP_ITERATIVE converges in a few iterations. The
+* other methods take no initial guess: every camera is solved on its own.
+*
+*/
+class PoseInitializer
+{
+public:
+  PoseInitializer();
+
+  /// \brief Number of worker threads (<= 0: one per hardware core)
+  void setNumThreads(int num_threads) { num_threads_ = num_threads; }
+
+  /// \brief PnP method (see PnPMethod)
+  void setMethod(PnPMethod method) { method_ = method; }
+  PnPMethod getMethod() const { return method_; }
+
+  /// \brief Seed the non-reference cameras with the FK prediction (only
+  /// used by PNP_ITERATIVE)
+  void setFKSeed(bool fk_seed) { fk_seed_ = fk_seed; }
+  bool getFKSeed() const { return fk_seed_; }
+
+  /// \brief Parse "iterative", "epnp" or "planar"
+  static bool parseMethod(const std::string &name, PnPMethod *method);
+
+  /// \brief Find the board poses of views [first, views->size()). The views
+  /// must have been generated without poses (View::generateView(.., false))
+  void run(std::vector<View> *views, std::size_t first = 0) const;
+
+private:
+  int       num_threads_;
+  PnPMethod method_;
+  bool      fk_seed_;
+};
+
+}
+
+#endif // POSE_INITIALIZER_H
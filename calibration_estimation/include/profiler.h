@@ -0,0 +1,174 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <ceres/ceres.h>
+
+namespace calib
+{
+
+/// \brief Cost of one phase of the optimization (run(), runIncremental())
+struct PhaseStats
+{
+  std::string name;
+  double      wall_time;            // seconds
+  double      thread_cpu_time;      // seconds, calling thread only (concurrent
+                                    // batch jobs are not mixed)
+  double      process_cpu_time;     // seconds, all the threads (ceres workers,
+                                    // view generation, concurrent batch jobs)
+  long        peak_rss;             // KiB, process-wide peak after the phase
+                                    // (shared by all the jobs of the process)
+  int         num_residual_blocks;  // problem size after the phase
+  int         num_parameter_blocks;
+  int         num_parameters;
+};
+
+/// \brief One iteration of the ceres minimizer
+struct IterationStats
+{
+  int    solve;                     // solver() call
+  int    iteration;
+  bool   step_is_successful;
+  double cost;
+  double cost_change;
+  double gradient_max_norm;
+  double step_norm;
+  int    linear_solver_iterations;
+  double iteration_time;            // seconds
+  double step_solver_time;          // seconds
+  double cumulative_time;           // seconds
+};
+
+/** Profiler
+*
+* Phase-level instrumentation of the optimization: wall time, CPU time (of
+* the calling thread and of the whole process, the latter includes the
+* ceres worker threads but also any other job running concurrently in the
+* process), process peak RSS and problem size of each phase
+* (begin() / end()), and the per-iteration
+* telemetry of ceres (callback()). The report can be saved as JSON or CSV,
+* labeled (e.g. with the robot name) and time-stamped, to follow the cost
+* of the calibration over time.
+*
+*/
+class Profiler
+{
+public:
+  Profiler();
+  ~Profiler();
+
+  /// \brief Label of the report (e.g. robot name)
+  void setLabel(const std::string &label) { label_ = label; }
+
+  /// \brief Forget all the phases and iterations
+  void clear();
+
+  /// \brief Start/finish a phase (problem can be null)
+  void begin(const std::string &name);
+  void end(const ceres::Problem *problem);
+
+  /// \brief Callback for ceres::Solver::Options::callbacks (starts a new solve)
+  ceres::IterationCallback *callback();
+
+  /// \brief Collected data
+  const std::vector<PhaseStats>     &phases() const     { return phases_; }
+  const std::vector<IterationStats> &iterations() const { return iterations_; }
+
+  /// \brief Print the phases (ROS_INFO)
+  void print() const;
+
+  /// \brief Save the report, in CSV if the extension is ".csv", JSON otherwise
+  bool write(const std::string &filename) const;
+  bool writeJSON(const std::string &filename) const;
+  bool writeCSV(const std::string &filename) const;
+
+private:
+  class Callback : public ceres::IterationCallback
+  {
+  public:
+    explicit Callback(Profiler *profiler) : profiler_(profiler) {}
+    ceres::CallbackReturnType operator()(const ceres::IterationSummary &summary);
+
+  private:
+    Profiler *profiler_;
+  };
+
+  static double wallTime();
+  static double threadCpuTime();
+  static double processCpuTime();
+  static long   peakRss();
+
+  std::string label_;
+  std::vector<PhaseStats>     phases_;
+  std::vector<IterationStats> iterations_;
+
+  // current phase
+  std::string current_name_;
+  double      start_wall_;
+  double      start_thread_cpu_;
+  double      start_process_cpu_;
+
+  int      num_solves_;
+  Callback callback_;
+
+  // non-copyable (callback_ refers to this)
+  Profiler(const Profiler &);
+  Profiler &operator=(const Profiler &);
+};
+
+/// \brief Phase of the profiler delimited by the scope
+class ScopedPhase
+{
+public:
+  ScopedPhase(Profiler *profiler, const std::string &name, const ceres::Problem *problem)
+    : profiler_(profiler), problem_(problem) { profiler_->begin(name); }
+  ~ScopedPhase() { profiler_->end(problem_); }
+
+private:
+  Profiler             *profiler_;
+  const ceres::Problem *problem_;
+};
+
+}
+
+#endif // PROFILER_H
@@ -41,10 +41,10 @@
 #include "joint_state.h"
 
 #include <urdf/model.h>
+#include <boost/shared_ptr.hpp>
 #include <map>
 #include <kdl/tree.hpp>
 #include <kdl/jntarray.hpp>
-#include <kdl/treefksolverpos_recursive.hpp>
 
 namespace calib
 {
@@ -71,17 +71,51 @@ public:
                        const double angle,
                        KDL::Frame *pose) const;
 
-  /// \brief get pose (using the current joint angle in joint_positions_)
+  /// \brief get pose (using the current joint angle)
   void getRelativePose(const std::string &link_name,
                        KDL::Frame *pose) const;
 
   /// \brief get poses
   void getPoses(PosesType *poses) const;
 
-  /// \brief Get Forward Kinematic (recurvise), similar to getRelativePose but
+  /// \brief Get Forward Kinematic, similar to getRelativePose but
   /// the pose will be in the root frame ('base_footprint').
+  /// Compatibility wrapper of getFK(int, KDL::Frame*)
   bool getFK(const std::string &link_name, KDL::Frame *pose);
 
+  /// \brief Get Forward Kinematic by link index (see getLinkIndex()).
+  /// All link poses are computed in a single forward pass and cached. Later
+  /// calls only recompute the subtrees of the joints whose position changed
+  /// since the last evaluation (and of the patched joint origins).
+  bool getFK(int link_idx, KDL::Frame *pose);
+
+  /// \brief Get Forward Kinematic of all the links (indexed by link index)
+  const std::vector<KDL::Frame> &getFK();
+
+  /// \brief Link index in the compiled tree (-1 if it does not exist)
+  int getLinkIndex(const std::string &link_name) const { return link_symbols_.find(link_name); }
+
+  /// \brief Link name of a link index
+  const std::string &getLinkNameByIndex(int link_idx) const { return link_symbols_.name(link_idx); }
+
+  /// \brief Parent link index (-1 for the root)
+  int getParentIndex(int link_idx) const { return parent_idx_[link_idx]; }
+
+  /// \brief Joint index (see JointState::getJointIndex()) of the link (-1: fixed)
+  int getLinkJointIndex(int link_idx) const { return joint_idx_[link_idx]; }
+
+  /// \brief get pose by link index (relative to its parent, current joint angle)
+  void getRelativePose(int link_idx, KDL::Frame *pose) const;
+
+  /// \brief Segment (joint + tip) of a link index, with the patched origins
+  const KDL::Segment &getSegment(int link_idx) const { return segment_[link_idx]; }
+
+  /// \brief Number of links in the compiled tree
+  std::size_t getNrOfLinks() const { return link_symbols_.size(); }
+
+  /// \brief Number of link poses recomputed by the last FK evaluation
+  std::size_t getNrOfUpdatedLinks() const { return updated_links_; }
+
   /// \brief Get link root (it is not the tree root)
   std::string getLinkRoot(const std::string &link_name) const;
 
@@ -103,9 +137,38 @@ public:
   /// \brief Set URDF Pose
   void setUrdfPose(const std::string &link_name, const urdf::Pose &pose);
 
+  /// \brief Set URDF Pose and patch the joint origin of the link in the live
+  /// tree, without updateTree(). Only the FK of the link subtree is recomputed.
+  bool setJointOrigin(const std::string &link_name, const urdf::Pose &pose);
+
   /// \brief Update KDL tree from URDF
   void updateTree();
 
+  /// \brief Calibration offset of a joint (joint index), added to its position
+  /// in the forward kinematic. Only the FK of the joint subtrees is recomputed.
+  void setJointOffset(int joint_idx, double offset);
+
+  /// \brief Calibration offset of a joint (0 by default)
+  double getJointOffset(int joint_idx) const { return joint_offset_[joint_idx]; }
+
+  /// \brief Joint position plus its calibration offset (the one of the FK)
+  double getCalibratedPosition(int joint_idx) const
+  { return position_[joint_idx] + joint_offset_[joint_idx]; }
+
+  /// \brief New value every time the tree is rebuilt or patched, unique
+  /// across all the RobotStates (0: no tree yet), so it identifies the tree
+  /// even if another RobotState is later created at the same address
+  unsigned long getTreeRevision() const { return tree_revision_; }
+
+  /// \brief Get URDF model (e.g. to create another RobotState from it)
+  const urdf::Model &getUrdfModel() const { return urdf_model_; }
+
+  /// \brief One plain RobotState (no /tf publishing) per thread with the
+  /// kinematics of robot_state (URDF model and joint offsets), so views can
+  /// be generated in parallel
+  static void createThreadStates(const RobotState &robot_state, int num_threads,
+                                 std::vector<boost::shared_ptr<RobotState> > *robot_states);
+
 protected:
   /// \brief Delete pointers
   void deletePtrs();
@@ -120,12 +183,45 @@ protected:
   /// \brief Get SegmentMap from KDL tree
   const KDL::SegmentMap &segments() const { return kdl_tree_->getSegments(); }
 
+  /// \brief Flatten kdl_tree_ (topological order, parent indexes and pointers
+  /// to the joint positions) for computing the forward kinematic
+  void compileTree();
+
+  /// \brief Compute the pose (root frame) of every link, single forward pass
+  void computePoses();
+
+  /// \brief Recompute only the subtrees of the links whose joint position
+  /// changed (see pose_q_) or whose joint origin was patched
+  void updatePoses();
+
+  /// \brief Calibrated joint position of a link (0 for fixed joints)
+  double linkPosition(int link_idx) const
+  {
+    int jnt = joint_idx_[link_idx];
+    return jnt >= 0 ? position_[jnt] + joint_offset_[jnt] : 0.0;
+  }
+
 
 protected:
   urdf::Model  urdf_model_;  // URDF model
-  KDL::Tree   *kdl_tree_;    // KDL tree (data from urdf but used for kinematic)
-
-  KDL::TreeFkSolverPos_recursive *fk_solver;  // forward kinematic
+  KDL::Tree   *kdl_tree_;    // KDL tree (structure only, frames in segment_)
+
+  // compiled tree (index 0 is the root, parents always before children)
+  SymbolTable                  link_symbols_;    // link name <-> idx
+  std::vector<int>             parent_idx_;      // idx -> parent idx (-1: root)
+  std::vector<KDL::Segment>    segment_;         // idx -> segment (joint + tip),
+                                                 // patched by setJointOrigin()
+  std::vector<int>             joint_idx_;       // idx -> joint index (-1: fixed)
+  std::vector<double>          joint_offset_;    // joint index -> calibration offset
+
+  std::vector<KDL::Frame>      pose_;            // idx -> pose (root frame)
+  std::vector<double>          pose_q_;          // idx -> joint angle of pose_
+  bool                         pose_valid_;      // false if the tree changed
+  unsigned long                pose_revision_;   // JointState revision of pose_
+  std::vector<int>             patched_idx_;     // links whose subtree is stale
+  std::size_t                  updated_links_;   // poses of the last evaluation
+  unsigned long                tree_revision_;   // compileTree(), setJointOrigin(),
+                                                 // setJointOffset()
 };
 
 }
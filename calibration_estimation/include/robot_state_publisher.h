@@ -49,6 +49,12 @@ namespace calib
 * This class is a wrapper of RobotState publisher.
 * It adds the timer and tf broadcaster
 *
+* Publishing is coalesced: joint updates do not publish, the timer (at most
+* publish_frequency, default 50 Hz) publishes the transforms only if the
+* joints or the tree changed since the last publish, or every tf_keepalive
+* seconds (default 1.0) so they do not go stale. In headless mode nothing is
+* published unless flush() is called.
+*
 */
 class RobotStatePublisher : public RobotState
 {
@@ -58,20 +64,37 @@ public:
 
   void updateTree();
 
-  bool update(const std::string &joint_name,
-              const double      &position);
+  /// \brief Publish all the transforms now
+  void publishTransforms(const ros::TimerEvent &e);
+
+  /// \brief Publish now if the joints or the tree changed (also in headless mode)
+  void flush();
 
-  bool update(const std::vector<std::string> &joint_name,
-              const std::vector<double>      &position);
+  /// \brief Stop (true) or resume (false) the periodic publishing
+  void setHeadless(bool headless);
 
-  void publishTransforms(const ros::TimerEvent &e);
+  /// \brief Number of transform sets published
+  std::size_t getPublishCount() const { return publish_count_; }
 
 private:
+  /// \brief Timer: publish if something changed (or for keepalive)
+  void publishChanges(const ros::TimerEvent &e);
+
+  /// \brief True if the joints or the tree changed since the last publish
+  bool changed() const;
+
   ros::NodeHandle node_;
   ros::Timer      timer_;
   ros::Duration   publish_interval_;
+  ros::Duration   keepalive_;
 
   tf::TransformBroadcaster tf_broadcaster_;
+
+  bool          headless_;
+  std::size_t   publish_count_;
+  ros::Time     last_publish_;
+  unsigned long published_revision_;      // JointState revision
+  unsigned long published_tree_revision_; // RobotState tree revision
 };
 
 }
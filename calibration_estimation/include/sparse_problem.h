@@ -0,0 +1,161 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#ifndef SPARSE_PROBLEM_H
+#define SPARSE_PROBLEM_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace ceres
+{
+class CostFunction;
+}
+
+namespace calib
+{
+
+/** SparseProblem
+*
+* Residuals and sparse (CSR) Jacobian of the camera-chain and chain
+* (checkerboard) sensors of the Python estimator (opt_runner.py), with its
+* models: transforms (x, y, z, angle-axis), active joints (link_T with the
+* gearing), rectified cameras (baseline, f, cx and cy shifts) and
+* checkerboards (spacing). The parameters are indexes of one vector of
+* values, the full parameter vector followed by the target poses, and the
+* free ones have a Jacobian column. Each sensor is a DynamicAutoDiffCostFunction
+* over the free values it uses, so the derivatives are exact and only the
+* structural non-zeros are stored.
+*
+*/
+class SparseProblem
+{
+public:
+  /// Transform of a chain (6 values from 'params'): fixed (axis 0) or moved
+  /// by a joint, axis 1..3 translation x, y, z and 4..6 rotation (roll,
+  /// pitch, yaw), negative for the opposite direction
+  struct Link
+  {
+    Link(int params = 0, int axis = 0, double position = 0.0, int gearing = -1)
+      : params(params), axis(axis), position(position), gearing(gearing) {}
+
+    int    params;    // index of x, y, z, a, b, c
+    int    axis;
+    double position;  // joint position (measured)
+    int    gearing;   // index of the joint gearing
+  };
+
+  /// Checkerboard (corners_x * corners_y corners) and its pose
+  struct Board
+  {
+    Board(int corners_x = 0, int corners_y = 0, int spacing = 0, int pose = 0)
+      : corners_x(corners_x), corners_y(corners_y), spacing(spacing), pose(pose) {}
+
+    int corners_x;
+    int corners_y;
+    int spacing;      // index of spacing_x, spacing_y
+    int pose;         // index of x, y, z, a, b, c (in the root frame)
+  };
+
+  SparseProblem();
+  ~SparseProblem();
+
+  /// \brief Jacobian column of each value (-1: fixed), it must be set before
+  /// adding the sensors
+  void setColumns(const std::vector<int> &columns, int num_columns);
+
+  /// \brief Camera attached to a chain (links: root to camera frame) seeing a
+  /// board. Residuals: u, v (and the disparity, if baseline_rgbd is not 0) of
+  /// each corner. 'camera': index of baseline_shift, f_shift, cx_shift, cy_shift
+  void addCameraChain(const std::vector<Link> &links, const double P[12],
+                      int camera, double baseline_rgbd, const Board &board,
+                      const std::vector<double> &measured);
+
+  /// \brief Board attached to a chain (links: root to board link).
+  /// Residuals: x, y, z of each corner (board pose minus chain)
+  void addChain(const std::vector<Link> &links, const Board &board);
+
+  /// \brief Residuals for 'values' (the Jacobian is not computed)
+  bool evaluate(const std::vector<double> &values,
+                std::vector<double> *residuals) const;
+
+  /// \brief Residuals and CSR Jacobian (data, indices, indptr) for 'values'
+  bool evaluate(const std::vector<double> &values,
+                std::vector<double> *residuals,
+                std::vector<double> *data,
+                std::vector<int>    *indices,
+                std::vector<int>    *indptr) const;
+
+  /// \brief Number of rows of the Jacobian
+  std::size_t numResiduals() const { return num_residuals_; }
+
+  /// \brief Number of columns of the Jacobian
+  std::size_t numColumns() const { return num_columns_; }
+
+  /// \brief Remove the sensors
+  void clear();
+
+private:
+  SparseProblem(const SparseProblem &);
+  SparseProblem &operator=(const SparseProblem &);
+
+  struct Sensor
+  {
+    ceres::CostFunction *cost_function;
+    std::vector<int>     blocks;        // value index of each parameter block
+    std::vector<std::pair<int, int> > free; // column, parameter block (sorted)
+    std::size_t          num_residuals;
+  };
+
+  /// \brief Add a sensor (cost function of the values 'blocks')
+  void addSensor(ceres::CostFunction *cost_function,
+                 const std::vector<int> &blocks, std::size_t num_residuals);
+
+  /// \brief Values used by the links and the 'others' (sorted, unique)
+  static void usedValues(const std::vector<Link> &links,
+                         const std::vector<int> &others, std::vector<int> *blocks);
+
+  std::vector<int>    columns_;
+  std::size_t         num_columns_;
+  std::vector<Sensor> sensors_;
+  std::size_t         num_residuals_;
+};
+
+}
+
+#endif // SPARSE_PROBLEM_H
@@ -0,0 +1,101 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace calib
+{
+
+/** SymbolTable
+*
+* Interns names (joints, links, camera frames) as dense integer ids: the
+* first name gets id 0, the next new one id 1, ... Names are interned once,
+* at load time, so the inner loops can use the ids to index flat vectors
+* instead of looking up strings. It can be shared by several threads.
+*
+* Tables that are complete after loading (joints, links) are frozen: no new
+* names can be added and the lookups (find(), name(), size()) take no lock.
+* Before freeze() every operation is serialized by a mutex, so names can be
+* interned concurrently (e.g. camera frames while the views are generated).
+* freeze() and clear() must not run concurrently with other calls.
+*
+*/
+class SymbolTable
+{
+public:
+  SymbolTable();
+  SymbolTable(const SymbolTable &other);
+  SymbolTable &operator=(const SymbolTable &other);
+
+  /// \brief Id of name, a new one (size()) if it is not in the table yet
+  /// (-1 if the table is frozen)
+  int intern(const std::string &name);
+
+  /// \brief Id of name (-1 if it is not in the table)
+  int find(const std::string &name) const;
+
+  /// \brief Name of id (valid until clear())
+  const std::string &name(int id) const;
+
+  /// \brief Number of names
+  std::size_t size() const;
+
+  /// \brief Forget all the names (and unfreeze the table)
+  void clear();
+
+  /// \brief No more names: lock-free lookups from now on
+  void freeze() { frozen_ = true; }
+  bool frozen() const { return frozen_; }
+
+private:
+  int findUnlocked(const std::string &name) const;
+
+  std::map<std::string, int> ids_;
+  std::deque<std::string>    names_; // id -> name (stable references)
+  bool                       frozen_;
+  mutable boost::mutex       mutex_;
+};
+
+}
+
+#endif // SYMBOL_TABLE_H
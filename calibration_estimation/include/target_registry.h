@@ -0,0 +1,116 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+#ifndef TARGET_REGISTRY_H
+#define TARGET_REGISTRY_H
+
+#include <opencv2/core/core.hpp>
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ros
+{
+class NodeHandle;
+}
+
+namespace calib
+{
+
+/** Target
+*
+* Calibration target (checkerboard) and its corner model. The corners are
+* generated once and shared (read-only) by all the views of the target.
+*
+*/
+struct Target
+{
+  std::string id;
+  int         width;      // corners_x
+  int         height;     // corners_y
+  double      spacing_x;  // meters
+  double      spacing_y;  // meters
+
+  std::vector<cv::Point3d> corners; // Z=0, row-major (x fastest)
+};
+
+typedef boost::shared_ptr<const Target> TargetPtr;
+
+/** TargetRegistry
+*
+* Calibration targets by target_id (RobotMeasurement::target_id). It starts
+* with the PR2 checkerboards; more targets can be read from the parameter
+* server with the same format as the 'checkerboards' of system.yaml:
+*
+*   checkerboards:
+*     large_cb_7x6: {corners_x: 7, corners_y: 6, spacing_x: 0.108, spacing_y: 0.108}
+*
+* The registry must be filled before the views are generated; after that it
+* is only read, so it can be shared by several threads.
+*
+*/
+class TargetRegistry
+{
+public:
+  TargetRegistry();
+
+  /// \brief Add (or replace) a target, generating its corners
+  void add(const std::string &id, int width, int height,
+           double spacing_x, double spacing_y);
+
+  /// \brief Read targets from the parameter 'param' (see class description)
+  bool readParam(const ros::NodeHandle &n,
+                 const std::string &param = "checkerboards");
+
+  /// \brief Target by id (null and ROS_ERROR if it does not exist)
+  TargetPtr get(const std::string &id) const;
+
+  /// \brief Number of targets
+  std::size_t size() const { return targets_.size(); }
+
+  /// \brief All the targets by id
+  const std::map<std::string, TargetPtr> &targets() const { return targets_; }
+
+private:
+  std::map<std::string, TargetPtr> targets_;
+};
+
+}
+
+#endif // TARGET_REGISTRY_H
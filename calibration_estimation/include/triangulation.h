@@ -51,6 +51,21 @@ void nViewTriangulate(const cv::Mat_<double> &x,
                       const std::vector<cv::Matx34d> &Ps,
                       cv::Vec3d &X);
 
+/// \brief Batched multi-view triangulation (same DLT as above) of all the
+/// points at once. x[i] are the 2D points seen by the camera Ps[i] (all with
+/// the same number of points). The 4x4 normal equations (A'A) are built for
+/// blocks of points, in Hartley normalized coordinates, and solved with a
+/// fixed-size eigen-solver on the stack.
+void nViewTriangulate(const std::vector<std::vector<cv::Point2d> > &x,
+                      const std::vector<cv::Matx34d> &Ps,
+                      std::vector<cv::Point3d> *X);
+
+/// \brief Batched multi-view triangulation, raw interface
+/// x:  nviews x npoints x 2 (u,v), Ps: nviews x 3 x 4, X: npoints x 3
+void nViewTriangulate(const double *x, const double *Ps,
+                      int nviews, int npoints,
+                      double *X);
+
 }
 
 #endif // TRIANGULATION_H
@@ -42,8 +42,12 @@
 #include <image_geometry/pinhole_camera_model.h>
 // #include <image_geometry/stereo_camera_model.h>
 #include <kdl/frames.hpp>
+#include <boost/dynamic_bitset.hpp>
 
 #include "calibration_msgs/RobotMeasurement.h"
+#include "chessboard.h"
+#include "target_registry.h"
+#include "calibration_context.h"
 
 namespace calib
 {
@@ -57,6 +61,11 @@ typedef calibration_msgs::RobotMeasurement::Ptr Msg;
 * Container of all the information obtained from a checkerboard sighting
 * It is generated from a Msg message (a robot measurement)
 *
+* The members are computed in stages (see Stage) which are only recomputed
+* when their inputs change: msg_ (generateView()), the KDL tree of the robot
+* state and the camera parameters (calc_error()). Use invalidate() after
+* modifying the public members by hand.
+*
 */
 class View
 {
@@ -64,28 +73,74 @@ public:
   typedef std::vector<cv::Point3d> Points3D;
   typedef std::vector<cv::Point2d> Points2D;
 
+  /// \brief Stages of updateView() and calc_error(). Invalidating a stage
+  /// also invalidates the stages that depend on it.
+  enum Stage
+  {
+    STAGE_MEASUREMENTS = 1, //!< corners, camera models, measurements, frame names (msg_)
+    STAGE_POSES        = 2, //!< board poses (solvePnP), board_transformed_pts_3D_
+    STAGE_KINEMATICS   = 4, //!< pose_rel_, pose_father_ (KDL tree of the robot state)
+    STAGE_ERROR        = 8, //!< calc_error() (camera parameters)
+    STAGE_ALL          = 15
+  };
+
   View();
   ~View();
 
-  static void setRobotState(RobotState *robot_state);
+  /// \brief Calibration the view belongs to (robot state, targets, cameras
+  /// and camera parameters). It must outlive the view.
+  void setContext(const CalibrationContext *context) { context_ = context; }
+  const CalibrationContext *getContext() const { return context_; }
 
-  /// \brief Generate View from RobotMeasurement Message
+  /// \brief Generate View from RobotMeasurement Message (context robot state).
+  /// False (view unusable) if the robot state is unset or the target unknown.
   bool generateView(const Msg &msg);
 
+  /// \brief Same as generateView(msg) but the kinematic is evaluated with the
+  /// given robot_state (not the shared one), so views can be generated in
+  /// parallel, each thread using its own RobotState
+  bool generateView(const Msg &msg, RobotState *robot_state);
+
+  /// \brief Same as generateView(msg, robot_state). If find_poses is false,
+  /// the board poses are not computed (see findCbPose(), PoseInitializer)
+  bool generateView(const Msg &msg, RobotState *robot_state, bool find_poses);
+
+  /// \brief Same as generateView(msg, robot_state), but the board poses
+  /// (rvec_, tvec_, error_, expected_pts_2D_) are already set, e.g. read
+  /// from a DatasetCache, so solvePnP is not run again
+  bool restoreView(const Msg &msg, RobotState *robot_state);
+
   /// \brief Update robot state with the measured joint angles
   void updateRobot();
+  void updateRobot(RobotState *robot_state);
+
+  /// \brief Drop the debugging payload of msg_ (images, features, laser data).
+  /// Only the chains, cam_info and image_points are needed after generateView()
+  void releaseRawData();
+
+  /// \brief Frame id (context frames) of a camera frame name (-1 if unknown)
+  int getFrameId(const std::string &camera_frame) const;
 
   /// \brief True if the camera is part of the view (frame name belongs to frame_name_)
   bool isVisible(const std::string &camera_frame);
+  bool isVisible(int frame_id) const
+  { return frame_id >= 0 && (std::size_t)frame_id < visibility_.size() && visibility_[frame_id]; }
 
-  /// \brief Return the camera index (frame_id_)
+  /// \brief Return the camera index (frame_ids_)
   int getCamIdx(const std::string &camera_frame);
 
+  /// \brief Camera index of a frame id (-1 if it is not visible), no lookups
+  int getCamIdx(int frame_id) const
+  { return isVisible(frame_id) ? cam_idx_[frame_id] : -1; }
+
+  /// \brief Visible cameras, one bit per frame id
+  const boost::dynamic_bitset<> &getVisibility() const { return visibility_; }
+
 
 // Public Members
   Msg msg_;                  // Remaining public members are generated from msg_
 
-  Points3D              board_model_pts_3D_;       // generateCorners()
+  TargetPtr             target_;                   // generateCorners(), shared
   std::vector<cv::Mat>  board_transformed_pts_3D_; // getTransformedPoints()
   std::vector<Points2D> measured_pts_2D_;          // getMeasurement()
 
@@ -94,10 +149,6 @@ public:
   std::vector<double>               triang_error_;   // calc_error()
   std::vector<std::vector<double> > indivual_error_; // calc_error()
 
-  static std::vector<double *>    camera_rot_;       // external
-  static std::vector<double *>    camera_trans_;     // external
-  static std::vector<std::string> cameras_;          // external - cameras to be calibrated
-
   std::vector<Points2D> expected_pts_2D_;          // findCbPoses()
   std::vector<double>   error_;                    // findCbPoses()
   std::vector<cv::Mat>  rvec_;                     // findCbPoses()
@@ -109,7 +160,7 @@ public:
 //   unsigned cam_number_;  cam_model_.size()
 
   std::vector<std::string>           frame_name_;  // getFrameNames()
-  std::map<std::string, std::size_t> frame_id_;    // frame_name -> frame_id
+  std::vector<int>                   frame_ids_;   // getFrameNames(), context frames
 
   std::vector<KDL::Frame> pose_rel_, pose_father_; // getPoses()
 //   KDL::Frame T0; // T0 == pose_father_[0]*pose_rel_[0]
@@ -121,6 +172,8 @@ public:
   /// for that camera)
   void generateIndexes(const std::vector<std::string> &cameras,
                        std::vector<int> *idx);
+  void generateIndexes(const std::vector<int> &camera_ids,
+                       std::vector<int> *idx) const;
 
   /// \brief Multi-view triangulation, for the selected cameras
   /// It will update triang_pts_3D_ variable
@@ -128,16 +181,58 @@ public:
                      const std::vector<double *>    &camera_rot,    //!< rotations
                      const std::vector<double *>    &camera_trans); //!< translations
 
+  /// \brief Reprojection errors with the cameras and camera parameters
+  /// of the context
   void calc_error();
 
+  /// \brief Find the board pose of camera i (rvec_[i], tvec_[i], error_[i],
+  /// expected_pts_2D_[i] and board_transformed_pts_3D_[i]). If a guess is
+  /// given, PNP_ITERATIVE starts from it. resizeCbPoses() must be called first
+  /// and checkCbPoses() once every camera is done.
+  void findCbPose(std::size_t i,
+                  int method = PNP_ITERATIVE,
+                  const cv::Mat &rvec_guess = cv::Mat(),
+                  const cv::Mat &tvec_guess = cv::Mat());
+
+  /// \brief Board pose in camera 'to' predicted from the board pose in camera
+  /// 'from' and the forward kinematic of both cameras (pose_father_, pose_rel_)
+  bool predictCbPose(std::size_t from, std::size_t to,
+                     cv::Mat *rvec, cv::Mat *tvec) const;
+
+  /// \brief One (empty) board pose per camera
+  void resizeCbPoses();
+
+  /// \brief True if the board poses are up to date (STAGE_POSES)
+  bool hasCbPoses() const;
+
+  /// \brief Set STAGE_POSES if every camera has a board pose (after
+  /// findCbPose()) and return it
+  bool checkCbPoses();
+
+  /// \brief Force the given stages (Stage flags) to be recomputed
+  void invalidate(unsigned stages = STAGE_ALL);
+
   void save();
   void output();
 
-  void updateView();
+  /// \brief Bring the view up to date (only the invalid stages are computed).
+  /// The robot state is always left with the joint angles of the view.
+  /// False if the measurements cannot be generated (unknown target).
+  bool updateView();
+  bool updateView(RobotState *robot_state);
+  bool updateView(RobotState *robot_state, bool find_poses);
 
 private:
-  /// \brief Generate 3D chessboard corners (board_points)
-  void generateCorners();
+  /// \brief STAGE_MEASUREMENTS: generateCorners() ... getFrameNames()
+  bool updateMeasurements();
+
+  /// \brief STAGE_KINEMATICS: getPoses(), unless it was computed with the
+  /// same robot_state and KDL tree
+  void updateKinematics(RobotState *robot_state);
+
+  /// \brief Get the target (and its 3D corners) of msg_->target_id (false
+  /// and ROS_ERROR if it is not in the target registry)
+  bool generateCorners();
 
   /// \brief Get Camera Model from Message
   void getCameraModels();
@@ -154,12 +249,22 @@ private:
   /// \brief Get camera name frame from Message
   void getFrameNames();
 
-  /// \brief Get Poses from Message and using robot_state_ for calculating the FK
-  void getPoses();
+  /// \brief Get Poses from Message and using robot_state for calculating the FK
+  void getPoses(RobotState *robot_state);
 
 private:
-  static RobotState *robot_state_; // it is needed in order to calculate cameras
-                                   // poses. It is unique (static)
+  const CalibrationContext *context_; // robot state, targets and cameras
+
+  unsigned valid_; // up-to-date stages (Stage flags)
+
+  // camera lookup by frame id (getFrameNames())
+  std::vector<int>        cam_idx_;    // frame id -> camera idx
+  boost::dynamic_bitset<> visibility_; // frame id -> visible
+
+  // inputs of the last computation of each stage
+  unsigned long             fk_tree_revision_; // STAGE_KINEMATICS
+  std::vector<std::string>  error_cameras_;    // STAGE_ERROR
+  std::vector<double>       error_params_;     // STAGE_ERROR
 };
 
 }
@@ -44,6 +44,7 @@ import yaml
 import os.path
 import numpy
 import math
+import scipy.sparse
 
 import stat
 import os
@@ -349,7 +350,10 @@ if __name__ == '__main__':
         yaml.dump([list([float(x) for x in pose]) for pose in list(output_poses)], out_f)
         out_f.close()
 
-        cov_x = matrix(J).T * matrix(J)
+        if scipy.sparse.issparse(J):
+            cov_x = matrix((J.T * J).todense())
+        else:
+            cov_x = matrix(J).T * matrix(J)
         numpy.savetxt(output_dir + "/" + cur_step["output_filename"] + "_cov.txt", cov_x, fmt="% 9.3f")
 
         previous_pose_guesses = output_poses
@@ -39,8 +39,15 @@ from calibration_estimation.single_transform import SingleTransform
 import numpy
 from numpy import array, matrix, zeros, cumsum, concatenate, reshape
 import scipy.optimize
+import scipy.sparse
 import sys
 
+# compiled residual/jacobian backend (camera chain and chain sensors)
+try:
+    from calibration_estimation.sparse_problem_cpp import SparseProblem
+except ImportError:
+    SparseProblem = None
+
 class ErrorCalc:
     """
     Helpers for computing errors and jacobians
@@ -53,6 +60,25 @@ class ErrorCalc:
         self._use_cov = use_cov
         self._j_count = 0
 
+        # residuals and sparse jacobian in C++, when all the sensors are supported
+        self._sparse_problem = None
+        if not use_cov:
+            self._sparse_problem = build_sparse_problem(robot_params, self._free_list, multisensors)
+
+    def is_sparse(self):
+        '''
+        True if the residuals and the (sparse) jacobian are computed by the compiled backend
+        '''
+        return self._sparse_problem is not None
+
+    def sparse_values(self, opt_all_vec):
+        '''
+        Values of the compiled backend: the full param vec followed by the checkerboard poses
+        '''
+        opt_param_vec, full_pose_arr = self.split_all(opt_all_vec)
+        full_param_vec = self.calculate_full_param_vec(opt_param_vec)
+        return concatenate([array(full_param_vec)[:,0], reshape(full_pose_arr, [-1])])
+
 
     def calculate_full_param_vec(self, opt_param_vec):
         '''
@@ -75,6 +101,14 @@ class ErrorCalc:
         for multisensor in self._multisensors:
             multisensor.update_config(self._robot_params)
 
+        if self._sparse_problem is not None:
+            # residuals only, the jacobian is computed by calculate_jacobian
+            r_vec = self._sparse_problem.residuals(self.sparse_values(opt_all_vec))
+            rms_error = numpy.sqrt( numpy.mean(r_vec**2) )
+            print "\t\t\t\t\tRMS error: %.3f    \r" % rms_error,
+            sys.stdout.flush()
+            return r_vec
+
         r_list = []
         for multisensor, cb_pose_vec in zip(self._multisensors, list(full_pose_arr)):
             # Process cb pose
@@ -132,6 +166,11 @@ class ErrorCalc:
         #import scipy.optimize.slsqp.approx_jacobian as approx_jacobian
         #J = approx_jacobian(opt_param_vec, self.calculate_error, 1e-6)
 
+        if self._sparse_problem is not None:
+            # same layout, exact derivatives and only the non-zeros (scipy.sparse.csr_matrix)
+            r, data, indices, indptr = self._sparse_problem.evaluate(self.sparse_values(opt_all_vec))
+            return scipy.sparse.csr_matrix((data, indices, indptr), shape=(len(r), len(opt_all_vec)))
+
         opt_param_vec, full_pose_arr = self.split_all(opt_all_vec)
 
         # Allocate the full jacobian matrix
@@ -285,6 +324,79 @@ class ErrorCalc:
             J_scaled = J
         return J_scaled
 
+def chain_links(calc_block, chain_state):
+    '''
+    Flatten the transforms of a FullChainCalcBlock (same order as its fk()) into the
+    links of the compiled backend: (params index, axis, joint position, gearing index).
+    Fixed transforms have axis 0.
+    '''
+    links = [(T.start, 0, 0.0, -1) for T in calc_block._before_chain_Ts]
+
+    chain = calc_block._chain
+    if chain is not None:
+        link_num = calc_block._link_num
+        if link_num < 0:
+            link_num = chain._M
+        m = 0
+        for joint_name in chain._joints:
+            if m > link_num:
+                break
+            transform = chain._transforms[joint_name]
+            if joint_name in chain._active:
+                links.append((transform.start, int(chain._axis[0,m]), float(chain_state.position[m]), chain.start + m))
+                m += 1
+            else:
+                links.append((transform.start, 0, 0.0, -1))
+
+    links.extend([(T.start, 0, 0.0, -1) for T in calc_block._after_chain_Ts])
+    return links
+
+def build_sparse_problem(robot_params, free_list, multisensors):
+    '''
+    Build the compiled residual/jacobian backend for the multisensors. Returns None if
+    it is not available or if a sensor is not supported (only camera chain and chain
+    sensors are), the numpy implementation is used then.
+    The values are the full param vec followed by the checkerboard poses (6 each),
+    the columns are the ones of calculate_jacobian.
+    '''
+    if SparseProblem is None:
+        return None
+    for ms in multisensors:
+        for sensor in ms.sensors:
+            if sensor.sensor_type not in ['camera', 'chain']:
+                return None
+
+    num_params = robot_params.length
+    num_free = sum(free_list)
+    columns = list(numpy.cumsum(free_list) - 1)
+    columns = [int(c) if free else -1 for c, free in zip(columns, free_list)]
+    columns.extend(range(num_free, num_free + 6*len(multisensors)))
+
+    problem = SparseProblem()
+    problem.set_columns(columns, num_free + 6*len(multisensors))
+
+    for i, ms in enumerate(multisensors):
+        ms.update_config(robot_params)
+        cb = robot_params.checkerboards[ms.checkerboard]
+        board = (cb._corners_x, cb._corners_y, cb.start, num_params + 6*i)
+        for sensor in ms.sensors:
+            calc_block = sensor._full_chain.calc_block
+            if sensor.sensor_type == 'camera':
+                chain_state = sensor._M_chain.chain_state if sensor._M_chain is not None else None
+                links = chain_links(calc_block, chain_state)
+                camera = robot_params.rectified_cams[sensor.sensor_id]
+                baseline_rgbd = 0.0
+                if sensor.terms_per_sample == 3:
+                    baseline_rgbd = camera._config['baseline_rgbd']
+                measured = array(sensor.get_measurement()).reshape(-1)
+                problem.add_camera_chain(links, list(sensor._M_cam.cam_info.P), camera.start,
+                                         baseline_rgbd, board, measured.tolist())
+            else:
+                links = chain_links(calc_block, sensor._M_chain.chain_state)
+                problem.add_chain(links, board)
+
+    return problem
+
 def build_opt_vector(robot_params, free_dict, pose_guess_arr):
     """
     Construct vector of all the parameters that we're optimizing over. This includes
@@ -330,13 +442,26 @@ def opt_runner(robot_params, pose_guess_arr, free_dict, multisensors, use_cov):
       free_dict - Dictionary storing which parameters are free
       multisensor - list of list of measurements. Each multisensor corresponds to a single checkerboard pose
       pose_guesses - List of guesses as to where all the checkerboard are. This is used to initialze the optimization
+    The returned jacobian is a scipy.sparse matrix when the compiled backend is used (see build_sparse_problem).
     """
     error_calc = ErrorCalc(robot_params, free_dict, multisensors, use_cov)
 
     # Construct the initial guess
     opt_all = build_opt_vector(robot_params, free_dict, pose_guess_arr)
 
-    x, cov_x, infodict, mesg, iter = scipy.optimize.leastsq(error_calc.calculate_error, opt_all, Dfun=error_calc.calculate_jacobian, full_output=1)
+    if error_calc.is_sparse() and hasattr(scipy.optimize, 'least_squares'):
+        # sparse jacobian: trust region with an iterative (lsmr) linear solver
+        result = scipy.optimize.least_squares(error_calc.calculate_error, opt_all, jac=error_calc.calculate_jacobian,
+                                              method='trf', tr_solver='lsmr')
+        x = result.x
+    else:
+        # leastsq needs a dense jacobian (scipy < 0.17 has no least_squares)
+        def dense_jacobian(opt_all_vec):
+            J = error_calc.calculate_jacobian(opt_all_vec)
+            if scipy.sparse.issparse(J):
+                return J.toarray()
+            return J
+        x, cov_x, infodict, mesg, iter = scipy.optimize.leastsq(error_calc.calculate_error, opt_all, Dfun=dense_jacobian, full_output=1)
 
     J = error_calc.calculate_jacobian(x)
 
@@ -85,5 +85,19 @@ double norm(const vector<Point2d> &p1,
   return error;
 }
 
+string csvField(const string &s)
+{
+  if (s.find_first_of(",\"\r\n") == string::npos)
+    return s;
+
+  string out = "\"";
+  for (size_t k = 0; k < s.size(); k++)
+  {
+    if (s[k] == '"')
+      out += '"';
+    out += s[k];
+  }
+  return out + "\"";
+}
 
 }
@@ -0,0 +1,241 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include "bag_reader.h"
+#include "data.h"
+#include "robot_state.h"
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+
+#include <exception>
+
+using namespace std;
+
+namespace calib
+{
+
+BagReader::BagReader() :
+  num_threads_(0), window_(0), max_in_flight_(0), context_(0), in_flight_(0),
+  done_(false), error_(false)
+{
+}
+
+BagReader::~BagReader()
+{
+}
+
+bool BagReader::read(const string &filename,
+                     const string &topic,
+                     Data *data,
+                     map<string, int> *sample_id)
+{
+  if (data->context().robot_state == 0)
+  {
+    ROS_ERROR("robot_state unset, use Data::setRobotState()");
+    return false;
+  }
+
+  int num_threads = num_threads_;
+  if (num_threads <= 0)
+    num_threads = max(1u, boost::thread::hardware_concurrency());
+
+  max_in_flight_ = window_ > 0 ? window_ : 2 * num_threads;
+  context_       = &data->context();
+
+  // reset shared state
+  queue_.clear();
+  views_.clear();
+  sample_id_.clear();
+  in_flight_ = 0;
+  done_ = false;
+  error_ = false;
+
+  // one kinematic context per worker (plain RobotState, no /tf publishing)
+  vector<boost::shared_ptr<RobotState> > robot_states;
+  RobotState::createThreadStates(*data->context().robot_state, num_threads, &robot_states);
+
+  boost::thread_group threads;
+  threads.create_thread(boost::bind(&BagReader::readerLoop, this, filename, topic));
+  for (int t = 0; t < num_threads; t++)
+    threads.create_thread(boost::bind(&BagReader::workerLoop, this, robot_states[t].get()));
+  threads.join_all();
+
+  if (error_)
+  {
+    views_.clear();
+    return false;
+  }
+
+  // add to data (same order as the bag, without the skipped views),
+  // releasing as we go
+  size_t offset = data->size();
+  map<size_t, size_t> view_idx; // bag index -> view index
+  for (map<size_t, View>::iterator it = views_.begin(); it != views_.end(); )
+  {
+    view_idx[it->first] = data->size();
+    data->view_.push_back(it->second);
+    views_.erase(it++);
+  }
+  data->orderViews(offset);
+
+  if (sample_id != 0)
+  {
+    for (map<string, size_t>::const_iterator it = sample_id_.begin(); it != sample_id_.end(); ++it)
+    {
+      map<size_t, size_t>::const_iterator v = view_idx.find(it->second);
+      if (v != view_idx.end())
+        (*sample_id)[it->first] = v->second;
+    }
+  }
+
+  // board poses of the new views (dataset-level, parallel over (view, camera))
+  data->pose_initializer_.run(&data->view_, offset);
+
+  // leave the shared robot state as the serial version does (last view)
+  if (data->size() > offset)
+    data->view_.back().updateRobot();
+
+  ROS_INFO("Read %zu views from %s (%d threads, window %zu)",
+           data->size() - offset, filename.c_str(), num_threads, max_in_flight_);
+
+  return true;
+}
+
+void BagReader::readerLoop(const string &filename, const string &topic)
+{
+  try
+  {
+    rosbag::Bag bag(filename);
+    rosbag::View view(bag, rosbag::TopicQuery(topic));
+
+    size_t index = 0;
+    BOOST_FOREACH(rosbag::MessageInstance const m, view)
+    {
+      // reserve a slot before instantiating (bounds the raw messages)
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (in_flight_ >= max_in_flight_)
+          not_full_.wait(lock);
+        in_flight_++;
+      }
+
+      Msg msg = m.instantiate<calibration_msgs::RobotMeasurement>();
+
+      {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        if (msg == NULL)
+        {
+          in_flight_--;
+          continue;
+        }
+
+        sample_id_[msg->sample_id] = index;
+        queue_.push_back(make_pair(index, msg));
+        index++;
+      }
+      not_empty_.notify_one();
+    }
+
+    bag.close();
+  }
+  catch (std::exception &e) // rosbag::BagException, bad_alloc, ...
+  {
+    ROS_ERROR("Could not read bag %s: %s", filename.c_str(), e.what());
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    error_ = true;
+  }
+
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    done_ = true;
+  }
+  not_empty_.notify_all();
+}
+
+void BagReader::workerLoop(RobotState *robot_state)
+{
+  while (true)
+  {
+    pair<size_t, Msg> item;
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (queue_.empty() && !done_)
+        not_empty_.wait(lock);
+
+      if (queue_.empty())
+        return; // reader finished and nothing left
+
+      item = queue_.front();
+      queue_.pop_front();
+    }
+
+    // generate view and drop the heavy part of the message
+    View view;
+    bool ok = false, failed = false;
+    try
+    {
+      view.setContext(context_);
+      ok = view.generateView(item.second, robot_state, false);
+      view.releaseRawData();
+    }
+    catch (std::exception &e)
+    {
+      ROS_ERROR("Could not generate the view of sample %s: %s",
+                item.second->sample_id.c_str(), e.what());
+      failed = true;
+    }
+    item.second.reset();
+
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      if (ok) // otherwise skipped (already reported)
+        views_[item.first] = view;
+      error_ = error_ || failed;
+      in_flight_--;
+    }
+    not_full_.notify_one();
+  }
+}
+
+}
@@ -0,0 +1,151 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+/**
+ * Headless batch calibration of several robots (see BatchRunner).
+ * It does not need a ROS master.
+ *
+ *   run_batch manifest [-o output_dir] [-j cores] [--board-pose] [--autodiff]
+ *                      [--pnp iterative|epnp|planar] [--no-cache]
+ *                      [--joint-offsets joint_0,joint_1,... [--chain-target frame]]
+ */
+
+#include "batch_runner.h"
+
+#include <ros/ros.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace calib;
+
+static void usage(const char *program)
+{
+  cerr << "Usage: " << program << " manifest [-o output_dir] [-j cores]"
+       << " [--board-pose] [--autodiff] [--pnp iterative|epnp|planar] [--no-cache]"
+       << " [--joint-offsets joint_0,joint_1,... [--chain-target frame]]" << endl
+       << "manifest lines: name urdf_file bag_file camera_0,camera_1,... [threads]" << endl;
+}
+
+int main(int argc, char **argv)
+{
+  google::InitGoogleLogging(argv[0]);
+  ros::Time::init(); // no ROS master
+
+  if (argc < 2)
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  BatchRunner runner;
+  SolverOptions solver_options;
+  solver_options.minimizer_progress_to_stdout = false;
+  PoseInitializer pose_initializer;
+
+  // full-chain calibration (see Optimization::setJointOffsets())
+  vector<string> joint_offsets;
+  string chain_target_frame = "r_gripper_tool_frame";
+
+  string manifest;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      runner.setOutputDir(argv[++i]);
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      runner.setNumCores(atoi(argv[++i]));
+    else if (strcmp(argv[i], "--board-pose") == 0)
+      runner.setBoardPose(true);
+    else if (strcmp(argv[i], "--autodiff") == 0)
+      runner.setAnalyticJacobian(false);
+    else if (strcmp(argv[i], "--no-cache") == 0)
+      runner.setDatasetCache(false);
+    else if (strcmp(argv[i], "--joint-offsets") == 0 && i + 1 < argc)
+    {
+      // comma separated
+      istringstream ss(argv[++i]);
+      string joint;
+      while (getline(ss, joint, ','))
+      {
+        if (!joint.empty())
+          joint_offsets.push_back(joint);
+      }
+    }
+    else if (strcmp(argv[i], "--chain-target") == 0 && i + 1 < argc)
+      chain_target_frame = argv[++i];
+    else if (strcmp(argv[i], "--pnp") == 0 && i + 1 < argc)
+    {
+      PnPMethod method;
+      if (!PoseInitializer::parseMethod(argv[++i], &method))
+      {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      pose_initializer.setMethod(method);
+    }
+    else if (argv[i][0] != '-' && manifest.empty())
+      manifest = argv[i];
+    else
+    {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  runner.setSolverOptions(solver_options);
+  runner.setPoseInitializer(pose_initializer);
+  runner.setJointOffsets(joint_offsets, chain_target_frame);
+
+  vector<BatchJob> jobs;
+  if (!BatchRunner::readManifest(manifest, &jobs))
+    return EXIT_FAILURE;
+
+  vector<BatchJobResult> results;
+  bool ok = runner.run(jobs, &results);
+
+  for (size_t j = 0; j < results.size(); j++)
+  {
+    cout << results[j].name << ": "
+         << (results[j].ok ? "ok" : "failed " + results[j].message)
+         << " (" << results[j].num_views << " views, RMS " << results[j].rms << " px)" << endl;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
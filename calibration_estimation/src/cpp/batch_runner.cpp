@@ -0,0 +1,426 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+#include "batch_runner.h"
+#include "auxiliar.h"
+#include "bag_reader.h"
+#include "data.h"
+#include "dataset_cache.h"
+#include "robot_state.h"
+
+#include <ros/ros.h>
+#include <urdf/model.h>
+#include <tinyxml.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/bind.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cerrno>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace calib
+{
+
+namespace
+{
+
+/// Cores shared by the running jobs
+struct CorePool
+{
+  boost::mutex              mutex;
+  boost::condition_variable released;
+  int                       free_cores;
+};
+
+bool readFile(const string &filename, string *content)
+{
+  ifstream file(filename.c_str());
+  if (!file)
+    return false;
+
+  ostringstream ss;
+  ss << file.rdbuf();
+  *content = ss.str();
+  return true;
+}
+
+/// \brief path relative to dir (unless it is absolute)
+string resolvePath(const string &dir, const string &path)
+{
+  if (path.empty() || path[0] == '/' || dir.empty())
+    return path;
+  return dir + "/" + path;
+}
+
+string formatTriple(double a, double b, double c)
+{
+  ostringstream ss;
+  ss << setprecision(12) << a << " " << b << " " << c;
+  return ss.str();
+}
+
+void jobThread(const BatchRunner *runner, const BatchJob *job, int threads,
+               BatchJobResult *result, CorePool *pool)
+{
+  *result = runner->runJob(*job, threads);
+
+  {
+    boost::mutex::scoped_lock lock(pool->mutex);
+    pool->free_cores += threads;
+  }
+  pool->released.notify_one();
+}
+
+}
+
+BatchRunner::BatchRunner() :
+  num_cores_(0), output_dir_("."), dataset_cache_(true),
+  analytic_jacobian_(true), board_pose_(false), fused_residuals_(true)
+{
+}
+
+bool BatchRunner::readManifest(const string &filename, vector<BatchJob> *jobs)
+{
+  ifstream file(filename.c_str());
+  if (!file)
+  {
+    ROS_ERROR("Could not open manifest %s", filename.c_str());
+    return false;
+  }
+
+  size_t slash = filename.rfind('/');
+  string dir = slash == string::npos ? string("") : filename.substr(0, slash);
+
+  jobs->clear();
+  string line;
+  for (int line_number = 1; getline(file, line); line_number++)
+  {
+    // remove comments
+    size_t comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+
+    istringstream ss(line);
+    BatchJob job;
+    string cameras;
+    if (!(ss >> job.name))
+      continue; // empty line
+
+    if (!(ss >> job.urdf_file >> job.bag_file >> cameras))
+    {
+      ROS_ERROR("%s:%d: expected 'name urdf_file bag_file cameras [threads]'",
+                filename.c_str(), line_number);
+      return false;
+    }
+
+    if (!(ss >> job.threads))
+      job.threads = 1;
+
+    job.urdf_file = resolvePath(dir, job.urdf_file);
+    job.bag_file  = resolvePath(dir, job.bag_file);
+
+    // comma separated
+    istringstream cs(cameras);
+    string camera;
+    while (getline(cs, camera, ','))
+    {
+      if (!camera.empty())
+        job.cameras.push_back(camera);
+    }
+
+    if (job.cameras.size() < 2)
+    {
+      ROS_ERROR("%s:%d: at least two cameras are needed", filename.c_str(), line_number);
+      return false;
+    }
+
+    jobs->push_back(job);
+  }
+
+  return true;
+}
+
+bool BatchRunner::run(const vector<BatchJob> &jobs, vector<BatchJobResult> *results) const
+{
+  if (mkdir(output_dir_.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    ROS_ERROR("Could not create %s", output_dir_.c_str());
+    return false;
+  }
+
+  int num_cores = num_cores_;
+  if (num_cores <= 0)
+    num_cores = max(1u, boost::thread::hardware_concurrency());
+
+  results->assign(jobs.size(), BatchJobResult());
+
+  CorePool pool;
+  pool.free_cores = num_cores;
+
+  // manifest order, each job waits until its budget is free
+  boost::thread_group threads;
+  for (size_t j = 0; j < jobs.size(); j++)
+  {
+    int budget = min(max(jobs[j].threads, 1), num_cores);
+    {
+      boost::unique_lock<boost::mutex> lock(pool.mutex);
+      while (pool.free_cores < budget)
+        pool.released.wait(lock);
+      pool.free_cores -= budget;
+    }
+
+    ROS_INFO("Job %s: started (%d threads)", jobs[j].name.c_str(), budget);
+    threads.create_thread(boost::bind(&jobThread, this, &jobs[j], budget,
+                                      &(*results)[j], &pool));
+  }
+  threads.join_all();
+
+  bool ok = true;
+  for (size_t j = 0; j < results->size(); j++)
+    ok = ok && (*results)[j].ok;
+
+  if (!writeSummary(output_dir_ + "/summary.csv", *results))
+    ok = false;
+  return ok;
+}
+
+BatchJobResult BatchRunner::runJob(const BatchJob &job, int threads) const
+{
+  ros::WallTime start = ros::WallTime::now();
+
+  BatchJobResult result;
+  result.name = job.name;
+
+  // robot
+  string xml;
+  urdf::Model model;
+  if (!readFile(job.urdf_file, &xml) || !model.initString(xml))
+  {
+    result.message = "could not read URDF " + job.urdf_file;
+    ROS_ERROR("Job %s: %s", job.name.c_str(), result.message.c_str());
+    return result;
+  }
+
+  RobotState robot_state;
+  robot_state.initFromURDF(model);
+
+  // views
+  Data data;
+  data.setRobotState(&robot_state);
+
+  PoseInitializer pose_initializer = pose_initializer_;
+  pose_initializer.setNumThreads(threads);
+  data.setPoseInitializer(pose_initializer);
+
+  // the bag directory may be read-only, the cache goes with the outputs
+  string cache_filename = dataset_cache_ ? output_dir_ + "/" + job.name + ".dataset" : string("");
+  DatasetCache cache(cache_filename);
+  boost::uint64_t bag_hash = DatasetCache::hashFile(job.bag_file);
+  if (cache_filename.empty() || !cache.load(bag_hash, &data))
+  {
+    BagReader bag_reader;
+    bag_reader.setNumThreads(threads);
+    if (!bag_reader.read(job.bag_file, "robot_measurement", &data))
+    {
+      result.message = "could not read bag " + job.bag_file;
+      ROS_ERROR("Job %s: %s", job.name.c_str(), result.message.c_str());
+      return result;
+    }
+
+    if (!cache_filename.empty())
+      cache.write(bag_hash, data);
+  }
+
+  if (data.size() == 0)
+  {
+    result.message = "no views in " + job.bag_file;
+    ROS_ERROR("Job %s: %s", job.name.c_str(), result.message.c_str());
+    return result;
+  }
+
+  // optimization (headless: no markers)
+  SolverOptions solver_options = solver_options_;
+  solver_options.num_threads = threads;
+
+  Optimization optimazer;
+  optimazer.setRobotState(&robot_state);
+  optimazer.setData(&data);
+  optimazer.setCamerasCalib(job.cameras);
+  optimazer.setAnalyticJacobian(analytic_jacobian_);
+  optimazer.setBoardPose(board_pose_);
+  optimazer.setFusedResiduals(fused_residuals_);
+  optimazer.setSolverOptions(solver_options);
+  optimazer.setJointOffsets(joint_offsets_, chain_target_frame_);
+  optimazer.setProfilerLabel(job.name);
+  optimazer.run();
+
+  result.num_views = data.size();
+  result.rms       = optimazer.reprojectionError();
+
+  // outputs
+  string prefix = output_dir_ + "/" + job.name;
+  if (!writeCalibratedUrdf(xml, &robot_state, job.cameras, prefix + ".urdf"))
+  {
+    result.message = "could not write " + prefix + ".urdf";
+    ROS_ERROR("Job %s: %s", job.name.c_str(), result.message.c_str());
+    return result;
+  }
+  optimazer.getProfiler().write(prefix + ".json");
+
+  vector<double> offsets;
+  optimazer.getJointOffsets(&offsets);
+  if (!offsets.empty() &&
+      !writeJointOffsets(joint_offsets_, offsets, prefix + "_joint_offsets.yaml"))
+  {
+    result.message = "could not write " + prefix + "_joint_offsets.yaml";
+    ROS_ERROR("Job %s: %s", job.name.c_str(), result.message.c_str());
+    return result;
+  }
+
+  result.ok        = true;
+  result.wall_time = (ros::WallTime::now() - start).toSec();
+  ROS_INFO("Job %s: %zu views, RMS %g px, %.1f s", job.name.c_str(),
+           result.num_views, result.rms, result.wall_time);
+  return result;
+}
+
+bool BatchRunner::writeSummary(const string &filename,
+                               const vector<BatchJobResult> &results)
+{
+  ofstream file(filename.c_str());
+  if (!file)
+  {
+    ROS_ERROR("Could not write %s", filename.c_str());
+    return false;
+  }
+
+  file << "name,status,views,rms,wall_time,message\n";
+  for (size_t j = 0; j < results.size(); j++)
+  {
+    const BatchJobResult &r = results[j];
+    file << csvField(r.name) << ","
+         << (r.ok ? "ok" : "failed") << ","
+         << r.num_views << ","
+         << r.rms << ","
+         << r.wall_time << ","
+         << csvField(r.message) << "\n";
+  }
+
+  file.close();
+  if (!file)
+  {
+    ROS_ERROR("Error writing %s", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool writeCalibratedUrdf(const string &xml,
+                         RobotState *robot_state,
+                         const vector<string> &cameras,
+                         const string &filename)
+{
+  TiXmlDocument doc;
+  doc.Parse(xml.c_str());
+  TiXmlElement *robot = doc.FirstChildElement("robot");
+  if (doc.Error() || robot == 0)
+  {
+    ROS_ERROR("Could not parse the URDF");
+    return false;
+  }
+
+  // the reference camera (cameras[0]) is not modified
+  for (size_t i = 1; i < cameras.size(); i++)
+  {
+    const string joint_name = robot_state->getJointName(cameras[i]);
+
+    TiXmlElement *joint = robot->FirstChildElement("joint");
+    for (; joint != 0; joint = joint->NextSiblingElement("joint"))
+    {
+      const char *name = joint->Attribute("name");
+      if (name != 0 && joint_name == name)
+        break;
+    }
+
+    if (joint == 0)
+    {
+      ROS_ERROR("Joint %s (camera %s) not found in the URDF",
+                joint_name.c_str(), cameras[i].c_str());
+      return false;
+    }
+
+    TiXmlElement *origin = joint->FirstChildElement("origin");
+    if (origin == 0)
+      origin = joint->InsertEndChild(TiXmlElement("origin"))->ToElement();
+
+    urdf::Pose pose = robot_state->getUrdfPose(cameras[i]);
+    double roll, pitch, yaw;
+    pose.rotation.getRPY(roll, pitch, yaw);
+
+    origin->SetAttribute("xyz", formatTriple(pose.position.x, pose.position.y, pose.position.z).c_str());
+    origin->SetAttribute("rpy", formatTriple(roll, pitch, yaw).c_str());
+  }
+
+  return doc.SaveFile(filename.c_str());
+}
+
+bool writeJointOffsets(const vector<string> &joints,
+                       const vector<double> &offsets,
+                       const string &filename)
+{
+  ofstream file(filename.c_str());
+  if (!file)
+  {
+    ROS_ERROR("Could not write %s", filename.c_str());
+    return false;
+  }
+
+  file << "joint_offsets:\n" << setprecision(12);
+  for (size_t j = 0; j < joints.size() && j < offsets.size(); j++)
+    file << "  " << joints[j] << ": " << offsets[j] << "\n";
+
+  return bool(file);
+}
+
+}
@@ -93,10 +93,18 @@ double findChessboardPose(InputArray objectPoints,
                           InputArray distCoeffs,
                           OutputArray rvec,
                           OutputArray tvec,
-                          OutputArray proj_points2D)
+                          OutputArray proj_points2D,
+                          int method,
+                          bool use_extrinsic_guess)
 {
-  solvePnP(objectPoints, imagePoints, cameraMatrix, distCoeffs,
-               rvec, tvec, false, CV_ITERATIVE);
+  if (method == PNP_PLANAR)
+    planarChessboardPose(objectPoints, imagePoints, cameraMatrix, distCoeffs, rvec, tvec);
+  else if (method == PNP_EPNP)
+    solvePnP(objectPoints, imagePoints, cameraMatrix, distCoeffs,
+             rvec, tvec, false, CV_EPNP);
+  else
+    solvePnP(objectPoints, imagePoints, cameraMatrix, distCoeffs,
+             rvec, tvec, use_extrinsic_guess, CV_ITERATIVE);
 
   // reprojection error
   double err = computeReprojectionErrors(objectPoints, imagePoints,
@@ -106,18 +114,61 @@ double findChessboardPose(InputArray objectPoints,
   return err;
 }
 
-void getCheckboardSize(const string &target_id, ChessBoard *cb)
+void planarChessboardPose(InputArray objectPoints,
+                          InputArray imagePoints,
+                          InputArray cameraMatrix,
+                          InputArray distCoeffs,
+                          OutputArray rvec,
+                          OutputArray tvec)
 {
-  if (target_id == "large_cb_7x6")
+  Mat object, image;
+  objectPoints.getMat().reshape(3, 1).convertTo(object, CV_64FC3);
+  imagePoints.getMat().reshape(2, 1).convertTo(image, CV_64FC2);
+
+  // board plane (X, Y) and normalized image points
+  vector<Point2d> board_xy(object.total()), normalized;
+  for (size_t j = 0; j < board_xy.size(); j++)
   {
-    cb->setSize(7, 6, 0.108);
+    const Point3d &X = object.at<Point3d>(j);
+    board_xy[j] = Point2d(X.x, X.y);
   }
-  else if (target_id == "small_cb_4x5")
+
+  undistortPoints(image, normalized, cameraMatrix, distCoeffs);
+
+  // H = lambda [r1 r2 t]
+  Mat H_mat = findHomography(board_xy, normalized, 0);
+  if (H_mat.empty())
   {
-    cb->setSize(4, 5, 0.0245);
+    // degenerate configuration
+    solvePnP(objectPoints, imagePoints, cameraMatrix, distCoeffs,
+             rvec, tvec, false, CV_EPNP);
+    return;
   }
-  else
-    ROS_ERROR("Wrong Checkboard size");
+  Matx33d H = H_mat;
+  Vec3d h1(H(0,0), H(1,0), H(2,0));
+  Vec3d h2(H(0,1), H(1,1), H(2,1));
+  Vec3d h3(H(0,2), H(1,2), H(2,2));
+
+  double lambda = 2.0 / (norm(h1) + norm(h2));
+  if (lambda * h3(2) < 0) // board in front of the camera
+    lambda = -lambda;
+
+  Vec3d r1 = lambda * h1;
+  Vec3d r2 = lambda * h2;
+  Vec3d r3 = r1.cross(r2);
+  Vec3d t  = lambda * h3;
+
+  // closest rotation matrix
+  Matx33d R(r1(0), r2(0), r3(0),
+            r1(1), r2(1), r3(1),
+            r1(2), r2(2), r3(2));
+  SVD svd(R);
+  Mat R_orth = svd.u * svd.vt;
+
+  Mat r;
+  Rodrigues(R_orth, r);
+  r.copyTo(rvec);
+  Mat(t).copyTo(tvec);
 }
 
 }
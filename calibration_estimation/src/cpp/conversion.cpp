@@ -189,6 +189,20 @@ void kdl2urdf(const KDL::Frame &frame, urdf::Pose *pose)
   pose->position.z = frame.p.z();
 }
 
+void urdf2kdl(const urdf::Pose &pose, KDL::Frame *frame)
+{
+  // rotation
+  frame->M = KDL::Rotation::Quaternion(pose.rotation.x,
+                                       pose.rotation.y,
+                                       pose.rotation.z,
+                                       pose.rotation.w);
+
+  // translation
+  frame->p = KDL::Vector(pose.position.x,
+                         pose.position.y,
+                         pose.position.z);
+}
+
 void serialize(const cv::Point3d &in, double out[3])
 {
   out[0] = in.x;
@@ -42,17 +42,47 @@
 
 #include "auxiliar.h"
 
+#include <algorithm>
+#include <exception>
+#include <boost/thread/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+
 using namespace std;
 using namespace cv;
 
 namespace calib
 {
 
-// Static member allocation
-Markers    *Data::markers_ = 0;
-RobotState *Data::robot_state_ = 0;
+/// \brief Generate views[k] from msgs[k] for k = order[begin], ..., order[end-1]
+/// (valid[k] = 0 if the view could not be generated)
+static void generateViews(const vector<Msg>        *msgs,
+                          vector<View>             *views,
+                          vector<char>             *valid,
+                          const CalibrationContext *context,
+                          RobotState               *robot_state,
+                          const vector<size_t>     *order,
+                          size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; i++)
+  {
+    size_t k = (*order)[i];
+    try
+    {
+      (*views)[k].setContext(context);
+      (*valid)[k] = (*views)[k].generateView((*msgs)[k], robot_state, false);
+      (*views)[k].releaseRawData();
+    }
+    catch (std::exception &e) // a thread must not throw, the view is skipped
+    {
+      ROS_ERROR("Could not generate the view of sample %s: %s",
+                (*msgs)[k]->sample_id.c_str(), e.what());
+      (*valid)[k] = 0;
+    }
+  }
+}
 
-Data::Data()
+Data::Data() : view_ordering_(false)
 {
 }
 
@@ -62,23 +92,247 @@ Data::~Data()
 
 void Data::setRobotState(RobotState *robot_state)
 {
-  robot_state_ = robot_state;
-  View::setRobotState(robot_state_);
+  context_.robot_state = robot_state;
+}
+
+void Data::setTargetRegistry(const TargetRegistry *target_registry)
+{
+  context_.target_registry = target_registry;
 }
 
 void Data::setMarkers(Markers *markers)
 {
-  markers_ = markers;
+  context_.markers = markers;
 }
 
 void Data::addMeasurement(const Msg &msg)
 {
   // set and generate view from message
   View current_view;
-  current_view.generateView(msg);
+  current_view.setContext(&context_);
+  if (!current_view.generateView(msg, context_.robot_state, false))
+    return; // skipped (already reported)
+  current_view.releaseRawData();
 
   // add to internal vector of views
   view_.push_back(current_view);
+  orderViews(view_.size() - 1);
+
+  // board poses
+  pose_initializer_.run(&view_, view_.size() - 1);
+}
+
+void Data::addMeasurements(const vector<Msg> &msgs, int num_threads)
+{
+  if (context_.robot_state == 0)
+  {
+    ROS_ERROR("robot_state unset, use setRobotState()");
+    return;
+  }
+
+  if (num_threads <= 0)
+    num_threads = max(1u, boost::thread::hardware_concurrency());
+  num_threads = min<size_t>(num_threads, max<size_t>(msgs.size(), 1));
+
+  // one kinematic context per thread (plain RobotState, no /tf publishing)
+  vector<boost::shared_ptr<RobotState> > robot_states;
+  RobotState::createThreadStates(*context_.robot_state, num_threads, &robot_states);
+
+  // generate views, each thread a consecutive range of the processing order
+  // (it writes only its own slots)
+  vector<size_t> order;
+  processingOrder(msgs, &order);
+
+  vector<View> views(msgs.size());
+  vector<char> valid(msgs.size(), 0);
+  size_t chunk = (msgs.size() + num_threads - 1) / num_threads;
+  boost::thread_group threads;
+  for (int t = 0; t < num_threads; t++)
+  {
+    size_t begin = min(t * chunk, msgs.size());
+    size_t end   = min(begin + chunk, msgs.size());
+    threads.create_thread(boost::bind(&generateViews, &msgs, &views, &valid, &context_,
+                                      robot_states[t].get(), &order, begin, end));
+  }
+  threads.join_all();
+
+  // drop the views that could not be generated (already reported)
+  if (find(valid.begin(), valid.end(), 0) != valid.end())
+  {
+    vector<size_t> index(msgs.size());
+    size_t n = 0;
+    for (size_t k = 0; k < msgs.size(); k++)
+    {
+      index[k] = n;
+      if (valid[k])
+        views[n++] = views[k];
+    }
+    views.resize(n);
+
+    size_t m = 0;
+    for (size_t i = 0; i < order.size(); i++)
+      if (valid[order[i]])
+        order[m++] = index[order[i]];
+    order.resize(m);
+  }
+
+  // board poses (dataset-level, parallel over (view, camera))
+  PoseInitializer pose_initializer = pose_initializer_;
+  pose_initializer.setNumThreads(num_threads);
+  pose_initializer.run(&views);
+
+  // add to internal vector of views (same order as msgs)
+  size_t offset = view_.size();
+  view_.insert(view_.end(), views.begin(), views.end());
+  orderViews(offset, order);
+
+  // leave the shared robot state as the serial version does (last view)
+  if (!views.empty())
+    view_.back().updateRobot();
+}
+
+void Data::processingOrder(const vector<Msg> &msgs, vector<size_t> *order) const
+{
+  if (view_ordering_)
+    jointSpaceOrder(msgs, order);
+  else
+  {
+    order->resize(msgs.size());
+    for (size_t k = 0; k < msgs.size(); k++)
+      (*order)[k] = k;
+  }
+}
+
+void Data::orderViews(size_t first, const vector<size_t> &order)
+{
+  orderRange(first, first);
+  for (size_t i = 0; i < order.size(); i++)
+    view_order_.push_back(first + order[i]);
+}
+
+void Data::orderViews(size_t first)
+{
+  orderRange(first, view_.size());
+}
+
+void Data::orderRange(size_t first, size_t last)
+{
+  // keep the stored order a permutation of [0, first), e.g. after
+  // setViewOrdering() or views added to view_ directly
+  if (view_order_.size() > first)
+    view_order_.clear();
+  if (view_order_.size() < first)
+    orderRange(view_order_.size(), first);
+
+  vector<Msg> msgs(last - first);
+  for (size_t v = first; v < last; v++)
+    msgs[v - first] = view_[v].msg_;
+
+  vector<size_t> order;
+  processingOrder(msgs, &order);
+  for (size_t i = 0; i < order.size(); i++)
+    view_order_.push_back(first + order[i]);
+}
+
+void Data::jointSpaceOrder(const vector<Msg> &msgs, vector<size_t> *order,
+                           double tolerance)
+{
+  order->clear();
+  size_t size = msgs.size();
+  if (size == 0)
+    return;
+
+  // joint vectors (joints out of the message are zero, see View::updateRobot())
+  map<string, size_t> joint_idx;
+  vector<vector<pair<size_t, double> > > chains(size);
+  for (size_t v = 0; v < size; v++)
+  {
+    for (size_t c = 0; c < msgs[v]->M_chain.size(); c++)
+    {
+      const sensor_msgs::JointState &chain_state = msgs[v]->M_chain[c].chain_state;
+      for (size_t j = 0; j < chain_state.name.size() && j < chain_state.position.size(); j++)
+      {
+        size_t idx = joint_idx.insert(make_pair(chain_state.name[j], joint_idx.size())).first->second;
+        chains[v].push_back(make_pair(idx, chain_state.position[j]));
+      }
+    }
+  }
+
+  vector<vector<double> > q(size, vector<double>(joint_idx.size(), 0.0));
+  for (size_t v = 0; v < size; v++)
+    for (size_t j = 0; j < chains[v].size(); j++)
+      q[v][chains[v][j].first] = chains[v][j].second;
+
+  // greedy nearest neighbour
+  vector<char> visited(size, 0);
+  size_t current = 0;
+  for (size_t k = 0; k < size; k++)
+  {
+    order->push_back(current);
+    visited[current] = 1;
+
+    size_t best = size, best_changes = 0;
+    double best_dist = 0;
+    for (size_t v = 0; v < size; v++)
+    {
+      if (visited[v])
+        continue;
+
+      size_t changes = 0;
+      double dist = 0;
+      for (size_t j = 0; j < q[v].size(); j++)
+      {
+        double d = fabs(q[v][j] - q[current][j]);
+        if (d > tolerance)
+        {
+          changes++;
+          dist += d;
+        }
+      }
+
+      if (best == size || changes < best_changes ||
+          (changes == best_changes && dist < best_dist))
+      {
+        best = v;
+        best_changes = changes;
+        best_dist = dist;
+      }
+    }
+    current = best;
+  }
+}
+
+void Data::updateViews(size_t first)
+{
+  if (context_.robot_state == 0)
+  {
+    ROS_ERROR("robot_state unset, use setRobotState()");
+    return;
+  }
+
+  if (first >= view_.size())
+    return;
+
+  // stored order (computed when the views were added), see orderViews()
+  if (view_order_.size() != view_.size())
+    orderRange(view_.size(), view_.size());
+
+  for (size_t i = 0; i < view_order_.size(); i++)
+  {
+    if (view_order_[i] < first)
+      continue;
+
+    View &view = view_[view_order_[i]];
+    view.updateView(context_.robot_state, false);
+    view.calc_error();
+  }
+}
+
+void Data::buildObservations(const vector<string> &cameras)
+{
+  observations_.clear(cameras);
+  for (size_t v = 0; v < view_.size(); v++)
+    observations_.addView(view_[v]);
 }
 
 void Data::showView(std::size_t id)
@@ -92,9 +346,15 @@ void Data::showView(std::size_t id)
 
 void Data::showView(std::size_t id, const vector<string> &camera_frames)
 {
+  if (context_.markers == 0)
+  {
+    ROS_ERROR("markers unset, use setMarkers()");
+    return;
+  }
+
   if (id < view_.size())
   {
-    markers_->reset();
+    context_.markers->reset();
     updateRobot(id);
     View &current_view = view_[id];
 
@@ -116,7 +376,7 @@ void Data::showView(std::size_t id, const vector<string> &camera_frames)
 //                       &new_points);
 
       // add new_points to markers_
-      markers_->addMarkers(current_view.board_transformed_pts_3D_[cam_idx],
+      context_.markers->addMarkers(current_view.board_transformed_pts_3D_[cam_idx],
                            current_view.camera_id_[cam_idx],
                            current_view.frame_name_[cam_idx],
                            chooseColor(i));
@@ -126,7 +386,7 @@ void Data::showView(std::size_t id, const vector<string> &camera_frames)
            << " --  camera: "           << current_view.camera_id_[cam_idx] << endl;
       cout << "\tcam_model.tfFrame(): " << current_view.frame_name_[cam_idx] << endl;
       cout << "\tReproj. error = "      << current_view.error_[cam_idx] << endl;
-      cout << "\tAveg. error = "        << current_view.error_[cam_idx] / current_view.board_model_pts_3D_.size() << endl;
+      cout << "\tAveg. error = "        << current_view.error_[cam_idx] / current_view.target_->corners.size() << endl;
       cout << "\trvec = "               << current_view.rvec_[cam_idx] << endl;
       cout << "\ttvec = "               << current_view.tvec_[cam_idx] << endl << endl;
     }
@@ -140,7 +400,7 @@ void Data::showView(std::size_t id, const vector<string> &camera_frames)
     if( current_view.triang_pts_3D_.size() > 0 )
     {
       // add new_points to markers_
-      markers_->addMarkers(Mat(current_view.triang_pts_3D_),
+      context_.markers->addMarkers(Mat(current_view.triang_pts_3D_),
                            "triangulation",
                            camera_frames[0],
                            cv::Scalar(255, 255, 255));
@@ -158,7 +418,7 @@ void Data::apply_transform(const cv::Mat &points,
                            cv::Mat *modif_points)
 {
   KDL::Frame pose;
-  robot_state_->getFK(frame, &pose);
+  context_.robot_state->getFK(frame, &pose);
   transform3DPoints(points, pose, modif_points);
 }
 
@@ -168,8 +428,8 @@ void Data::apply_transform(const cv::Mat &points,
                            cv::Mat *modif_points)
 {
   KDL::Frame pose1, pose2;
-  robot_state_->getFK(frame1, &pose1);
-  robot_state_->getFK(frame2, &pose2);
+  context_.robot_state->getFK(frame1, &pose1);
+  context_.robot_state->getFK(frame2, &pose2);
   transform3DPoints(points, pose2.Inverse() * pose1, modif_points);
 }
 
@@ -0,0 +1,440 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include "dataset_cache.h"
+#include "data.h"
+#include "target_registry.h"
+
+#include <ros/ros.h>
+#include <ros/serialization.h>
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace cv;
+using boost::uint8_t;
+using boost::uint32_t;
+using boost::uint64_t;
+using boost::int64_t;
+
+namespace calib
+{
+
+static const char MAGIC[8] = "CALIBDS";
+
+// header (32 bytes)
+struct DatasetHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t num_views;
+  uint64_t bag_hash;
+  uint64_t config_hash;
+};
+
+// FNV-1a
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t k = 0; k < size; k++)
+    hash = (hash ^ bytes[k]) * 1099511628211ULL;
+  return hash;
+}
+
+template <typename T>
+static uint64_t fnv1a(uint64_t hash, const T &value)
+{
+  return fnv1a(hash, &value, sizeof(T));
+}
+
+/// \brief Bounds-checked reader over the mapped file
+class MappedReader
+{
+public:
+  MappedReader(const uint8_t *data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+  bool read(void *dst, size_t size)
+  {
+    if (pos_ + size > size_)
+      return false;
+    memcpy(dst, data_ + pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+  /// \brief Pointer to the next 'size' bytes (skipping them)
+  const uint8_t *skip(size_t size)
+  {
+    if (pos_ + size > size_)
+      return 0;
+    const uint8_t *ptr = data_ + pos_;
+    pos_ += size;
+    return ptr;
+  }
+
+private:
+  const uint8_t *data_;
+  size_t size_;
+  size_t pos_;
+};
+
+template <typename T>
+static void writeValue(ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/// \brief The view has a board pose (3 + 3 doubles) and the expected points
+/// of each camera, as written to the cache
+static bool hasCachedPoses(const View &view)
+{
+  size_t num_cams = view.rvec_.size();
+  if (!view.hasCbPoses() || view.tvec_.size() != num_cams ||
+      view.error_.size() != num_cams || view.expected_pts_2D_.size() != num_cams)
+    return false;
+
+  for (size_t i = 0; i < num_cams; i++)
+  {
+    if (view.rvec_[i].total() != 3 || view.rvec_[i].type() != CV_64F ||
+        view.tvec_[i].total() != 3 || view.tvec_[i].type() != CV_64F)
+      return false;
+  }
+  return true;
+}
+
+DatasetCache::DatasetCache(const string &filename) : filename_(filename)
+{
+}
+
+DatasetCache::~DatasetCache()
+{
+}
+
+uint64_t DatasetCache::hashFile(const string &filename)
+{
+  const size_t BLOCK = 1 << 20; // 1 MiB
+
+  struct stat st;
+  ifstream in(filename.c_str(), ios::binary);
+  if (!in || stat(filename.c_str(), &st) != 0)
+    return 0;
+
+  // the file identity and modification time catch the changes between the
+  // two blocks (a bag rewritten in place, a different bag of the same size)
+  uint64_t size = st.st_size;
+  uint64_t hash = FNV_OFFSET;
+  hash = fnv1a(hash, size);
+  hash = fnv1a(hash, uint64_t(st.st_dev));
+  hash = fnv1a(hash, uint64_t(st.st_ino));
+  hash = fnv1a(hash, int64_t(st.st_mtim.tv_sec));
+  hash = fnv1a(hash, int64_t(st.st_mtim.tv_nsec));
+
+  vector<char> buffer(BLOCK);
+  uint64_t offsets[2] = { 0, size > BLOCK ? size - BLOCK : 0 };
+  for (int b = 0; b < 2; b++)
+  {
+    in.seekg(offsets[b]);
+    in.read(&buffer[0], BLOCK);
+    streamsize n = in.gcount();
+    in.clear();
+    hash = fnv1a(hash, &buffer[0], n);
+  }
+
+  return hash;
+}
+
+uint64_t DatasetCache::hashConfig(const Data &data)
+{
+  uint64_t hash = FNV_OFFSET;
+  hash = fnv1a(hash, uint32_t(data.pose_initializer_.getMethod()));
+  hash = fnv1a(hash, uint8_t(data.pose_initializer_.getFKSeed()));
+
+  // targets (by id, map order)
+  TargetRegistry pr2_targets;
+  const TargetRegistry *registry = data.context().target_registry;
+  if (registry == 0)
+    registry = &pr2_targets;
+
+  const map<string, TargetPtr> &targets = registry->targets();
+  for (map<string, TargetPtr>::const_iterator it = targets.begin(); it != targets.end(); it++)
+  {
+    const Target &target = *it->second;
+    hash = fnv1a(hash, target.id.c_str(), target.id.size() + 1);
+    hash = fnv1a(hash, uint32_t(target.width));
+    hash = fnv1a(hash, uint32_t(target.height));
+    hash = fnv1a(hash, target.spacing_x);
+    hash = fnv1a(hash, target.spacing_y);
+  }
+
+  return hash;
+}
+
+bool DatasetCache::write(uint64_t bag_hash, const Data &data)
+{
+  // the cache holds all the views of the bag or none
+  for (size_t v = 0; v < data.view_.size(); v++)
+  {
+    if (!hasCachedPoses(data.view_[v]))
+    {
+      ROS_ERROR("Dataset cache %s not written: view %zu has no board poses",
+                filename_.c_str(), v);
+      return false;
+    }
+  }
+
+  // write a temporary file and rename it (never leave a partial cache); the
+  // name is unique, so concurrent writers of the same cache do not collide
+  // and the last rename wins
+  vector<char> tmp_template(filename_.begin(), filename_.end());
+  const char suffix[] = ".XXXXXX";
+  tmp_template.insert(tmp_template.end(), suffix, suffix + sizeof(suffix));
+  int fd = mkstemp(&tmp_template[0]);
+  if (fd < 0)
+  {
+    ROS_ERROR("Could not write dataset cache %s", filename_.c_str());
+    return false;
+  }
+  fchmod(fd, 0644);  // mkstemp() creates it 0600
+  close(fd);
+
+  string tmp_filename(&tmp_template[0]);
+  ofstream out(tmp_filename.c_str(), ios::binary | ios::trunc);
+  if (!out)
+  {
+    ROS_ERROR("Could not write dataset cache %s", tmp_filename.c_str());
+    remove(tmp_filename.c_str());
+    return false;
+  }
+
+  DatasetHeader header;
+  memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.version   = VERSION;
+  header.num_views = data.view_.size();
+  header.bag_hash  = bag_hash;
+  header.config_hash = hashConfig(data);
+  writeValue(out, header);
+
+  vector<uint8_t> buffer;
+  for (size_t v = 0; v < data.view_.size(); v++)
+  {
+    const View &view = data.view_[v];
+
+    // message
+    uint32_t msg_size = ros::serialization::serializationLength(*view.msg_);
+    buffer.resize(msg_size);
+    ros::serialization::OStream stream(buffer.empty() ? 0 : &buffer[0], msg_size);
+    ros::serialization::serialize(stream, *view.msg_);
+
+    writeValue(out, msg_size);
+    out.write(reinterpret_cast<const char *>(buffer.empty() ? 0 : &buffer[0]), msg_size);
+
+    // initial board poses
+    uint32_t num_cams = view.rvec_.size();
+    writeValue(out, num_cams);
+    for (size_t i = 0; i < num_cams; i++)
+    {
+      for (int k = 0; k < 3; k++)
+        writeValue(out, view.rvec_[i].at<double>(k));
+      for (int k = 0; k < 3; k++)
+        writeValue(out, view.tvec_[i].at<double>(k));
+      writeValue(out, view.error_[i]);
+
+      const View::Points2D &expected = view.expected_pts_2D_[i];
+      uint32_t num_points = expected.size();
+      writeValue(out, num_points);
+      for (size_t j = 0; j < num_points; j++)
+      {
+        writeValue(out, expected[j].x);
+        writeValue(out, expected[j].y);
+      }
+    }
+  }
+
+  out.close();
+  if (!out || rename(tmp_filename.c_str(), filename_.c_str()) != 0)
+  {
+    ROS_ERROR("Could not write dataset cache %s", filename_.c_str());
+    remove(tmp_filename.c_str());
+    return false;
+  }
+
+  ROS_INFO("Dataset cache written: %s (%zu views)", filename_.c_str(), data.view_.size());
+  return true;
+}
+
+bool DatasetCache::load(uint64_t bag_hash,
+                        Data *data,
+                        map<string, int> *sample_id)
+{
+  if (data->context().robot_state == 0)
+  {
+    ROS_ERROR("robot_state unset, use Data::setRobotState()");
+    return false;
+  }
+
+  int fd = open(filename_.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false; // no cache yet
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DatasetHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  size_t file_size = st.st_size;
+  void *mapped = mmap(0, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    ROS_ERROR("Could not map dataset cache %s", filename_.c_str());
+    return false;
+  }
+
+  MappedReader reader(static_cast<const uint8_t *>(mapped), file_size);
+
+  DatasetHeader header;
+  reader.read(&header, sizeof(header));
+  if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != VERSION || header.bag_hash != bag_hash ||
+      header.config_hash != hashConfig(*data))
+  {
+    ROS_INFO("Dataset cache %s is out of date", filename_.c_str());
+    munmap(mapped, file_size);
+    return false;
+  }
+
+  // read all the views before adding them (a truncated file adds nothing)
+  vector<View> views(header.num_views);
+  vector<Msg>  msgs(header.num_views);
+  bool ok = true;
+  for (size_t v = 0; v < views.size() && ok; v++)
+  {
+    View &view = views[v];
+    view.setContext(&data->context());
+
+    // message
+    uint32_t msg_size = 0;
+    ok = reader.read(&msg_size, sizeof(msg_size));
+    const uint8_t *msg_data = ok ? reader.skip(msg_size) : 0;
+    if (msg_data == 0)
+    {
+      ok = false;
+      break;
+    }
+
+    Msg msg(new calibration_msgs::RobotMeasurement());
+    ros::serialization::IStream stream(const_cast<uint8_t *>(msg_data), msg_size);
+    try
+    {
+      ros::serialization::deserialize(stream, *msg);
+    }
+    catch (ros::serialization::StreamOverrunException &e)
+    {
+      ok = false;
+      break;
+    }
+
+    // initial board poses
+    uint32_t num_cams = 0;
+    ok = reader.read(&num_cams, sizeof(num_cams));
+    for (size_t i = 0; i < num_cams && ok; i++)
+    {
+      double pose[7]; // rvec, tvec, error
+      uint32_t num_points = 0;
+      ok = reader.read(pose, sizeof(pose)) && reader.read(&num_points, sizeof(num_points));
+
+      View::Points2D expected(num_points);
+      for (size_t j = 0; j < num_points && ok; j++)
+        ok = reader.read(&expected[j].x, sizeof(double)) && reader.read(&expected[j].y, sizeof(double));
+
+      view.rvec_.push_back(Mat(3, 1, CV_64F, &pose[0]).clone());
+      view.tvec_.push_back(Mat(3, 1, CV_64F, &pose[3]).clone());
+      view.error_.push_back(pose[6]);
+      view.expected_pts_2D_.push_back(expected);
+    }
+
+    msgs[v] = msg;
+  }
+
+  munmap(mapped, file_size);
+
+  // restore the views (kinematics), see Data::setViewOrdering()
+  vector<size_t> order;
+  if (ok)
+  {
+    data->processingOrder(msgs, &order);
+    for (size_t i = 0; i < order.size() && ok; i++)
+      ok = views[order[i]].restoreView(msgs[order[i]], data->context().robot_state);
+  }
+
+  if (!ok)
+  {
+    ROS_ERROR("Dataset cache %s is corrupted", filename_.c_str());
+    return false;
+  }
+
+  // add to data
+  size_t offset = data->size();
+  data->view_.insert(data->view_.end(), views.begin(), views.end());
+  data->orderViews(offset, order);
+
+  if (sample_id != 0)
+  {
+    for (size_t v = offset; v < data->size(); v++)
+      (*sample_id)[data->view_[v].msg_->sample_id] = v;
+  }
+
+  // leave the shared robot state as the serial version does (last view)
+  if (data->size() > offset)
+    data->view_.back().updateRobot();
+
+  ROS_INFO("Dataset cache loaded: %s (%zu views)", filename_.c_str(), views.size());
+  return true;
+}
+
+}
@@ -41,7 +41,7 @@
 namespace calib
 {
 
-JointState::JointState()
+JointState::JointState() : revision_(0)
 {
 }
 
@@ -51,38 +51,38 @@ JointState::~JointState()
 
 void JointState::initString(const std::vector<std::string> &joint_name)
 {
-  joint_positions_.clear();
+  joint_symbols_.clear();
+  revision_++;
 
-  // create joint_positions_ map
+  // intern the joint names (id: position in position_)
   for (unsigned i = 0; i < joint_name.size(); ++i)
   {
-    joint_positions_[joint_name[i]] = 0;
+    joint_symbols_.intern(joint_name[i]);
   }
+  joint_symbols_.freeze();  // lock-free lookups
+  position_.assign(joint_symbols_.size(), 0);
 }
 
 bool JointState::empty(void)
 {
-  return joint_positions_.empty();
+  return position_.empty();
 }
 
 void JointState::reset(void)
 {
+  revision_++;
+
   // reset joints to zeros
-  for (JointStateType::iterator it = joint_positions_.begin();
-        it != joint_positions_.end(); it++)
-  {
-    it->second = 0;
-  }
+  position_.assign(position_.size(), 0);
 }
 
 bool JointState::update(const std::string &joint_name,
                         const double      &position)
 {
-  JointStateType::iterator it = joint_positions_.find(joint_name);
-  if (it != joint_positions_.end())
+  int joint_idx = joint_symbols_.find(joint_name);
+  if (joint_idx >= 0)
   {
-    it->second = position;
-    return true;
+    return update(joint_idx, position);
   }
   else
   {
@@ -108,26 +108,43 @@ bool JointState::update(const std::vector<std::string> &joint_name,
   }
 }
 
+bool JointState::update(int joint_idx, double position)
+{
+  if (joint_idx < 0 || joint_idx >= (int)position_.size())
+  {
+    ROS_ERROR("Joint index %d does not belong to the joint positions vector.", joint_idx);
+    return false;
+  }
+
+  position_[joint_idx] = position;
+  revision_++;
+  return true;
+}
+
 void JointState::getJointNames(std::vector<std::string> *joint_name) const
 {
   // get joint names
   joint_name->clear();
-  for (JointStateType::const_iterator it = joint_positions_.begin();
-       it != joint_positions_.end(); it++)
+  for (size_t id = 0; id < position_.size(); id++)
   {
-    joint_name->push_back(it->first);
+    joint_name->push_back(joint_symbols_.name(id));
   }
 }
 
 void JointState::getJointPositions(std::vector<double> *joint_position) const
 {
   // get joint position
-  joint_position->clear();
-  for (JointStateType::const_iterator it = joint_positions_.begin();
-       it != joint_positions_.end(); it++)
+  *joint_position = position_;
+}
+
+JointState::JointStateType JointState::getJointPositions() const
+{
+  JointStateType joint_positions;
+  for (size_t id = 0; id < position_.size(); id++)
   {
-    joint_position->push_back(it->second);
+    joint_positions[joint_symbols_.name(id)] = position_[id];
   }
+  return joint_positions;
 }
 
 }
@@ -38,32 +38,140 @@
  * This is a app for run and visualize estimation errors
  */
 
-#include <rosbag/bag.h>
-#include <rosbag/view.h>
-#include <boost/foreach.hpp>
-
 #include "optimization.h"
+#include "bag_reader.h"
+#include "dataset_cache.h"
+#include "batch_runner.h"
 
 #include "markers.h"
 #include "robot_state.h"
 #include "robot_state_publisher.h"
 #include "calibration_msgs/RobotMeasurement.h"
 
+#include <ros/callback_queue.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 using namespace std;
 using namespace cv;
 using namespace calib;
 
 // global variables
-RobotState *robot_state;
-Markers    *visual_markers;
-Data       *data;
+RobotState          *robot_state;
+RobotStatePublisher *tf_publisher = 0;    // robot_state, unless headless
+Markers             *visual_markers = 0;  // 0 if headless
+Data                *data;
 
 Optimization optimazer;
 map<string, int> sample_id;
+string profile_report;  // phase timing / solver telemetry (JSON or CSV)
+string joint_offsets_file;  // estimated joint offsets (YAML), "" disables it
+
+// online mode: the ROS callbacks (new measurements, /tf and markers timers)
+// and the optimization share data and robot_state through data_mutex; the
+// solver thread waits for new views (pending_views)
+boost::mutex              data_mutex;
+boost::mutex              pending_mutex;
+boost::condition_variable pending_cond;
+bool                      pending_views = false;
+
+/// \brief Stop (true) or resume (false) the periodic /tf and marker publishing
+void pausePublishing(bool pause)
+{
+  if (tf_publisher)
+    tf_publisher->setHeadless(pause);
+  if (visual_markers)
+    visual_markers->setHeadless(pause);
+}
+
+/// \brief Publish pending changes and report the publish counts
+void flushPublishing()
+{
+  if (tf_publisher)
+    tf_publisher->flush();
+  if (visual_markers)
+    visual_markers->flush();
+
+  ROS_INFO("Published %zu /tf sets and %zu marker arrays",
+           tf_publisher ? tf_publisher->getPublishCount() : 0,
+           visual_markers ? visual_markers->getPublishCount() : 0);
+}
+
+/// \brief Write the estimated joint offsets (full-chain calibration)
+void exportJointOffsets()
+{
+  vector<double> offsets;
+  optimazer.getJointOffsets(&offsets);
+  if (!offsets.empty() && !joint_offsets_file.empty())
+    writeJointOffsets(optimazer.getJointOffsetNames(), offsets, joint_offsets_file);
+}
 
 void robotMeasurementCallback(const calibration_msgs::RobotMeasurement::Ptr robot_measurement)
 {
-  data->showView( sample_id[robot_measurement->sample_id] );
+  map<string, int>::const_iterator it = sample_id.find(robot_measurement->sample_id);
+  if (it != sample_id.end()) // skipped views are not shown
+    data->showView(it->second);
+}
+
+/// \brief New view (called with data_mutex locked, see spinLocked()), the
+/// solver thread refines the solution
+void onlineMeasurementCallback(const calibration_msgs::RobotMeasurement::Ptr robot_measurement)
+{
+  size_t id = data->size();
+  data->addMeasurement(robot_measurement);
+  if (data->size() == id)
+    return; // skipped (e.g. unknown target)
+
+  sample_id[robot_measurement->sample_id] = id;
+
+  {
+    boost::mutex::scoped_lock lock(pending_mutex);
+    pending_views = true;
+  }
+  pending_cond.notify_one();
+}
+
+/// \brief Online solver thread: each runIncremental() adds all the views that
+/// arrived since the previous one (several measurements, one solve)
+void onlineSolverThread()
+{
+  while (ros::ok())
+  {
+    {
+      boost::mutex::scoped_lock lock(pending_mutex);
+      while (!pending_views && ros::ok())
+        pending_cond.timed_wait(lock, boost::posix_time::milliseconds(100));
+      if (!pending_views)
+        break; // shutdown
+      pending_views = false;
+    }
+
+    optimazer.runIncremental();  // data_mutex released during the solve
+    if (!profile_report.empty())
+      optimazer.getProfiler().write(profile_report);
+    exportJointOffsets();
+
+    boost::mutex::scoped_lock lock(data_mutex);
+    flushPublishing();
+  }
+}
+
+/// \brief ros::spin() with data_mutex locked while the callbacks run
+void spinLocked()
+{
+  ros::CallbackQueue *queue = ros::getGlobalCallbackQueue();
+  while (ros::ok())
+  {
+    if (queue->isEmpty())
+    {
+      ros::WallDuration(0.005).sleep();
+      continue;
+    }
+
+    boost::mutex::scoped_lock lock(data_mutex);
+    queue->callAvailable();
+  }
 }
 
 int main(int argc, char **argv)
@@ -76,60 +184,160 @@ int main(int argc, char **argv)
   if (!model.initParam("robot_description"))
     return EXIT_FAILURE;
 
-  // create robot
-  bool publising = true;  // true by default. It will publish /tf
-  if (publising)
-    robot_state = new RobotStatePublisher();
+  // create node
+  ros::NodeHandle n; //("calib");
+
+  // 'headless' (false by default): no /tf nor markers, and the offline
+  // calibration exits when it finishes
+  bool headless;
+  n.param("headless", headless, false);
+
+  // create robot (it will publish /tf, unless headless)
+  if (!headless)
+    robot_state = tf_publisher = new RobotStatePublisher();
   else
     robot_state = new RobotState();
 
   // init robot from urdf
   robot_state->initFromURDF(model);
 
-  // create node
-  ros::NodeHandle n; //("calib");
-
   // visualization marker publisher
-  visual_markers = new Markers();
+  if (!headless)
+    visual_markers = new Markers();
+
+
+  // set Data class
+  data = new Data();
+  data->setRobotState(robot_state);
+  data->setMarkers(visual_markers);
+
+  // Choose cameras to be calibrated
+  std::vector<std::string> camera_frames;
+  camera_frames.clear();
+  camera_frames.push_back("narrow_stereo_l_stereo_camera_optical_frame"); // [I|0]
+  camera_frames.push_back("narrow_stereo_r_stereo_camera_optical_frame");
+  camera_frames.push_back("wide_stereo_l_stereo_camera_optical_frame");
+  camera_frames.push_back("wide_stereo_r_stereo_camera_optical_frame");
+  camera_frames.push_back("head_mount_kinect_rgb_optical_frame");
+  camera_frames.push_back("high_def_optical_frame");
+
+  // Optimization
+  optimazer.setRobotState(robot_state);
+  optimazer.setMarkers(visual_markers);
+  optimazer.setData(data);
+  optimazer.setCamerasCalib(camera_frames);
+
+  // closed-form jacobians by default ('false' uses AutoDiff)
+  bool analytic_jacobian;
+  n.param("analytic_jacobian", analytic_jacobian, true);
+  optimazer.setAnalyticJacobian(analytic_jacobian);
+
+  // views parameterized by free 3D points by default ('true': board pose)
+  bool board_pose;
+  n.param("board_pose", board_pose, false);
+  optimazer.setBoardPose(board_pose);
+
+  // board pose: one residual block per camera-view ('false': per corner)
+  bool fused_residuals;
+  n.param("fused_residuals", fused_residuals, true);
+  optimazer.setFusedResiduals(fused_residuals);
+
+  // full-chain calibration: offsets of the 'joint_offsets' joints (none by
+  // default), with the board attached to 'chain_target_frame'
+  std::vector<std::string> joint_offsets;
+  string chain_target_frame;
+  n.getParam("joint_offsets", joint_offsets);
+  n.param("chain_target_frame", chain_target_frame, string("r_gripper_tool_frame"));
+  optimazer.setJointOffsets(joint_offsets, chain_target_frame);
+  n.param("joint_offsets_file", joint_offsets_file, string("joint_offsets.yaml"));
+
+  // ceres solver configuration (linear solver "auto" by default)
+  SolverOptions solver_options;
+  solver_options.readParam(n);
+  optimazer.setSolverOptions(solver_options);
 
+  // profiling report ("" disables it), labeled with the robot name
+  n.param("profile_report", profile_report, string(""));
+  optimazer.setProfilerLabel(model.getName());
 
-  // read bag filename from param
-  string rosbag_filename;
-  if (!n.getParam("cal_measurements", rosbag_filename))
+  // board pose initialization: PnP method ("iterative", "epnp", "planar"),
+  // non-reference cameras seeded with the FK prediction by default
+  string pnp_method_name;
+  bool pnp_fk_seed;
+  int pnp_threads;
+  n.param("pnp_method", pnp_method_name, string("iterative"));
+  n.param("pnp_fk_seed", pnp_fk_seed, true);
+  n.param("pnp_threads", pnp_threads, 0);
+
+  PnPMethod pnp_method;
+  if (!PoseInitializer::parseMethod(pnp_method_name, &pnp_method))
   {
-    ROS_ERROR("Could read parameter cal_measurements on parameter server");
-    return false;
+    ROS_ERROR("Unknown pnp_method '%s', using 'iterative'", pnp_method_name.c_str());
+    pnp_method = PNP_ITERATIVE;
   }
+  if (pnp_fk_seed && pnp_method != PNP_ITERATIVE && n.hasParam("pnp_fk_seed"))
+    ROS_WARN("pnp_fk_seed is only used by the 'iterative' pnp_method, ignored");
+
+  PoseInitializer pose_initializer;
+  pose_initializer.setMethod(pnp_method);
+  pose_initializer.setFKSeed(pnp_fk_seed);
+  pose_initializer.setNumThreads(pnp_threads);
+  data->setPoseInitializer(pose_initializer);
+
+  // process the views in joint-space proximity order (false by default),
+  // so the FK of consecutive views changes as few joints as possible
+  bool view_ordering;
+  n.param("view_ordering", view_ordering, false);
+  data->setViewOrdering(view_ordering);
+
+  // calibration targets: PR2 checkerboards plus the ones of 'checkerboards'
+  // (same format as system.yaml), shared by all the views
+  TargetRegistry target_registry;
+  target_registry.readParam(n, "checkerboards");
+  data->setTargetRegistry(&target_registry);
+
+  // offline by default (using bag file), 'online' listens to the
+  // robot_measurement topic and refines the solution with each new view
+  bool online;
+  n.param("online", online, false);
 
-  bool offline = true; // offline by default (using bag file)
-                       // 'online' method is not yet implemented
-  if (offline)
+  ros::Subscriber subs_robot_measurement;
+  if (!online)
   {
-    // set Data class
-    data = new Data();
-    data->setRobotState(robot_state);
-    data->setMarkers(visual_markers);
-
-    // read rosbag
-    rosbag::Bag bag(rosbag_filename);
-    rosbag::View view(bag, rosbag::TopicQuery("robot_measurement"));
-    vector<calibration_msgs::RobotMeasurement::Ptr> msgs;
-    int id=0;
-    BOOST_FOREACH(rosbag::MessageInstance const m, view)
+    // read bag filename from param
+    string rosbag_filename;
+    if (!n.getParam("cal_measurements", rosbag_filename))
     {
-      calibration_msgs::RobotMeasurement::Ptr i = m.instantiate<calibration_msgs::RobotMeasurement>();
-      if (i != NULL)
-      {
-        sample_id[i->sample_id] = id;
-        data->addMeasurement(i);
-        id++;
-      }
+      ROS_ERROR("Could read parameter cal_measurements on parameter server");
+      return false;
     }
-    bag.close();
 
-    // subscriber (for debug)
-//   ros::Subscriber subs_robot_measurement = n.subscribe("robot_measurement", 1,
-//                                                        robotMeasurementCallback);
+    // read rosbag (streaming: views generated in parallel, 0: one thread
+    // per core, with at most 'ingestion_window' raw messages in memory)
+    int num_threads, window;
+    n.param("ingestion_threads", num_threads, 0);
+    n.param("ingestion_window", window, 0);
+
+    // processed views are cached next to the bag (unless dataset_cache is "")
+    string cache_filename;
+    n.param("dataset_cache", cache_filename, rosbag_filename + ".dataset");
+
+    // nothing is published while the views are loaded and optimized
+    pausePublishing(true);
+
+    DatasetCache cache(cache_filename);
+    boost::uint64_t bag_hash = DatasetCache::hashFile(rosbag_filename);
+    if (cache_filename.empty() || !cache.load(bag_hash, data, &sample_id))
+    {
+      BagReader bag_reader;
+      bag_reader.setNumThreads(num_threads);
+      bag_reader.setWindow(window > 0 ? window : 0);
+      if (!bag_reader.read(rosbag_filename, "robot_measurement", data, &sample_id))
+        return EXIT_FAILURE;
+
+      if (!cache_filename.empty())
+        cache.write(bag_hash, *data);
+    }
 
     // show views (for debug)
 //     size_t size = data->size();
@@ -142,22 +350,30 @@ int main(int argc, char **argv)
 //     data->showView(3);
 //     ros::spinOnce();
 
-    // Choose cameras to be calibrated
-    std::vector<std::string> camera_frames;
-    camera_frames.clear();
-    camera_frames.push_back("narrow_stereo_l_stereo_camera_optical_frame"); // [I|0]
-    camera_frames.push_back("narrow_stereo_r_stereo_camera_optical_frame");
-    camera_frames.push_back("wide_stereo_l_stereo_camera_optical_frame");
-    camera_frames.push_back("wide_stereo_r_stereo_camera_optical_frame");
-    camera_frames.push_back("head_mount_kinect_rgb_optical_frame");
-    camera_frames.push_back("high_def_optical_frame");
-
-    // Optimization
-    optimazer.setRobotState(robot_state);
-    optimazer.setMarkers(visual_markers);
-    optimazer.setData(data);
-    optimazer.setCamerasCalib(camera_frames);
     optimazer.run();
+    if (!profile_report.empty())
+      optimazer.getProfiler().write(profile_report);
+    exportJointOffsets();
+
+    pausePublishing(false);
+    flushPublishing();
+    if (headless)
+      return EXIT_SUCCESS;
+  }
+  else
+  {
+    // each new measurement is added to the current problem (warm start) by
+    // the solver thread, the callbacks keep running during the solve
+    optimazer.setDataMutex(&data_mutex);
+    subs_robot_measurement = n.subscribe("robot_measurement", 10,
+                                         onlineMeasurementCallback);
+    boost::thread solver_thread(onlineSolverThread);
+
+    spinLocked();
+
+    pending_cond.notify_one();
+    solver_thread.join();
+    return 0;
   }
 
   // save urdf to file
@@ -55,7 +55,8 @@ cv::Scalar chooseRandomColor() { return colors[rand() % NUM_COLORS]; }
 cv::Scalar chooseColor(int i)  { return colors[i % NUM_COLORS]; }
 
 
-Markers::Markers() : current_id_(0)
+Markers::Markers() :
+  current_id_(0), dirty_(false), headless_(false), publish_count_(0)
 {
   publisher_ = nh_.advertise<visualization_msgs::MarkerArray>( "visualization_marker_array", 0 );
 
@@ -65,7 +66,7 @@ Markers::Markers() : current_id_(0)
 
   // trigger to publish fixed joints
   publish_interval_ = ros::Duration(1.0/max(publish_freq,1.0));
-  timer_ = nh_.createTimer(publish_interval_, &Markers::puslish, this);
+  timer_ = nh_.createTimer(publish_interval_, &Markers::publishChanges, this);
 }
 
 Markers::~Markers()
@@ -76,14 +77,18 @@ void Markers::reset()
 {
   // Working around RViz bug, it doesn't delete some points of previous markers
   // if the number of checherboards are less
-  for (int i = 0; i < marker_array_.markers.size(); i++)
+  if (!headless_ && !marker_array_.markers.empty())
   {
-    marker_array_.markers[i].header.stamp = ros::Time();
-    marker_array_.markers[i].points.clear();
+    for (int i = 0; i < marker_array_.markers.size(); i++)
+    {
+      marker_array_.markers[i].header.stamp = ros::Time();
+      marker_array_.markers[i].points.clear();
+    }
+    puslish();
   }
-  puslish();
   marker_array_.markers.clear();
   current_id_ = 0;
+  dirty_ = true;
 }
 
 void Markers::resetTime()
@@ -92,7 +97,7 @@ void Markers::resetTime()
   {
     marker_array_.markers[i].header.stamp = ros::Time();
   }
-  puslish();
+  dirty_ = true;
 }
 
 void Markers::puslish()
@@ -104,6 +109,29 @@ void Markers::puslish()
 void Markers::puslish(const ros::TimerEvent &e)
 {
   publisher_.publish(marker_array_);
+  publish_count_++;
+  dirty_ = false;
+}
+
+void Markers::publishChanges(const ros::TimerEvent &e)
+{
+  if (dirty_)
+    puslish(e);
+}
+
+void Markers::flush()
+{
+  if (dirty_)
+    puslish();
+}
+
+void Markers::setHeadless(bool headless)
+{
+  headless_ = headless;
+  if (headless_)
+    timer_.stop();
+  else
+    timer_.start();
 }
 
 void Markers::addMarkers(const cv::Mat &board_measured_pts_3D,
@@ -118,6 +146,7 @@ void Markers::addMarkers(const cv::Mat &board_measured_pts_3D,
   points2markers(board_measured_pts_3D, &marker);
 
   marker_array_.markers.push_back(marker);
+  dirty_ = true;
 }
 
 void Markers::setMarkers(const int id,        // needed for MarkerArray
@@ -0,0 +1,115 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include "observation_store.h"
+#include "view.h"
+
+#include <ros/ros.h>
+
+using namespace std;
+
+namespace calib
+{
+
+ObservationStore::ObservationStore()
+{
+  view_begin_.push_back(0);
+}
+
+ObservationStore::~ObservationStore()
+{
+}
+
+void ObservationStore::clear(const vector<string> &cameras)
+{
+  view_.clear();
+  camera_.clear();
+  corner_.clear();
+  u_.clear();
+  v_.clear();
+
+  view_begin_.clear();
+  view_begin_.push_back(0);
+
+  cameras_ = cameras;
+  intrinsics_.assign(4 * cameras_.size(), 0.0);
+  has_intrinsics_.assign(cameras_.size(), 0);
+}
+
+void ObservationStore::addView(const View &view)
+{
+  int v = numViews();
+
+  for (size_t c = 0; c < cameras_.size(); c++)
+  {
+    int cam_idx = view.getCamIdx(view.getFrameId(cameras_[c]));
+    if (cam_idx < 0)
+      continue; // not visible
+
+    // intrinsics (the camera info is the same in all the views)
+    cv::Matx33d K = view.cam_model_[cam_idx].intrinsicMatrix();
+    double *k = &intrinsics_[4*c];
+    if (!has_intrinsics_[c])
+    {
+      k[0] = K(0,0);
+      k[1] = K(1,1);
+      k[2] = K(0,2);
+      k[3] = K(1,2);
+      has_intrinsics_[c] = 1;
+    }
+    else if (k[0] != K(0,0) || k[1] != K(1,1) || k[2] != K(0,2) || k[3] != K(1,2))
+    {
+      ROS_WARN("View %d: intrinsics of %s differ from the first view, using the first ones",
+               v, cameras_[c].c_str());
+    }
+
+    // measurements
+    const vector<cv::Point2d> &pts = view.measured_pts_2D_[cam_idx];
+    for (size_t j = 0; j < pts.size(); j++)
+    {
+      view_.push_back(v);
+      camera_.push_back(c);
+      corner_.push_back(j);
+      u_.push_back(pts[j].x);
+      v_.push_back(pts[j].y);
+    }
+  }
+
+  view_begin_.push_back(view_.size());
+}
+
+}
@@ -38,11 +38,15 @@
 #include "robot_state.h"
 #include "markers.h"
 #include "conversion.h"
+#include "triangulation.h"
 
 #include "auxiliar.h"
 
 #include <ros/ros.h>
 #include <opencv2/calib3d/calib3d.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <map>
 
 using namespace std;
 using namespace cv;
@@ -50,12 +54,65 @@ using namespace cv;
 namespace calib
 {
 
+// "auto" linear solver thresholds (number of parameters, residual blocks)
+static const size_t DENSE_SCHUR_MAX_SIZE     = 140;     // reduced camera system (20 cameras)
+static const size_t EXPLICIT_SCHUR_MAX_SIZE  = 300000;  // eliminated (e.g. 100000 points)
+static const size_t EXPLICIT_SCHUR_MAX_RES   = 200000;  // residual blocks
+
+/// \brief Lock of the data mutex (if any) for a scope, see setDataMutex()
+class DataLock
+{
+public:
+  explicit DataLock(boost::mutex *mutex) : mutex_(mutex) { if (mutex_) mutex_->lock(); }
+  ~DataLock() { if (mutex_) mutex_->unlock(); }
+
+private:
+  boost::mutex *mutex_;
+};
+
+/// \brief Release of a locked data mutex for a scope (the ceres solve)
+class DataUnlock
+{
+public:
+  explicit DataUnlock(boost::mutex *mutex) : mutex_(mutex) { if (mutex_) mutex_->unlock(); }
+  ~DataUnlock() { if (mutex_) mutex_->lock(); }
+
+private:
+  boost::mutex *mutex_;
+};
+
+SolverOptions::SolverOptions()
+  : linear_solver("auto"),
+    num_threads(0),
+    max_num_iterations(1000),
+    function_tolerance(1e-32),
+    minimizer_progress_to_stdout(true)
+{
+}
+
+void SolverOptions::readParam(const ros::NodeHandle &n)
+{
+  n.param("solver/linear_solver",      linear_solver,      linear_solver);
+  n.param("solver/num_threads",        num_threads,        num_threads);
+  n.param("solver/max_num_iterations", max_num_iterations, max_num_iterations);
+  n.param("solver/function_tolerance", function_tolerance, function_tolerance);
+  n.param("solver/minimizer_progress_to_stdout",
+          minimizer_progress_to_stdout, minimizer_progress_to_stdout);
+}
+
 Optimization::Optimization()
 {
   robot_state_ = 0;
   markers_ = 0;
   data_ = 0;
   cameras_.clear();
+  analytic_jacobian_ = true;
+  board_pose_ = false;
+  fused_residuals_ = true;
+  num_views_added_ = 0;
+  data_mutex_ = 0;
+  param_target_rot_ = 0;
+  param_target_trans_ = 0;
 }
 
 Optimization::~Optimization()
@@ -82,12 +139,48 @@ void Optimization::setData(Data *data)
 void Optimization::setCamerasCalib(const std::vector<std::string> &cameras)
 {
   cameras_ = cameras;
-  View::cameras_ = cameras;
+  if (data_ != 0)
+    data_->context().setCameras(cameras);
+}
+
+void Optimization::setAnalyticJacobian(bool analytic_jacobian)
+{
+  analytic_jacobian_ = analytic_jacobian;
+}
+
+void Optimization::setBoardPose(bool board_pose)
+{
+  board_pose_ = board_pose;
+}
+
+void Optimization::setFusedResiduals(bool fused_residuals)
+{
+  fused_residuals_ = fused_residuals;
+}
+
+void Optimization::setJointOffsets(const std::vector<std::string> &joints,
+                                   const std::string &target_frame)
+{
+  joint_offsets_ = joints;
+  target_frame_  = target_frame;
+}
+
+void Optimization::getJointOffsets(std::vector<double> *offsets) const
+{
+  // none if the full-chain calibration was disabled (see initialization())
+  offsets->resize(param_target_rot_ != 0 ? param_joint_offset_.size() : 0);
+  for (size_t j = 0; j < offsets->size(); j++)
+    (*offsets)[j] = *param_joint_offset_[j];
+}
+
+void Optimization::setSolverOptions(const SolverOptions &solver_options)
+{
+  solver_options_ = solver_options;
 }
 
 bool Optimization::valid()
 {
-  return robot_state_ != 0 && markers_ != 0 && data_ != 0;
+  return robot_state_ != 0 && data_ != 0;
 }
 
 void Optimization::run()
@@ -99,16 +192,105 @@ void Optimization::run()
     return;
   }
 
-  initialization();
-  addResiduals();
-  solver();
-  updateParam();
+  DataLock lock(data_mutex_);
+
+  // new problem (the previous one refers to the blocks being reused)
+  problem_.reset(new ceres::Problem());
+  profiler_.clear();
+
+  {
+    ScopedPhase phase(&profiler_, "initialization", problem_.get());
+    initialization();
+  }
+  {
+    ScopedPhase phase(&profiler_, "triangulation", problem_.get());
+    triangulation();
+  }
+  {
+    ScopedPhase phase(&profiler_, "addResiduals", problem_.get());
+    addResiduals();
+  }
+  num_views_added_ = data_->size();
+
+  {
+    ScopedPhase phase(&profiler_, "solver", problem_.get());
+    solver();
+  }
+  {
+    ScopedPhase phase(&profiler_, "updateParam", problem_.get());
+    updateParam();
+  }
+  profiler_.print();
+}
+
+void Optimization::runIncremental()
+{
+  // check if the state is valid
+  if( !valid() )
+  {
+    ROS_ERROR("The optimazer data is not complete");
+    return;
+  }
+
+  DataLock lock(data_mutex_);
+
+  size_t first_view = 0;  // views to update
+  if (!problem_)
+  {
+    // first call: same as run()
+    problem_.reset(new ceres::Problem());
+    profiler_.clear();
+
+    {
+      ScopedPhase phase(&profiler_, "initialization", problem_.get());
+      initialization();
+    }
+    {
+      ScopedPhase phase(&profiler_, "triangulation", problem_.get());
+      triangulation();
+    }
+    {
+      ScopedPhase phase(&profiler_, "addResiduals", problem_.get());
+      addResiduals();
+    }
+  }
+  else
+  {
+    // only the new views (as new residual blocks), the cameras keep the
+    // current values, so the solver starts from the previous solution
+    ScopedPhase phase(&profiler_, "addViews", problem_.get());
+
+    vector<Matx34d> Ps;
+    projectionMatrices(&Ps);
+
+    first_view = num_views_added_;
+    for (size_t v = num_views_added_; v < data_->size(); v++)
+    {
+      data_->observations_.addView(data_->view_[v]);
+      triangulation(v, Ps);
+      addResiduals(v);
+    }
+  }
+  num_views_added_ = data_->size();
+
+  if (problem_->NumResidualBlocks() == 0)
+    return;
+
+  {
+    ScopedPhase phase(&profiler_, "solver", problem_.get());
+    solver();
+  }
+  {
+    ScopedPhase phase(&profiler_, "updateParam", problem_.get());
+    updateParam(first_view);
+  }
 }
 
 void Optimization::initialization()
 {
-  param_camera_rot_.clear();
-  param_camera_trans_.clear();
+  // reuse the arena memory
+  parameters_.clear();
+  parameters_.setNumCameras(cameras_.size());
 
   KDL::Frame T0, current_position;
 //   robot_state_->reset(); // not needed, rigid relationship between the cameras
@@ -126,108 +308,672 @@ void Optimization::initialization()
     current_position = Ti.Inverse() * T0;
 
     // generate cameras in doubles
-    double *camera_rot = new double[4];
-    serialize(current_position.M, camera_rot);
-    param_camera_rot_.push_back(camera_rot);
+    serialize(current_position.M, parameters_.cameraRotation(c));
+    serialize(current_position.p, parameters_.cameraTranslation(c));
+  }
+
+  parameters_.getCameraBlocks(&param_camera_rot_, &param_camera_trans_);
+
+  // cameras and their parameters for the views (calc_error())
+  CalibrationContext &context = data_->context();
+  context.setCameras(cameras_);
+  context.camera_rot   = param_camera_rot_;
+  context.camera_trans = param_camera_trans_;
+
+  // observation table for the calibrated cameras
+  data_->buildObservations(cameras_);
+
+  // full-chain calibration: joint offsets (from the current RobotState ones)
+  // and the board pose in the target frame
+  param_joint_offset_.clear();
+  param_target_rot_ = param_target_trans_ = 0;
+  joint_offset_idx_.assign(robot_state_->getNrOfJoints(), -1);
+  if (joint_offsets_.empty())
+    return;
+
+  parameters_.setNumJointOffsets(joint_offsets_.size());
+  for (size_t j = 0; j < joint_offsets_.size(); j++)
+  {
+    param_joint_offset_.push_back(parameters_.jointOffset(j));
 
-    double *camera_trans = new double[3];
-    serialize(current_position.p, camera_trans);
-    param_camera_trans_.push_back(camera_trans);
+    int joint_idx = robot_state_->getJointIndex(joint_offsets_[j]);
+    if (joint_idx < 0)
+      ROS_ERROR("Joint '%s' could not been found, no offset", joint_offsets_[j].c_str());
+    else
+    {
+      joint_offset_idx_[joint_idx] = j;
+      *param_joint_offset_[j] = robot_state_->getJointOffset(joint_idx);
+    }
   }
 
-  View::camera_rot_ = param_camera_rot_;
-  View::camera_trans_ = param_camera_trans_;
+  if (robot_state_->getLinkIndex(target_frame_) < 0 || !initTargetPose())
+  {
+    ROS_ERROR("No board pose for the target frame '%s', joint offsets disabled",
+              target_frame_.c_str());
+    param_target_rot_ = param_target_trans_ = 0;
+  }
+}
+
+bool Optimization::initTargetPose()
+{
+  int camera0_id = data_->context().camera_ids[0];
+  for (size_t v = 0; v < data_->size(); v++)
+  {
+    View &view = data_->view_[v];
+    int cam_idx = view.getCamIdx(camera0_id);
+    if (cam_idx < 0 || view.rvec_[cam_idx].empty())
+      continue;
 
-  // create 3D points by triangulation (saved insie View: view.triang_pts_3D_)
-  triangulation();
+    // board in camera 0 (solvePnP)
+    Matx33d R;
+    Rodrigues(view.rvec_[cam_idx], R);
+    const Mat &tvec = view.tvec_[cam_idx];
+    KDL::Frame T_board(KDL::Rotation(R(0,0), R(0,1), R(0,2),
+                                     R(1,0), R(1,1), R(1,2),
+                                     R(2,0), R(2,1), R(2,2)),
+                       KDL::Vector(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2)));
+
+    // board in the target frame: FK(target)^-1 * FK(camera 0) * T_board
+    KDL::Frame T_camera0, T_target;
+    view.updateRobot(robot_state_);
+    robot_state_->getFK(cameras_[0], &T_camera0);
+    robot_state_->getFK(target_frame_, &T_target);
+    KDL::Frame T = T_target.Inverse() * T_camera0 * T_board;
+
+    size_t board_idx = parameters_.addBoardPose();
+    param_target_rot_   = parameters_.boardRotation(board_idx);
+    param_target_trans_ = parameters_.boardTranslation(board_idx);
+    serialize(T.M, param_target_rot_);
+    serialize(T.p, param_target_trans_);
+    return true;
+  }
+
+  return false;
 }
 
 void Optimization::triangulation()
 {
+  vector<Matx34d> Ps;
+  projectionMatrices(&Ps);
+
   for (size_t v = 0; v < data_->size(); v++)
+    triangulation(v, Ps);
+}
+
+void Optimization::projectionMatrices(vector<Matx34d> *Ps)
+{
+  const ObservationStore &obs = data_->observations_;
+
+  Ps->resize(cameras_.size());
+  for (size_t i = 0; i < cameras_.size(); i++)
   {
-    // try with a subset
-//     std::vector<std::string> camera_frames;
-//     camera_frames.push_back("narrow_stereo_l_stereo_camera_optical_frame"); // [I|0]
-//     camera_frames.push_back("narrow_stereo_r_stereo_camera_optical_frame");
-//     camera_frames.push_back("wide_stereo_l_stereo_camera_optical_frame");
-//     camera_frames.push_back("wide_stereo_r_stereo_camera_optical_frame");
-//     camera_frames.push_back("head_mount_kinect_rgb_optical_frame");
-// //     camera_frames.push_back("high_def_optical_frame");
-    data_->view_[v].triangulation(cameras_, // camera_frames,
-                                  param_camera_rot_,
-                                  param_camera_trans_);
+    Matx33d R;
+    Vec3d t;
+    deserialize(param_camera_rot_[i], &R);
+    deserialize(param_camera_trans_[i], &t);
+
+    const double *k = obs.intrinsics(i);
+    Matx33d K(k[0],   0,  k[2],
+                0,  k[1], k[3],
+                0,    0,    1);
+
+    hconcat(K*R, K*t, (*Ps)[i]);
+  }
+}
+
+void Optimization::triangulation(size_t v, const vector<Matx34d> &Ps)
+{
+  const ObservationStore &obs = data_->observations_;
+  View &current_view = data_->view_[v];
+
+  current_view.triang_pts_3D_.clear();
+  size_t npoints = current_view.target_->corners.size();
+
+  // rows of the view, grouped by camera (nviews x npoints x 2)
+  size_t begin = obs.viewBegin(v);
+  size_t end   = obs.viewEnd(v);
+
+  vector<double> x, P;
+  x.reserve(2 * (end - begin));
+  int nviews = 0;
+  for (size_t k = begin; k < end; )
+  {
+    int i = obs.camera(k);
+    size_t k_end = k;
+    while (k_end < end && obs.camera(k_end) == i)
+      k_end++;
+
+    // only cameras seeing the whole board
+    if (k_end - k == npoints)
+    {
+      for (size_t kk = k; kk < k_end; kk++)
+      {
+        x.push_back(obs.u(kk));
+        x.push_back(obs.v(kk));
+      }
+      P.insert(P.end(), Ps[i].val, Ps[i].val + 12);
+      nviews++;
+    }
+    k = k_end;
   }
+
+  if (nviews == 0 || npoints == 0)
+    return;
+
+  //! triangulate all the board corners at once
+  current_view.triang_pts_3D_.resize(npoints);
+  nViewTriangulate(&x[0], &P[0], nviews, npoints, &current_view.triang_pts_3D_[0].x);
+}
+
+double Optimization::reprojectionError(vector<double> *camera_rms)
+{
+  const ObservationStore &obs = data_->observations_;
+
+  size_t num_cameras = cameras_.size();
+  vector<double> sum(num_cameras, 0.0);
+  vector<size_t> count(num_cameras, 0);
+
+  for (size_t k = 0; k < obs.size(); k++)
+  {
+    // only the views in the problem
+    size_t v = obs.view(k);
+    if (v >= param_point_3D_.size())
+      continue;
+
+    int i = obs.camera(k);
+    const double *K = obs.intrinsics(i);
+
+    double residuals[2];
+    if (param_board_rot_[v] != 0)
+    {
+      const Point3d &model = data_->view_[v].target_->corners[obs.corner(k)];
+      const double corner[3] = { model.x, model.y, model.z };
+      BoardPoseReprojectionError error(obs.u(k), obs.v(k), K[0], K[1], K[2], K[3], corner);
+      error(param_camera_rot_[i], param_camera_trans_[i],
+            param_board_rot_[v], param_board_trans_[v], residuals);
+    }
+    else if (!param_point_3D_[v].empty())
+    {
+      calc_residuals(obs.u(k), obs.v(k), K[0], K[1], K[2], K[3],
+                     param_camera_rot_[i], param_camera_trans_[i],
+                     param_point_3D_[v][obs.corner(k)],
+                     residuals);
+    }
+    else
+      continue;
+
+    sum[i] += residuals[0]*residuals[0] + residuals[1]*residuals[1];
+    count[i]++;
+  }
+
+  // full-chain blocks (all the corners of a camera-view)
+  vector<double> residuals;
+  for (size_t b = 0; b < chain_blocks_.size(); b++)
+  {
+    const ChainBlock &block = chain_blocks_[b];
+    residuals.resize(block.error.observed.size());
+    block.error(&block.parameters[0], &residuals[0]);
+
+    for (size_t r = 0; r < residuals.size(); r++)
+      sum[block.camera] += residuals[r]*residuals[r];
+    count[block.camera] += residuals.size() / 2;
+  }
+
+  double total_sum = 0;
+  size_t total_count = 0;
+  if (camera_rms != 0)
+    camera_rms->assign(num_cameras, 0.0);
+  for (size_t i = 0; i < num_cameras; i++)
+  {
+    total_sum += sum[i];
+    total_count += count[i];
+    if (camera_rms != 0 && count[i] > 0)
+      (*camera_rms)[i] = sqrt(sum[i] / count[i]);
+  }
+
+  return total_count > 0 ? sqrt(total_sum / total_count) : 0.0;
 }
 
 void Optimization::addResiduals()
 {
-  // v: view index
-  // i: camera index
-  // j: points
+  param_point_3D_.clear();
+  param_point_3D_.resize(data_->size());
+  param_board_rot_.assign(data_->size(), 0);
+  param_board_trans_.assign(data_->size(), 0);
+  chain_blocks_.clear();
+
   for (size_t v = 0; v < data_->size(); v++)
+    addResiduals(v);
+}
+
+/// \brief Rotation matrix as a row-major array (KinematicChain)
+static void rowMajor(const KDL::Rotation &M, double out[9])
+{
+  for (int r = 0; r < 3; r++)
+    for (int c = 0; c < 3; c++)
+      out[3*r+c] = M(r, c);
+}
+
+void Optimization::buildChain(const RobotState &robot_state, int link_idx,
+                              const vector<double> &positions,
+                              const vector<int> &offset_idx,
+                              KinematicChain *chain)
+{
+  // links from the tip to the root
+  vector<int> path;
+  for (int idx = link_idx; idx >= 0; idx = robot_state.getParentIndex(idx))
+    path.push_back(idx);
+
+  // fixed segments are folded into the transform before the next joint
+  chain->joints.clear();
+  KDL::Frame A = KDL::Frame::Identity();
+  for (int k = int(path.size()) - 1; k >= 0; k--)
   {
-    View &current_view = data_->view_[v];
+    const KDL::Segment &segment = robot_state.getSegment(path[k]);
+    KDL::Frame F = segment.pose(0.0);
+    A = A * F;
 
-    vector<double *> param_point_3D;
+    int joint_idx = robot_state.getLinkJointIndex(path[k]);
+    KDL::Joint::JointType type = segment.getJoint().getType();
+    if (joint_idx < 0 || type == KDL::Joint::None)
+      continue;
 
-    for (size_t i = 0; i < cameras_.size(); i++)
-    {
-      string cam_frame = cameras_[i];
+    // pose(q) = pose(0) * J(axis, q), with the axis in the pose(0) frame
+    ChainJoint joint;
+    rowMajor(A.M, joint.rotation);
+    serialize(A.p, joint.translation);
+    KDL::Vector axis = F.M.Inverse() * segment.getJoint().JointAxis();
+    serialize(axis, joint.axis);
+    joint.prismatic = (type == KDL::Joint::TransAxis);  // kdl_parser: RotAxis or TransAxis
+    joint.offset   = offset_idx[joint_idx];
+    joint.position = positions[joint_idx];
+    if (joint.offset < 0)
+      joint.position += robot_state.getJointOffset(joint_idx);
+    chain->joints.push_back(joint);
 
-      if (i == 0)
-      {
-        // First camera is the reference, most be in the view
-        if (!current_view.isVisible(cam_frame))
-          break;
+    A = KDL::Frame::Identity();
+  }
 
-        // serialize 3D points (board points in frame 0)
-        int cam_idx = current_view.getCamIdx(cameras_[i]);
+  rowMajor(A.M, chain->tip_rotation);
+  serialize(A.p, chain->tip_translation);
+}
 
-        //! 3D points
-        Mat board_pts_frame0 = current_view.board_transformed_pts_3D_[cam_idx];
-//         Mat board_pts_frame0(current_view.triang_pts_3D_);
+void Optimization::addChainResiduals(size_t v)
+{
+  const ObservationStore &obs = data_->observations_;
+  size_t begin = obs.viewBegin(v);
+  size_t end   = obs.viewEnd(v);
+  if (begin == end || param_target_rot_ == 0)
+    return;
 
-        serialize(board_pts_frame0, &param_point_3D);
-      }
-      else
+  View &current_view = data_->view_[v];
+
+  // measured joint positions of the view (joints out of the message are zero)
+  vector<double> positions(robot_state_->getNrOfJoints(), 0.0);
+  const Msg &msg = current_view.msg_;
+  for (size_t c = 0; c < msg->M_chain.size(); c++)
+  {
+    const sensor_msgs::JointState &chain_state = msg->M_chain[c].chain_state;
+    for (size_t j = 0; j < chain_state.name.size() && j < chain_state.position.size(); j++)
+    {
+      int joint_idx = robot_state_->getJointIndex(chain_state.name[j]);
+      if (joint_idx >= 0)
+        positions[joint_idx] = chain_state.position[j];
+    }
+  }
+
+  KinematicChain camera_chain, target_chain;
+  buildChain(*robot_state_, robot_state_->getLinkIndex(cameras_[0]), positions,
+             joint_offset_idx_, &camera_chain);
+  buildChain(*robot_state_, robot_state_->getLinkIndex(target_frame_), positions,
+             joint_offset_idx_, &target_chain);
+
+  // offset blocks used by the view (joint.offset: global -> local index)
+  vector<double *> offsets;
+  map<int, int> local;
+  KinematicChain *chains[2] = { &camera_chain, &target_chain };
+  for (int c = 0; c < 2; c++)
+  {
+    for (size_t j = 0; j < chains[c]->joints.size(); j++)
+    {
+      int &offset = chains[c]->joints[j].offset;
+      if (offset < 0)
+        continue;
+
+      map<int, int>::iterator it = local.find(offset);
+      if (it == local.end())
       {
-        if (!current_view.isVisible(cam_frame))
-          continue;
+        it = local.insert(make_pair(offset, int(offsets.size()))).first;
+        offsets.push_back(param_joint_offset_[offset]);
       }
+      offset = it->second;
+    }
+  }
+
+  // one block per camera (rows [k, k_end)), all the corners it sees
+  const vector<Point3d> &model = current_view.target_->corners;
+  vector<double> observed, corners;
+  for (size_t k = begin; k < end; )
+  {
+    int i = obs.camera(k);
+    size_t k_end = k;
+    while (k_end < end && obs.camera(k_end) == i)
+      k_end++;
+
+    observed.clear();
+    corners.resize(3 * (k_end - k));
+    for (size_t kk = k; kk < k_end; kk++)
+    {
+      observed.push_back(obs.u(kk));
+      observed.push_back(obs.v(kk));
+      serialize(model[obs.corner(kk)], &corners[3*(kk - k)]);
+    }
+
+    const double *K = obs.intrinsics(i); // fx, fy, cx, cy
+    ChainReprojectionError error(observed, corners, K[0], K[1], K[2], K[3],
+                                 camera_chain, target_chain);
+
+    vector<double *> parameters;
+    parameters.push_back(param_camera_rot_[i]);    // camera_rot i
+    parameters.push_back(param_camera_trans_[i]);  // camera_trans i
+    parameters.push_back(param_target_rot_);       // board pose (target frame)
+    parameters.push_back(param_target_trans_);
+    parameters.insert(parameters.end(), offsets.begin(), offsets.end());
+
+    problem_->AddResidualBlock(ChainReprojectionError::Create(error, offsets.size()),
+                               NULL,                // squared loss
+                               parameters);
+    chain_blocks_.push_back(ChainBlock(i, error, parameters));
+
+    k = k_end;
+  }
+
+  // first camera is constanst: [I|0]
+  if (obs.camera(begin) == 0)
+  {
+    problem_->SetParameterBlockConstant(param_camera_rot_[0]);
+    problem_->SetParameterBlockConstant(param_camera_trans_[0]);
+  }
+}
+
+void Optimization::addResiduals(size_t v)
+{
+  const ObservationStore &obs = data_->observations_;
+  if (param_point_3D_.size() <= v)
+  {
+    param_point_3D_.resize(v + 1);
+    param_board_rot_.resize(v + 1, 0);
+    param_board_trans_.resize(v + 1, 0);
+  }
+
+  // full-chain calibration (the reference camera is not needed)
+  if (param_target_rot_ != 0)
+  {
+    addChainResiduals(v);
+    return;
+  }
+
+  // rows of the view, sorted by camera: the first camera is the reference,
+  // it must be in the view
+  size_t begin = obs.viewBegin(v);
+  size_t end   = obs.viewEnd(v);
+  if (begin == end || obs.camera(begin) != 0)
+    return;
+
+  View &current_view = data_->view_[v];
+  int cam_idx = current_view.getCamIdx(data_->context().camera_ids[0]);
+
+  if (board_pose_)
+  {
+    // board pose in frame 0 (solvePnP of the reference camera)
+    size_t board_idx = parameters_.addBoardPose();
+    double *board_rot   = param_board_rot_[v]   = parameters_.boardRotation(board_idx);
+    double *board_trans = param_board_trans_[v] = parameters_.boardTranslation(board_idx);
+
+    Matx33d R;
+    Rodrigues(current_view.rvec_[cam_idx], R);
+    serialize(KDL::Rotation(R(0,0), R(0,1), R(0,2),
+                            R(1,0), R(1,1), R(1,2),
+                            R(2,0), R(2,1), R(2,2)), board_rot);
+
+    const Mat &tvec = current_view.tvec_[cam_idx];
+    serialize(KDL::Vector(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2)), board_trans);
+
+    // board model (x, y, z of each corner) and size
+    const Target &target = *current_view.target_;
+    const vector<Point3d> &model = target.corners;
+    vector<double> corners(3 * model.size());
+    for (size_t j = 0; j < model.size(); j++)
+      serialize(model[j], &corners[3*j]);
+
+    // feed optimazer with data, by camera (rows [k, k_end))
+    // k: observation, i: camera index, j: corner
+    vector<double> observed;
+    for (size_t k = begin; k < end; )
+    {
+      int i = obs.camera(k);
+      size_t k_end = k;
+      while (k_end < end && obs.camera(k_end) == i)
+        k_end++;
 
-      // get measured_pts_2D and intrinsicMatrix
-      int cam_idx = current_view.getCamIdx(cam_frame);
-      vector<Point2d> &measured_pts_2D = current_view.measured_pts_2D_[cam_idx];
-      Matx33d intrinsicMatrix = current_view.cam_model_[cam_idx].intrinsicMatrix();
+      const double *K = obs.intrinsics(i); // fx, fy, cx, cy
 
+      // one block for all the corners (whole board seen by the camera)
+      ceres::CostFunction *cost_function = NULL;
+      if (fused_residuals_ && k_end - k == model.size())
+      {
+        observed.resize(2 * model.size());
+        for (size_t kk = k; kk < k_end; kk++)
+        {
+          observed[2*obs.corner(kk)]   = obs.u(kk);
+          observed[2*obs.corner(kk)+1] = obs.v(kk);
+        }
+
+        cost_function =
+          createBoardViewReprojectionError(target.width, target.height, &observed[0],
+                                           K[0], K[1], K[2], K[3], &corners[0]);
+      }
 
-      // feed optimazer with data
-      for (int j = 0; j < measured_pts_2D.size(); j++)
+      if (cost_function != NULL)
       {
-        ceres::CostFunction *cost_function =
-          ReprojectionErrorWithQuaternions::Create(measured_pts_2D[j].x,
-                                                    measured_pts_2D[j].y,
-                                                    intrinsicMatrix(0,0),
-                                                    intrinsicMatrix(1,1),
-                                                    intrinsicMatrix(0,2),
-                                                    intrinsicMatrix(1,2));
-
-        problem_.AddResidualBlock(cost_function,
-                                  NULL,                      // squared loss
-                                  param_camera_rot_[i],      // camera_rot i
-                                  param_camera_trans_[i],    // camera_trans i
-                                  param_point_3D[j]);        // point j (constant?)
+        problem_->AddResidualBlock(cost_function,
+                                   NULL,                      // squared loss
+                                   param_camera_rot_[i],      // camera_rot i
+                                   param_camera_trans_[i],    // camera_trans i
+                                   board_rot,                 // board pose (view v)
+                                   board_trans);
+        k = k_end;
+        continue;
       }
 
-      // first camera is constanst: [I|0]
-      if (i == 0)
+      // one block per corner
+      for (; k < k_end; k++)
       {
-        problem_.SetParameterBlockConstant(param_camera_rot_[0]);
-        problem_.SetParameterBlockConstant(param_camera_trans_[0]);
+        int j = obs.corner(k);
+        cost_function =
+          BoardPoseReprojectionError::Create(obs.u(k), obs.v(k),
+                                             K[0], K[1], K[2], K[3], &corners[3*j]);
+
+        problem_->AddResidualBlock(cost_function,
+                                   NULL,                      // squared loss
+                                   param_camera_rot_[i],      // camera_rot i
+                                   param_camera_trans_[i],    // camera_trans i
+                                   board_rot,                 // board pose (view v)
+                                   board_trans);
       }
     }
   }
+  else
+  {
+    // serialize 3D points (board points in frame 0)
+    //! 3D points
+    Mat board_pts_frame0 = current_view.board_transformed_pts_3D_[cam_idx];
+//     Mat board_pts_frame0(current_view.triang_pts_3D_);
+
+    vector<double *> &param_point_3D = param_point_3D_[v];
+    size_t view_idx = parameters_.addView(board_pts_frame0);
+    parameters_.getPointBlocks(view_idx, &param_point_3D);
+
+    // feed optimazer with data
+    // k: observation, i: camera index, j: point
+    for (size_t k = begin; k < end; k++)
+    {
+      int i = obs.camera(k);
+      int j = obs.corner(k);
+      const double *K = obs.intrinsics(i); // fx, fy, cx, cy
+
+      ceres::CostFunction *cost_function;
+      if (analytic_jacobian_)
+        cost_function =
+          ReprojectionErrorAnalytic::Create(obs.u(k), obs.v(k),
+                                            K[0], K[1], K[2], K[3]);
+      else
+        cost_function =
+          ReprojectionErrorWithQuaternions::Create(obs.u(k), obs.v(k),
+                                                   K[0], K[1], K[2], K[3]);
+
+      problem_->AddResidualBlock(cost_function,
+                                 NULL,                      // squared loss
+                                 param_camera_rot_[i],      // camera_rot i
+                                 param_camera_trans_[i],    // camera_trans i
+                                 param_point_3D[j]);        // point j (constant?)
+    }
+  }
+
+  // first camera is constanst: [I|0]
+  problem_->SetParameterBlockConstant(param_camera_rot_[0]);
+  problem_->SetParameterBlockConstant(param_camera_trans_[0]);
+}
+
+void Optimization::configureSolver(ceres::Solver::Options *options)
+{
+  // problem size
+  size_t num_cameras     = cameras_.size();
+  size_t num_views       = 0;
+  size_t num_board_poses = 0;
+  size_t num_points      = 0;
+  for (size_t v = 0; v < param_point_3D_.size(); v++)
+  {
+    if (param_point_3D_[v].empty() && param_board_rot_[v] == 0)
+      continue;
+    num_views++;
+    num_board_poses += param_board_rot_[v] != 0 ? 1 : 0;
+    num_points += param_point_3D_[v].size();
+  }
+
+  size_t num_residual_blocks = problem_->NumResidualBlocks();
+
+  // linear solver
+  string linear_solver = solver_options_.linear_solver;
+  if (linear_solver == "auto" && param_target_rot_ != 0)
+  {
+    // full-chain calibration: nothing to eliminate (cameras, one board pose
+    // and the joint offsets), a small dense problem
+    linear_solver = "dense_qr";
+  }
+  else if (linear_solver == "auto")
+  {
+    linear_solver = autoLinearSolver(num_cameras, num_board_poses, num_points,
+                                     num_residual_blocks);
+  }
+
+#if defined(CERES_NO_SUITESPARSE) && defined(CERES_NO_CXSPARSE)
+  // no sparse linear algebra library available
+  if (linear_solver == "sparse_schur")
+    linear_solver = "iterative_schur";
+#endif
+
+  if (linear_solver == "dense_schur")
+  {
+    options->linear_solver_type = ceres::DENSE_SCHUR;
+  }
+  else if (linear_solver == "sparse_schur")
+  {
+    options->linear_solver_type = ceres::SPARSE_SCHUR;
+  }
+  else if (linear_solver == "iterative_schur")
+  {
+    options->linear_solver_type = ceres::ITERATIVE_SCHUR;
+    options->preconditioner_type = ceres::SCHUR_JACOBI;
+  }
+  else if (linear_solver == "dense_qr")
+  {
+    options->linear_solver_type = ceres::DENSE_QR;
+  }
+  else
+  {
+    ROS_ERROR("Unknown linear solver '%s', using dense_schur", linear_solver.c_str());
+    options->linear_solver_type = ceres::DENSE_SCHUR;
+    linear_solver = "dense_schur";
+  }
+
+  // threads
+  int num_threads = solver_options_.num_threads;
+  if (num_threads <= 0)
+    num_threads = std::max(1u, boost::thread::hardware_concurrency());
+
+  options->num_threads = num_threads;
+  options->num_linear_solver_threads = num_threads;
+
+  // Schur elimination ordering: points first (group 0), then cameras (group 1)
+  // (none in full-chain calibration, there are no points nor view poses, and
+  // none for dense_qr)
+  ceres::ParameterBlockOrdering *ordering = new ceres::ParameterBlockOrdering;
+
+  vector<double *> parameter_blocks;
+  problem_->GetParameterBlocks(&parameter_blocks);
+  for (size_t k = 0; k < parameter_blocks.size(); k++)
+    ordering->AddElementToGroup(parameter_blocks[k], 1);
+
+  for (size_t v = 0; v < param_point_3D_.size(); v++)
+  {
+    for (size_t j = 0; j < param_point_3D_[v].size(); j++)
+      ordering->AddElementToGroup(param_point_3D_[v][j], 0);
+
+    // board pose (view parameterized by the board pose)
+    if (param_board_rot_[v] != 0)
+    {
+      ordering->AddElementToGroup(param_board_rot_[v], 0);
+      ordering->AddElementToGroup(param_board_trans_[v], 0);
+    }
+  }
+
+  bool schur = linear_solver.find("schur") != string::npos;
+  if (schur && ordering->NumGroups() > 1)
+    options->linear_solver_ordering = ordering;  // owned by options
+  else
+    delete ordering;
+
+  // stopping criteria and output
+  options->max_num_iterations = solver_options_.max_num_iterations;
+  options->function_tolerance = solver_options_.function_tolerance;
+  options->minimizer_progress_to_stdout = solver_options_.minimizer_progress_to_stdout;
+
+  ROS_INFO("Solver: %s, %d threads (%zu cameras, %zu views, %zu points, %zu residual blocks)%s",
+           linear_solver.c_str(), num_threads,
+           num_cameras, num_views, num_points, num_residual_blocks,
+           param_target_rot_ != 0 ? ", joint offsets" : board_pose_ ? ", board pose" : "");
+}
+
+string Optimization::autoLinearSolver(size_t num_cameras,
+                                      size_t num_board_poses,
+                                      size_t num_points,
+                                      size_t num_residual_blocks)
+{
+  size_t schur_size      = 7 * num_cameras;  // quaternion + translation
+  size_t eliminated_size = 6 * num_board_poses + 3 * num_points;
+
+  // building the reduced system explicitly is the bottleneck
+  if (num_residual_blocks > EXPLICIT_SCHUR_MAX_RES ||
+      eliminated_size > EXPLICIT_SCHUR_MAX_SIZE)
+    return "iterative_schur";
+
+  // a large reduced camera system is sparse (not every pair of cameras
+  // sees the same board)
+  if (schur_size > DENSE_SCHUR_MAX_SIZE)
+    return "sparse_schur";
+
+  return "dense_schur";
 }
 
 void Optimization::solver()
@@ -240,18 +986,28 @@ void Optimization::solver()
   }
 
   ceres::Solver::Options options;
-  options.linear_solver_type = ceres::DENSE_SCHUR;
-  options.num_threads = 8;
-  options.max_num_iterations = 1000;
-  options.function_tolerance = 1e-32;
-  options.minimizer_progress_to_stdout = true;
-//   options.minimizer_progress_to_stdout = false;
+  configureSolver(&options);
+  options.callbacks.push_back(profiler_.callback());
 
   ceres::Solver::Summary summary;
-  ceres::Solve(options, &problem_, &summary);
+  {
+    // only problem_ and the parameter blocks are used, new views can be
+    // added to data_ meanwhile (see setDataMutex())
+    DataUnlock unlock(data_mutex_);
+    ceres::Solve(options, problem_.get(), &summary);
+  }
   std::cout << summary.FullReport() << "\n";
   cout << "\n";
 
+  vector<double> camera_rms;
+  double rms = reprojectionError(&camera_rms);
+  ROS_INFO("Reprojection error (RMS): %f pixels", rms);
+  for (size_t i = 0; i < cameras_.size(); i++)
+    ROS_INFO("  %s: %f", cameras_[i].c_str(), camera_rms[i]);
+
+  for (size_t j = 0; j < param_joint_offset_.size() && param_target_rot_ != 0; j++)
+    ROS_INFO("Joint offset %s: %f", joint_offsets_[j].c_str(), *param_joint_offset_[j]);
+
   for (size_t i = 0; i < cameras_.size(); i++)
   {
     print_array(param_camera_rot_[i],   4, "param_camera[i]:");
@@ -259,8 +1015,17 @@ void Optimization::solver()
   }
 }
 
-void Optimization::updateParam()
+void Optimization::updateParam(size_t first_view)
 {
+  // estimated joint offsets, part of the forward kinematic from now on (the
+  // camera origins below are relative to the calibrated FK)
+  if (param_target_rot_ != 0)
+  {
+    for (size_t joint_idx = 0; joint_idx < joint_offset_idx_.size(); joint_idx++)
+      if (joint_offset_idx_[joint_idx] >= 0)
+        robot_state_->setJointOffset(joint_idx, *param_joint_offset_[joint_offset_idx_[joint_idx]]);
+  }
+
   // get camera '0' (KDL::Frame to robot)
   KDL::Frame T0;
   robot_state_->getFK(cameras_[0], &T0);
@@ -292,21 +1057,22 @@ void Optimization::updateParam()
     KDL::Frame current_position = pose_father.Inverse() * T0 * frame.Inverse();
     urdf::Pose pose;
     kdl2urdf(current_position, &pose);
-    robot_state_->setUrdfPose(cameras_[i], pose);
+    robot_state_->setJointOrigin(cameras_[i], pose);  // no tree rebuild
   }
 
-//   sleep(1);
-  robot_state_->updateTree();
+  data_->context().camera_rot   = param_camera_rot_;
+  data_->context().camera_trans = param_camera_trans_;
 
-  View::camera_rot_ = param_camera_rot_;
-  View::camera_trans_ = param_camera_trans_;
+  // views with the new camera origins (only the camera subtrees change)
+  data_->updateViews(first_view);
 
 
 //   triangulation();
 //   data_->view_[3].triangulation(cameras_, // camera_frames,
 //                                 param_camera_rot_,
 //                                 param_camera_trans_);
-  data_->showView(3);
+  if (markers_ != 0)
+    data_->showView(3);
 
 
   //   triangulation();
@@ -321,33 +1087,5 @@ void Optimization::updateParam()
 //   }
 }
 
-// void Optimization::calcError()
-// {
-//   // v: view index
-//   // i: camera index
-//   // j: points
-//   for (size_t v = 0; v < data_->size(); v++)
-//   {
-//     View &current_view = data_->view_[v];
-//
-//     vector<double *> param_point_3D;
-//
-//     for (size_t i = 0; i < cameras_.size(); i++)
-//     {
-//       string cam_frame = cameras_[i];
-//
-//       int cam_idx = current_view.getCamIdx(cam_frame);
-//       vector<Point2d> &measured_pts_2D = current_view.measured_pts_2D_[cam_idx];
-//       Matx33d intrinsicMatrix = current_view.cam_model_[cam_idx].intrinsicMatrix();
-//
-//
-//       // feed optimazer with data
-//       for (int j = 0; j < measured_pts_2D.size(); j++)
-//       {
-//     }
-//   }
-//   }
-// }
-
 }
 
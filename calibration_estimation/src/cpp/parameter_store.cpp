@@ -0,0 +1,151 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include "parameter_store.h"
+#include "conversion.h"
+
+using namespace std;
+using namespace cv;
+
+namespace calib
+{
+
+// doubles per chunk (4096 points)
+static const size_t CHUNK_SIZE = 3 * 4096;
+
+ParameterStore::ParameterStore() : chunk_idx_(0), chunk_used_(0)
+{
+}
+
+ParameterStore::~ParameterStore()
+{
+  for (size_t k = 0; k < chunks_.size(); k++)
+    delete [] chunks_[k];
+}
+
+void ParameterStore::clear()
+{
+  camera_rot_.clear();
+  camera_trans_.clear();
+  joint_offset_.clear();
+
+  view_begin_.clear();
+  view_size_.clear();
+  board_begin_.clear();
+
+  chunk_idx_  = 0;
+  chunk_used_ = 0;
+}
+
+void ParameterStore::setNumCameras(size_t num_cameras)
+{
+  camera_rot_.assign(4 * num_cameras, 0.0);
+  camera_trans_.assign(3 * num_cameras, 0.0);
+}
+
+double *ParameterStore::allocate(size_t size)
+{
+  // find a chunk with enough space (the remaining of a chunk is not used)
+  while (chunk_idx_ < chunks_.size() &&
+         chunk_used_ + size > chunk_size_[chunk_idx_])
+  {
+    chunk_idx_++;
+    chunk_used_ = 0;
+  }
+
+  // new chunk
+  if (chunk_idx_ == chunks_.size())
+  {
+    size_t current_size = max(size, CHUNK_SIZE);
+    chunks_.push_back(new double[current_size]);
+    chunk_size_.push_back(current_size);
+    chunk_used_ = 0;
+  }
+
+  double *block = chunks_[chunk_idx_] + chunk_used_;
+  chunk_used_ += size;
+
+  return block;
+}
+
+size_t ParameterStore::addView(const vector<Point3d> &points)
+{
+  double *begin = allocate(3 * points.size());
+  for (size_t j = 0; j < points.size(); j++)
+    serialize(points[j], begin + 3*j);
+
+  view_begin_.push_back(begin);
+  view_size_.push_back(points.size());
+
+  return view_begin_.size() - 1;
+}
+
+size_t ParameterStore::addBoardPose()
+{
+  double *begin = allocate(7);
+  for (size_t k = 0; k < 7; k++)
+    begin[k] = 0.0;
+  begin[0] = 1.0; // identity quaternion
+
+  board_begin_.push_back(begin);
+
+  return board_begin_.size() - 1;
+}
+
+void ParameterStore::getCameraBlocks(vector<double *> *camera_rot,
+                                     vector<double *> *camera_trans)
+{
+  camera_rot->clear();
+  camera_trans->clear();
+
+  for (size_t i = 0; i < numCameras(); i++)
+  {
+    camera_rot->push_back(cameraRotation(i));
+    camera_trans->push_back(cameraTranslation(i));
+  }
+}
+
+void ParameterStore::getPointBlocks(size_t view, vector<double *> *points)
+{
+  points->clear();
+  points->reserve(numPoints(view));
+
+  for (size_t j = 0; j < numPoints(view); j++)
+    points->push_back(point(view, j));
+}
+
+}
@@ -0,0 +1,172 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+#include "pose_initializer.h"
+
+#include <ros/ros.h>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/bind.hpp>
+
+using namespace std;
+using namespace cv;
+
+namespace calib
+{
+
+namespace
+{
+
+/// (view index, camera index)
+typedef pair<size_t, size_t> PoseTask;
+
+/// Tasks shared by the worker threads
+struct PoseTaskQueue
+{
+  vector<View>           *views;
+  const vector<PoseTask> *tasks;
+  int                     method;
+  bool                    seeded;   // start from the reference camera prediction
+
+  boost::mutex mutex;
+  size_t       next;
+};
+
+void poseWorker(PoseTaskQueue *queue)
+{
+  while (true)
+  {
+    size_t t;
+    {
+      boost::mutex::scoped_lock lock(queue->mutex);
+      if (queue->next >= queue->tasks->size())
+        return;
+      t = queue->next++;
+    }
+
+    const PoseTask &task = (*queue->tasks)[t];
+    View &view = (*queue->views)[task.first];
+
+    // each task only writes the entries of its own camera
+    Mat rvec, tvec;
+    if (queue->seeded)
+      view.predictCbPose(0, task.second, &rvec, &tvec);
+    view.findCbPose(task.second, queue->method, rvec, tvec);
+  }
+}
+
+void runTasks(vector<View> *views, const vector<PoseTask> &tasks,
+              int num_threads, int method, bool seeded)
+{
+  if (tasks.empty())
+    return;
+
+  PoseTaskQueue queue;
+  queue.views  = views;
+  queue.tasks  = &tasks;
+  queue.method = method;
+  queue.seeded = seeded;
+  queue.next   = 0;
+
+  num_threads = min<int>(num_threads, tasks.size());
+  if (num_threads <= 1)
+  {
+    poseWorker(&queue);
+    return;
+  }
+
+  boost::thread_group threads;
+  for (int t = 0; t < num_threads; t++)
+    threads.create_thread(boost::bind(&poseWorker, &queue));
+  threads.join_all();
+}
+
+}
+
+PoseInitializer::PoseInitializer() :
+  num_threads_(0), method_(PNP_ITERATIVE), fk_seed_(true)
+{
+}
+
+bool PoseInitializer::parseMethod(const string &name, PnPMethod *method)
+{
+  if (name == "iterative")
+    *method = PNP_ITERATIVE;
+  else if (name == "epnp")
+    *method = PNP_EPNP;
+  else if (name == "planar")
+    *method = PNP_PLANAR;
+  else
+    return false;
+
+  return true;
+}
+
+void PoseInitializer::run(vector<View> *views, size_t first) const
+{
+  int num_threads = num_threads_;
+  if (num_threads <= 0)
+    num_threads = max(1u, boost::thread::hardware_concurrency());
+
+  // the seed is only used by PNP_ITERATIVE, the other methods solve every
+  // camera on its own (the configured method is never replaced)
+  bool seeded = fk_seed_ && method_ == PNP_ITERATIVE;
+
+  // reference cameras first, the rest can be seeded from them
+  vector<PoseTask> reference, others;
+  for (size_t v = first; v < views->size(); v++)
+  {
+    size_t num_cameras = (*views)[v].rvec_.size();
+    for (size_t i = 0; i < num_cameras; i++)
+    {
+      if (i == 0 || !seeded)
+        reference.push_back(PoseTask(v, i));
+      else
+        others.push_back(PoseTask(v, i));
+    }
+  }
+
+  runTasks(views, reference, num_threads, method_, false);
+  runTasks(views, others, num_threads, method_, true);
+
+  // each task only wrote its camera, the stage is set per view
+  for (size_t v = first; v < views->size(); v++)
+    (*views)[v].checkCbPoses();
+}
+
+}
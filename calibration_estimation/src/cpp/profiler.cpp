@@ -0,0 +1,307 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include "profiler.h"
+#include "auxiliar.h"
+
+#include <ros/ros.h>
+
+#include <fstream>
+#include <cstdio>
+#include <ctime>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace calib
+{
+
+/// \brief JSON string literal of s (quotes, backslashes and control
+/// characters escaped)
+static string jsonString(const string &s)
+{
+  string out = "\"";
+  for (size_t k = 0; k < s.size(); k++)
+  {
+    unsigned char c = s[k];
+    switch (c)
+    {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20)
+        {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        }
+        else
+          out += c;
+    }
+  }
+  return out + "\"";
+}
+
+Profiler::Profiler() :
+  start_wall_(0), start_thread_cpu_(0), start_process_cpu_(0), num_solves_(0),
+  callback_(this)
+{
+}
+
+Profiler::~Profiler()
+{
+}
+
+void Profiler::clear()
+{
+  phases_.clear();
+  iterations_.clear();
+  num_solves_ = 0;
+}
+
+void Profiler::begin(const string &name)
+{
+  current_name_ = name;
+  start_wall_ = wallTime();
+  start_thread_cpu_  = threadCpuTime();
+  start_process_cpu_ = processCpuTime();
+}
+
+void Profiler::end(const ceres::Problem *problem)
+{
+  PhaseStats phase;
+  phase.name      = current_name_;
+  phase.wall_time = wallTime() - start_wall_;
+  phase.thread_cpu_time  = threadCpuTime() - start_thread_cpu_;
+  phase.process_cpu_time = processCpuTime() - start_process_cpu_;
+  phase.peak_rss         = peakRss();
+
+  phase.num_residual_blocks  = problem ? problem->NumResidualBlocks()  : 0;
+  phase.num_parameter_blocks = problem ? problem->NumParameterBlocks() : 0;
+  phase.num_parameters       = problem ? problem->NumParameters()      : 0;
+
+  phases_.push_back(phase);
+}
+
+ceres::IterationCallback *Profiler::callback()
+{
+  num_solves_++;
+  return &callback_;
+}
+
+ceres::CallbackReturnType Profiler::Callback::operator()(const ceres::IterationSummary &summary)
+{
+  IterationStats it;
+  it.solve                    = profiler_->num_solves_;
+  it.iteration                = summary.iteration;
+  it.step_is_successful       = summary.step_is_successful;
+  it.cost                     = summary.cost;
+  it.cost_change              = summary.cost_change;
+  it.gradient_max_norm        = summary.gradient_max_norm;
+  it.step_norm                = summary.step_norm;
+  it.linear_solver_iterations = summary.linear_solver_iterations;
+  it.iteration_time           = summary.iteration_time_in_seconds;
+  it.step_solver_time         = summary.step_solver_time_in_seconds;
+  it.cumulative_time          = summary.cumulative_time_in_seconds;
+
+  profiler_->iterations_.push_back(it);
+  return ceres::SOLVER_CONTINUE;
+}
+
+void Profiler::print() const
+{
+  for (size_t k = 0; k < phases_.size(); k++)
+  {
+    const PhaseStats &p = phases_[k];
+    ROS_INFO("%-15s wall %9.4f s  thread cpu %9.4f s  process cpu %9.4f s  "
+             "process peak RSS %8ld KiB  (%d residual blocks, %d parameter blocks)",
+             p.name.c_str(), p.wall_time, p.thread_cpu_time, p.process_cpu_time, p.peak_rss,
+             p.num_residual_blocks, p.num_parameter_blocks);
+  }
+}
+
+bool Profiler::write(const string &filename) const
+{
+  const string ext = ".csv";
+  if (filename.size() >= ext.size() &&
+      filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0)
+    return writeCSV(filename);
+  else
+    return writeJSON(filename);
+}
+
+bool Profiler::writeJSON(const string &filename) const
+{
+  ofstream out(filename.c_str());
+  if (!out)
+  {
+    ROS_ERROR("Could not write profiler report %s", filename.c_str());
+    return false;
+  }
+
+  out.precision(9);
+  out << "{\n";
+  out << "  \"label\": " << jsonString(label_) << ",\n";
+  out << "  \"timestamp\": " << time(0) << ",\n";
+
+  out << "  \"phases\": [\n";
+  for (size_t k = 0; k < phases_.size(); k++)
+  {
+    const PhaseStats &p = phases_[k];
+    out << "    {\"name\": " << jsonString(p.name)
+        << ", \"wall_time\": " << p.wall_time
+        << ", \"thread_cpu_time\": " << p.thread_cpu_time
+        << ", \"process_cpu_time\": " << p.process_cpu_time
+        << ", \"process_peak_rss_kib\": " << p.peak_rss
+        << ", \"num_residual_blocks\": " << p.num_residual_blocks
+        << ", \"num_parameter_blocks\": " << p.num_parameter_blocks
+        << ", \"num_parameters\": " << p.num_parameters
+        << "}" << (k + 1 < phases_.size() ? "," : "") << "\n";
+  }
+  out << "  ],\n";
+
+  out << "  \"iterations\": [\n";
+  for (size_t k = 0; k < iterations_.size(); k++)
+  {
+    const IterationStats &it = iterations_[k];
+    out << "    {\"solve\": " << it.solve
+        << ", \"iteration\": " << it.iteration
+        << ", \"step_is_successful\": " << (it.step_is_successful ? "true" : "false")
+        << ", \"cost\": " << it.cost
+        << ", \"cost_change\": " << it.cost_change
+        << ", \"gradient_max_norm\": " << it.gradient_max_norm
+        << ", \"step_norm\": " << it.step_norm
+        << ", \"linear_solver_iterations\": " << it.linear_solver_iterations
+        << ", \"iteration_time\": " << it.iteration_time
+        << ", \"step_solver_time\": " << it.step_solver_time
+        << ", \"cumulative_time\": " << it.cumulative_time
+        << "}" << (k + 1 < iterations_.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n";
+  out << "}\n";
+
+  return out.good();
+}
+
+bool Profiler::writeCSV(const string &filename) const
+{
+  ofstream out(filename.c_str());
+  if (!out)
+  {
+    ROS_ERROR("Could not write profiler report %s", filename.c_str());
+    return false;
+  }
+
+  // two tables (phases, iterations) separated by an empty line
+  time_t timestamp = time(0);
+  out.precision(9);
+  out << "label,timestamp,phase,wall_time,thread_cpu_time,process_cpu_time,"
+         "process_peak_rss_kib,num_residual_blocks,num_parameter_blocks,num_parameters\n";
+  for (size_t k = 0; k < phases_.size(); k++)
+  {
+    const PhaseStats &p = phases_[k];
+    out << csvField(label_) << "," << timestamp << "," << csvField(p.name) << ","
+        << p.wall_time << "," << p.thread_cpu_time << "," << p.process_cpu_time << ","
+        << p.peak_rss << ","
+        << p.num_residual_blocks << "," << p.num_parameter_blocks << ","
+        << p.num_parameters << "\n";
+  }
+
+  out << "\nsolve,iteration,step_is_successful,cost,cost_change,gradient_max_norm,"
+         "step_norm,linear_solver_iterations,iteration_time,step_solver_time,"
+         "cumulative_time\n";
+  for (size_t k = 0; k < iterations_.size(); k++)
+  {
+    const IterationStats &it = iterations_[k];
+    out << it.solve << "," << it.iteration << "," << it.step_is_successful << ","
+        << it.cost << "," << it.cost_change << "," << it.gradient_max_norm << ","
+        << it.step_norm << "," << it.linear_solver_iterations << ","
+        << it.iteration_time << "," << it.step_solver_time << ","
+        << it.cumulative_time << "\n";
+  }
+
+  return out.good();
+}
+
+double Profiler::wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+/// \brief User plus system time of a rusage
+static double usageTime(const struct rusage &usage)
+{
+  return usage.ru_utime.tv_sec + 1e-6 * usage.ru_utime.tv_usec +
+         usage.ru_stime.tv_sec + 1e-6 * usage.ru_stime.tv_usec;
+}
+
+double Profiler::threadCpuTime()
+{
+  // the calling thread only: the ceres worker threads and the parallel view
+  // generation are missing, but other jobs (BatchRunner threads) too
+  struct rusage usage;
+#ifdef RUSAGE_THREAD
+  getrusage(RUSAGE_THREAD, &usage);
+#else
+  getrusage(RUSAGE_SELF, &usage);
+#endif
+  return usageTime(usage);
+}
+
+double Profiler::processCpuTime()
+{
+  // all the threads, including the jobs running concurrently
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usageTime(usage);
+}
+
+long Profiler::peakRss()
+{
+  // process-wide, there is no per-thread memory
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss; // KiB on Linux
+}
+
+}
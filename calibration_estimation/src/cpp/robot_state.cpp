@@ -35,15 +35,29 @@
 //! \author Pablo Speciale
 
 #include "robot_state.h"
+#include "conversion.h"
 #include "ros/assert.h"
 #include <kdl_parser/kdl_parser.hpp>
+#include <boost/thread/mutex.hpp>
 
 using namespace std;
 
 namespace calib
 {
 
-RobotState::RobotState() : kdl_tree_(0), fk_solver(0)
+// tree revisions are unique across the RobotStates (see getTreeRevision())
+static boost::mutex  tree_revision_mutex;
+static unsigned long last_tree_revision = 0;
+
+static unsigned long newTreeRevision()
+{
+  boost::mutex::scoped_lock lock(tree_revision_mutex);
+  return ++last_tree_revision;
+}
+
+RobotState::RobotState() :
+  kdl_tree_(0), pose_valid_(false), pose_revision_(0), updated_links_(0),
+  tree_revision_(0)
 {
 }
 
@@ -57,15 +71,33 @@ void RobotState::initFromURDF(const urdf::Model &model)
   // copy urdf model
   urdf_model_ = model;
 
-  // create internal structures
-  updateTree();
-
   // get joint names
   vector<string> joint_names;
   getJointNames(&joint_names);
 
   // init joint_state (vector of angles joints)
   JointState::initString(joint_names);
+
+  // create internal structures (after the joint indexes, see compileTree())
+  updateTree();
+}
+
+void RobotState::createThreadStates(const RobotState &robot_state, int num_threads,
+                                    vector<boost::shared_ptr<RobotState> > *robot_states)
+{
+  robot_states->resize(num_threads);
+  for (int t = 0; t < num_threads; t++)
+  {
+    RobotState *state = new RobotState();
+    state->initFromURDF(robot_state.getUrdfModel());
+
+    // same model, same joint indexes
+    for (size_t j = 0; j < robot_state.joint_offset_.size(); j++)
+      if (robot_state.joint_offset_[j] != 0)
+        state->setJointOffset(j, robot_state.joint_offset_[j]);
+
+    (*robot_states)[t].reset(state);
+  }
 }
 
 void RobotState::getJointNames(vector<string> *joint_name) const
@@ -91,10 +123,7 @@ void RobotState::deletePtrs()
   // delete current KDL tree
   if (kdl_tree_)
     delete kdl_tree_;
-
-  // delete current fk_solver
-  if (fk_solver)
-    delete fk_solver;
+  kdl_tree_ = 0;
 }
 
 void RobotState::updateTree()
@@ -109,8 +138,106 @@ void RobotState::updateTree()
     ROS_ERROR("Failed to construct kdl tree from urdf");
   }
 
-  // create TreeFkSolverPos_recursive from KDL tree
-  fk_solver = new KDL::TreeFkSolverPos_recursive(*kdl_tree_);
+  // flat representation for the forward kinematic
+  compileTree();
+}
+
+void RobotState::compileTree()
+{
+  link_symbols_.clear();
+  parent_idx_.clear();
+  segment_.clear();
+  joint_idx_.clear();
+  patched_idx_.clear();
+  pose_valid_ = false;
+  tree_revision_ = newTreeRevision();
+
+  if (segments().empty())
+    return;
+
+  // breadth-first traversal: parents are always before their children
+  vector<KDL::SegmentMap::const_iterator> queue;
+  queue.push_back(kdl_tree_->getRootSegment());
+  parent_idx_.push_back(-1);
+
+  for (size_t k = 0; k < queue.size(); k++)
+  {
+    const KDL::TreeElement &element = queue[k]->second;
+    const KDL::Segment &segment = element.segment;
+
+    link_symbols_.intern(queue[k]->first);  // id k
+    segment_.push_back(segment);
+
+    // joint index of the joint angle
+    int joint_idx = -1;
+    if (segment.getJoint().getType() != KDL::Joint::None)
+    {
+      joint_idx = getJointIndex(segment.getJoint().getName());
+      if (joint_idx < 0)
+        ROS_ERROR("Join: %s does not belong to the joint positions vector.",
+                  segment.getJoint().getName().c_str());
+    }
+    joint_idx_.push_back(joint_idx);
+
+    // children
+    for (size_t c = 0; c < element.children.size(); c++)
+    {
+      queue.push_back(element.children[c]);
+      parent_idx_.push_back(k);
+    }
+  }
+  link_symbols_.freeze();  // lock-free lookups
+
+  pose_.resize(segment_.size());
+  pose_q_.resize(segment_.size());
+  joint_offset_.resize(position_.size(), 0.0);
+}
+
+void RobotState::computePoses()
+{
+  if (segment_.empty())
+    return;
+
+  // root (the recursive KDL solver also uses the identity)
+  pose_[0] = KDL::Frame::Identity();
+
+  for (size_t k = 1; k < segment_.size(); k++)
+  {
+    pose_q_[k] = linkPosition(k);
+    pose_[k]   = pose_[parent_idx_[k]] * segment_[k].pose(pose_q_[k]);
+  }
+
+  pose_valid_    = true;
+  pose_revision_ = getRevision();
+  patched_idx_.clear();
+  updated_links_ = segment_.size();
+}
+
+void RobotState::updatePoses()
+{
+  // patched links, the rest of each subtree is marked on the way (parents
+  // are always before their children)
+  vector<char> stale(segment_.size(), 0);
+  for (size_t i = 0; i < patched_idx_.size(); i++)
+    stale[patched_idx_[i]] = 1;
+
+  updated_links_ = 0;
+  for (size_t k = 1; k < segment_.size(); k++)
+  {
+    // joints set again to the same value (e.g. reset() + update()) are not
+    // changes
+    double q = linkPosition(k);
+    if (!stale[k] && !stale[parent_idx_[k]] && q == pose_q_[k])
+      continue;
+
+    stale[k]   = 1;
+    pose_q_[k] = q;
+    pose_[k]   = pose_[parent_idx_[k]] * segment_[k].pose(q);
+    updated_links_++;
+  }
+
+  pose_revision_ = getRevision();
+  patched_idx_.clear();
 }
 
 bool RobotState::empty(void)
@@ -120,30 +247,47 @@ bool RobotState::empty(void)
 
 bool RobotState::getFK(const std::string &link_name, KDL::Frame *pose)
 {
-  // generate Joint Array
-  KDL::JntArray q_in;
-  generateJntArray(&q_in);
+  int link_idx = getLinkIndex(link_name);
+  if (link_idx < 0)
+  {
+    printf("Link name could not been found");
+    return false;
+  }
 
-  // forward kinematic (recursive)
-  int result = fk_solver->JntToCart(q_in, *pose, link_name);
+  return getFK(link_idx, pose);
+}
 
-  if (result == -1)
-    printf("q_in.rows() != tree.getNrOfJoints()");
+bool RobotState::getFK(int link_idx, KDL::Frame *pose)
+{
+  if (link_idx < 0 || link_idx >= (int)segment_.size())
+    return false;
 
-  if (result == -2)
-    printf("Link name could not been found");
+  *pose = getFK()[link_idx];
+  return true;
+}
+
+const vector<KDL::Frame> &RobotState::getFK()
+{
+  // full pass after a tree rebuild, otherwise only the subtrees of the
+  // changed joints (positions or patched origins)
+  if (!pose_valid_)
+    computePoses();
+  else if (pose_revision_ != getRevision() || !patched_idx_.empty())
+    updatePoses();
+  else
+    updated_links_ = 0;
 
-  return result >= 0;
+  return pose_;
 }
 
 void RobotState::getRelativePose(const string &link_name,
                                  const double angle,
                                  KDL::Frame *pose) const
 {
-  // get pose
-  KDL::SegmentMap::const_iterator seg = segments().find(link_name);
-  if (seg != segments().end())
-    *pose = seg->second.segment.pose(angle);
+  // get pose (compiled segment, it includes the patched joint origins)
+  int link_idx = getLinkIndex(link_name);
+  if (link_idx >= 0)
+    *pose = segment_[link_idx].pose(angle);
   else
     ROS_ERROR("Link name could not been found");
 }
@@ -151,29 +295,32 @@ void RobotState::getRelativePose(const string &link_name,
 void RobotState::getRelativePose(const string &link_name,
                                  KDL::Frame *pose) const
 {
-  string jnt_name = getJointName(link_name);
-  JointState::JointStateType::const_iterator jnt = joint_positions_.find(jnt_name);
-  if (jnt != joint_positions_.end())
+  int jnt = getJointIndex(getJointName(link_name));
+  if (jnt >= 0)
   {
-    double current_angle = jnt->second;
+    double current_angle = getCalibratedPosition(jnt);
     getRelativePose(link_name, current_angle, pose);
   }
   else
     ROS_ERROR("Join name could not been found");
 }
 
+void RobotState::getRelativePose(int link_idx, KDL::Frame *pose) const
+{
+  *pose = segment_[link_idx].pose(linkPosition(link_idx));
+}
+
 void RobotState::getPoses(PosesType *poses) const
 {
   poses->clear();
 
   // loop over all joint positions
-  JointState::JointStateType::const_iterator jnt = joint_positions_.begin();
-  for (; jnt != joint_positions_.end(); jnt++)
+  for (size_t jnt = 0; jnt < position_.size(); jnt++)
   {
     // get pose
     KDL::Frame pose;
-    const string &link_name = getLinkName(jnt->first);
-    getRelativePose(link_name, jnt->second, &pose);
+    const string &link_name = getLinkName(getJointNameByIndex(jnt));
+    getRelativePose(link_name, getCalibratedPosition(jnt), &pose);
 
     // save pose
     (*poses)[link_name] = pose;
@@ -192,6 +339,67 @@ void RobotState::setUrdfPose(const std::string &link_name, const urdf::Pose &pos
   urdf_model_.joints_[jnt]->parent_to_joint_origin_transform = pose;
 }
 
+bool RobotState::setJointOrigin(const std::string &link_name, const urdf::Pose &pose)
+{
+  int link_idx = getLinkIndex(link_name);
+  const urdf::Link *link = urdf_model_.getLink(link_name).get();
+  if (link_idx <= 0 || !link || !link->parent_joint)
+  {
+    ROS_ERROR("Link %s has no parent joint", link_name.c_str());
+    return false;
+  }
+
+  // urdf model (e.g. for exporting it)
+  urdf::Joint &jnt = *link->parent_joint;
+  jnt.parent_to_joint_origin_transform = pose;
+
+  // KDL joint, same conversion as kdl_parser (axis in the parent frame)
+  KDL::Frame origin;
+  urdf2kdl(pose, &origin);
+
+  KDL::Vector axis(jnt.axis.x, jnt.axis.y, jnt.axis.z);
+  KDL::Joint joint;
+  switch (jnt.type)
+  {
+    case urdf::Joint::REVOLUTE:
+    case urdf::Joint::CONTINUOUS:
+      joint = KDL::Joint(jnt.name, origin.p, origin.M * axis, KDL::Joint::RotAxis);
+      break;
+    case urdf::Joint::PRISMATIC:
+      joint = KDL::Joint(jnt.name, origin.p, origin.M * axis, KDL::Joint::TransAxis);
+      break;
+    default:
+      joint = KDL::Joint(jnt.name, KDL::Joint::None);
+      break;
+  }
+
+  // patch the compiled segment (kdl_tree_ only keeps the structure), the
+  // poses outside of its subtree remain valid
+  const KDL::Segment &segment = segment_[link_idx];
+  segment_[link_idx] = KDL::Segment(segment.getName(), joint, origin, segment.getInertia());
+  patched_idx_.push_back(link_idx);
+  tree_revision_ = newTreeRevision();
+
+  return true;
+}
+
+void RobotState::setJointOffset(int joint_idx, double offset)
+{
+  if (joint_idx < 0 || joint_idx >= (int)joint_offset_.size())
+  {
+    ROS_ERROR("Joint index %d out of range", joint_idx);
+    return;
+  }
+
+  joint_offset_[joint_idx] = offset;
+
+  // links moved by the joint (updatePoses() also compares the positions)
+  for (size_t k = 0; k < joint_idx_.size(); k++)
+    if (joint_idx_[k] == joint_idx)
+      patched_idx_.push_back(k);
+  tree_revision_ = newTreeRevision();
+}
+
 string RobotState::getLinkRoot(const string &link_name) const
 {
   const urdf::Link *link = urdf_model_.getLink(link_name).get();
@@ -265,10 +473,9 @@ void RobotState::generateJntArray(KDL::JntArray *jnt_array)
   jnt_array->resize(kdl_tree_->getNrOfJoints());
   KDL::SetToZero(*jnt_array);
 
-  JointStateType::const_iterator it = joint_positions_.begin();
-  for (; it != joint_positions_.end(); it++)
+  for (size_t jnt = 0; jnt < position_.size(); jnt++)
   {
-    jnt_array->data(getJointID(it->first)) = it->second;
+    jnt_array->data(getJointID(getJointNameByIndex(jnt))) = position_[jnt];
   }
 }
 
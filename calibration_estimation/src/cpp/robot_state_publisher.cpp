@@ -45,15 +45,19 @@ using namespace std;
 namespace calib
 {
 
-RobotStatePublisher::RobotStatePublisher()
+RobotStatePublisher::RobotStatePublisher() :
+  headless_(false), publish_count_(0),
+  published_revision_(0), published_tree_revision_(0)
 {
-  // set publish frequency
-  double publish_freq;
+  // set publish frequency (maximum)
+  double publish_freq, keepalive;
   node_.param("publish_frequency", publish_freq, 50.0);
+  node_.param("tf_keepalive", keepalive, 1.0);
 
   // trigger to publish fixed joints
   publish_interval_ = ros::Duration(1.0/max(publish_freq,1.0));
-  timer_ = node_.createTimer(publish_interval_, &RobotStatePublisher::publishTransforms, this);
+  keepalive_ = ros::Duration(keepalive);
+  timer_ = node_.createTimer(publish_interval_, &RobotStatePublisher::publishChanges, this);
 }
 
 RobotStatePublisher::~RobotStatePublisher()
@@ -64,33 +68,38 @@ void RobotStatePublisher::updateTree()
 {
   timer_.stop();
   RobotState::updateTree();
-  timer_.start();
+  if (!headless_)
+    timer_.start();
 }
 
-bool RobotStatePublisher::update(const string &joint_name,
-                                 const double &position)
+void RobotStatePublisher::setHeadless(bool headless)
 {
-  // using RobotState implementation
-  bool result = RobotState::update(joint_name, position);
-
-  // publishing transforms right away
-  const ros::TimerEvent dummy_event;
-  publishTransforms(dummy_event);
-
-  return result;
+  headless_ = headless;
+  if (headless_)
+    timer_.stop();
+  else
+    timer_.start();
 }
 
-bool RobotStatePublisher::update(const vector<string> &joint_name,
-                                 const vector<double> &position)
+bool RobotStatePublisher::changed() const
 {
-  // using RobotState implementation
-  bool result = RobotState::update(joint_name, position);
+  return getRevision() != published_revision_ ||
+         getTreeRevision() != published_tree_revision_;
+}
 
-  // publishing transforms right away
-  const ros::TimerEvent dummy_event;
-  publishTransforms(dummy_event);
+void RobotStatePublisher::publishChanges(const ros::TimerEvent &e)
+{
+  if (changed() || ros::Time::now() - last_publish_ >= keepalive_)
+    publishTransforms(e);
+}
 
-  return result;
+void RobotStatePublisher::flush()
+{
+  if (changed())
+  {
+    const ros::TimerEvent dummy_event;
+    publishTransforms(dummy_event);
+  }
 }
 
 void RobotStatePublisher::publishTransforms(const ros::TimerEvent &e)
@@ -104,16 +113,15 @@ void RobotStatePublisher::publishTransforms(const ros::TimerEvent &e)
   ros::Time delay = now + ros::Duration(0.5);
 
   // loop over all joint positions
-  JointState::JointStateType::const_iterator jnt = joint_positions_.begin();
-  for (; jnt != joint_positions_.end(); jnt++)
+  for (size_t jnt = 0; jnt < position_.size(); jnt++)
   {
     // get pose
     KDL::Frame pose;
-    const string &link_name = getLinkName(jnt->first);
+    const string &link_name = getLinkName(getJointNameByIndex(jnt));
 
     // moving transforms
     tf_transform.stamp_ = now;
-    getRelativePose(link_name, jnt->second, &pose);
+    getRelativePose(link_name, getCalibratedPosition(jnt), &pose);
 
     // convert KDL::Frame to tf::Transform
     tf::transformKDLToTF(pose, tf_transform);
@@ -126,6 +134,11 @@ void RobotStatePublisher::publishTransforms(const ros::TimerEvent &e)
   }
 
   tf_broadcaster_.sendTransform(tf_transforms);
+
+  publish_count_++;
+  last_publish_            = now;
+  published_revision_      = getRevision();
+  published_tree_revision_ = getTreeRevision();
 }
 
 }
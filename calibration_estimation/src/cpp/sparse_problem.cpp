@@ -0,0 +1,441 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include "sparse_problem.h"
+
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+
+#include <ros/console.h>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+namespace calib
+{
+
+namespace
+{
+
+/// \brief [R|t] = [R|t] * [Ra|ta] (R row-major)
+template <typename T>
+void compose(T R[9], T t[3], const T Ra[9], const T ta[3])
+{
+  T R0[9];
+  for (int k = 0; k < 9; k++)
+    R0[k] = R[k];
+
+  for (int r = 0; r < 3; r++)
+  {
+    t[r] += R0[3*r]*ta[0] + R0[3*r+1]*ta[1] + R0[3*r+2]*ta[2];
+    for (int c = 0; c < 3; c++)
+      R[3*r+c] = R0[3*r]*Ra[c] + R0[3*r+1]*Ra[3+c] + R0[3*r+2]*Ra[6+c];
+  }
+}
+
+/// Residuals of one sensor of the Python estimator (see SparseProblem),
+/// each value it uses is a parameter block of size 1
+struct SensorResidual
+{
+  SensorResidual(const vector<SparseProblem::Link> &links,
+                 const SparseProblem::Board &board)
+    : links(links), board(board), camera_chain(false), camera(0), baseline_rgbd(0.0)
+  {
+    for (int k = 0; k < 12; k++)
+      P[k] = 0.0;
+  }
+
+  /// \brief Parameter block of a value index
+  int block(int value) const
+  {
+    return lower_bound(blocks.begin(), blocks.end(), value) - blocks.begin();
+  }
+
+  template <typename T>
+  T value(T const* const* parameters, int idx) const
+  {
+    return parameters[block(idx)][0];
+  }
+
+  /// \brief Transform of x, y, z, angle-axis (SingleTransform)
+  template <typename T>
+  void pose(T const* const* parameters, int idx, T R[9], T t[3]) const
+  {
+    T angle_axis[3];
+    for (int k = 0; k < 3; k++)
+    {
+      t[k]          = value(parameters, idx + k);
+      angle_axis[k] = value(parameters, idx + 3 + k);
+    }
+    ceres::AngleAxisToRotationMatrix(angle_axis, ceres::RowMajorAdapter3x3(R));
+  }
+
+  /// \brief Transform of a link: fixed (SingleTransform) or moved by its
+  /// joint (link_T of the joint chain: translation * roll * pitch * yaw)
+  template <typename T>
+  void link(T const* const* parameters, const SparseProblem::Link &link,
+            T R[9], T t[3]) const
+  {
+    if (link.axis == 0)
+    {
+      pose(parameters, link.params, R, t);
+      return;
+    }
+
+    T q[6];
+    for (int k = 0; k < 6; k++)
+      q[k] = value(parameters, link.params + k);
+
+    T d = value(parameters, link.gearing) * T(link.position);
+    int k = abs(link.axis) - 1;
+    q[k] += link.axis > 0 ? d : -d;
+
+    T cr = cos(q[3]), sr = sin(q[3]);
+    T cp = cos(q[4]), sp = sin(q[4]);
+    T cy = cos(q[5]), sy = sin(q[5]);
+
+    R[0] = cp*cy;              R[1] = -cp*sy;             R[2] = sp;
+    R[3] = sr*sp*cy + cr*sy;   R[4] = cr*cy - sr*sp*sy;   R[5] = -sr*cp;
+    R[6] = sr*sy - cr*sp*cy;   R[7] = cr*sp*sy + sr*cy;   R[8] = cr*cp;
+    t[0] = q[0];
+    t[1] = q[1];
+    t[2] = q[2];
+  }
+
+  template <typename T>
+  bool operator()(T const* const* parameters, T *residuals) const
+  {
+    // chain: root to the camera frame (or to the board link)
+    T R[9], t[3];
+    for (int k = 0; k < 9; k++)
+      R[k] = T(k % 4 == 0 ? 1.0 : 0.0);
+    t[0] = t[1] = t[2] = T(0.0);
+
+    for (size_t i = 0; i < links.size(); i++)
+    {
+      T Ra[9], ta[3];
+      link(parameters, links[i], Ra, ta);
+      compose(R, t, Ra, ta);
+    }
+
+    // board pose (root frame) and spacing
+    T Rb[9], tb[3];
+    pose(parameters, board.pose, Rb, tb);
+    T spacing_x = value(parameters, board.spacing);
+    T spacing_y = value(parameters, board.spacing + 1);
+
+    size_t terms = camera_chain ? (baseline_rgbd != 0.0 ? 3 : 2) : 3;
+    size_t num_corners = camera_chain ? measured.size() / terms
+                                      : size_t(board.corners_x * board.corners_y);
+
+    // projection matrix with the shifts (RectifiedCamera.project())
+    T Pc[12];
+    if (camera_chain)
+    {
+      for (int k = 0; k < 12; k++)
+        Pc[k] = T(P[k]);
+      T f_shift = value(parameters, camera + 1);
+      Pc[3] += value(parameters, camera);      // baseline_shift
+      Pc[0] += f_shift;
+      Pc[5] += f_shift;
+      Pc[2] += value(parameters, camera + 2);  // cx_shift
+      Pc[6] += value(parameters, camera + 3);  // cy_shift
+    }
+
+    for (size_t n = 0; n < num_corners; n++)
+    {
+      T X[3] = { T(double(n % board.corners_x)) * spacing_x,
+                 T(double(n / board.corners_x)) * spacing_y,
+                 T(0.0) };
+
+      T world[3];
+      for (int r = 0; r < 3; r++)
+        world[r] = Rb[3*r]*X[0] + Rb[3*r+1]*X[1] + Rb[3*r+2]*X[2] + tb[r];
+
+      T *residual = residuals + terms*n;
+      if (!camera_chain)
+      {
+        // board pose minus the chain
+        for (int r = 0; r < 3; r++)
+          residual[r] = world[r] - (R[3*r]*X[0] + R[3*r+1]*X[1] + R[3*r+2]*X[2] + t[r]);
+        continue;
+      }
+
+      // camera frame: R^T * (world - t)
+      T d[3] = { world[0] - t[0], world[1] - t[1], world[2] - t[2] };
+      T c[3];
+      for (int r = 0; r < 3; r++)
+        c[r] = R[r]*d[0] + R[3+r]*d[1] + R[6+r]*d[2];
+
+      T h[3];
+      for (int r = 0; r < 3; r++)
+        h[r] = Pc[4*r]*c[0] + Pc[4*r+1]*c[1] + Pc[4*r+2]*c[2] + Pc[4*r+3];
+
+      residual[0] = h[0] / h[2] - T(measured[terms*n]);
+      residual[1] = h[1] / h[2] - T(measured[terms*n+1]);
+      if (terms == 3)
+        residual[2] = Pc[0] * T(baseline_rgbd) / c[2] - T(measured[terms*n+2]);
+    }
+
+    return true;
+  }
+
+  vector<SparseProblem::Link> links;
+  SparseProblem::Board board;
+  bool   camera_chain;   // false: board attached to the chain
+  double P[12];
+  int    camera;
+  double baseline_rgbd;
+  vector<double> measured;
+  vector<int> blocks;    // value index of each parameter block (sorted)
+};
+
+/// \brief Cost function of a sensor, one parameter block per value
+ceres::CostFunction *createSensorCost(SensorResidual *residual, size_t num_residuals)
+{
+  ceres::DynamicAutoDiffCostFunction<SensorResidual, 8> *cost_function =
+    new ceres::DynamicAutoDiffCostFunction<SensorResidual, 8>(residual);
+
+  for (size_t k = 0; k < residual->blocks.size(); k++)
+    cost_function->AddParameterBlock(1);
+  cost_function->SetNumResiduals(num_residuals);
+
+  return cost_function;
+}
+
+}
+
+SparseProblem::SparseProblem()
+  : num_columns_(0), num_residuals_(0)
+{
+}
+
+SparseProblem::~SparseProblem()
+{
+  clear();
+}
+
+void SparseProblem::setColumns(const vector<int> &columns, int num_columns)
+{
+  columns_     = columns;
+  num_columns_ = num_columns;
+}
+
+void SparseProblem::usedValues(const vector<Link> &links, const vector<int> &others,
+                               vector<int> *blocks)
+{
+  blocks->assign(others.begin(), others.end());
+  for (size_t i = 0; i < links.size(); i++)
+  {
+    for (int k = 0; k < 6; k++)
+      blocks->push_back(links[i].params + k);
+    if (links[i].axis != 0)
+      blocks->push_back(links[i].gearing);
+  }
+
+  sort(blocks->begin(), blocks->end());
+  blocks->erase(unique(blocks->begin(), blocks->end()), blocks->end());
+}
+
+void SparseProblem::addCameraChain(const vector<Link> &links, const double P[12],
+                                   int camera, double baseline_rgbd, const Board &board,
+                                   const vector<double> &measured)
+{
+  SensorResidual *residual = new SensorResidual(links, board);
+  residual->camera_chain  = true;
+  residual->camera        = camera;
+  residual->baseline_rgbd = baseline_rgbd;
+  residual->measured      = measured;
+  for (int k = 0; k < 12; k++)
+    residual->P[k] = P[k];
+
+  vector<int> others;
+  for (int k = 0; k < 4; k++)
+    others.push_back(camera + k);
+  others.push_back(board.spacing);
+  others.push_back(board.spacing + 1);
+  for (int k = 0; k < 6; k++)
+    others.push_back(board.pose + k);
+  usedValues(links, others, &residual->blocks);
+
+  addSensor(createSensorCost(residual, measured.size()), residual->blocks,
+            measured.size());
+}
+
+void SparseProblem::addChain(const vector<Link> &links, const Board &board)
+{
+  SensorResidual *residual = new SensorResidual(links, board);
+
+  vector<int> others;
+  others.push_back(board.spacing);
+  others.push_back(board.spacing + 1);
+  for (int k = 0; k < 6; k++)
+    others.push_back(board.pose + k);
+  usedValues(links, others, &residual->blocks);
+
+  size_t num_residuals = 3 * board.corners_x * board.corners_y;
+  addSensor(createSensorCost(residual, num_residuals), residual->blocks,
+            num_residuals);
+}
+
+void SparseProblem::addSensor(ceres::CostFunction *cost_function,
+                              const vector<int> &blocks, size_t num_residuals)
+{
+  Sensor sensor;
+  sensor.cost_function = cost_function;
+  sensor.blocks        = blocks;
+  sensor.num_residuals = num_residuals;
+
+  // Jacobian columns (fixed values have none)
+  for (size_t k = 0; k < blocks.size(); k++)
+  {
+    int column = blocks[k] < int(columns_.size()) ? columns_[blocks[k]] : -1;
+    if (column >= 0)
+      sensor.free.push_back(make_pair(column, int(k)));
+  }
+  sort(sensor.free.begin(), sensor.free.end());
+
+  sensors_.push_back(sensor);
+  num_residuals_ += num_residuals;
+}
+
+bool SparseProblem::evaluate(const vector<double> &values,
+                             vector<double> *residuals) const
+{
+  if (values.size() < columns_.size())
+  {
+    ROS_ERROR("SparseProblem: %zu values, expected %zu", values.size(), columns_.size());
+    return false;
+  }
+
+  residuals->assign(num_residuals_, 0.0);
+
+  vector<const double *> parameters;
+  size_t row = 0;
+  for (size_t s = 0; s < sensors_.size(); s++)
+  {
+    const Sensor &sensor = sensors_[s];
+    if (sensor.num_residuals == 0)
+      continue;
+
+    parameters.resize(sensor.blocks.size());
+    for (size_t k = 0; k < sensor.blocks.size(); k++)
+      parameters[k] = &values[sensor.blocks[k]];
+
+    // no jacobians: ceres evaluates the residuals only (no dual numbers)
+    if (!sensor.cost_function->Evaluate(&parameters[0], &(*residuals)[row], NULL))
+      return false;
+
+    row += sensor.num_residuals;
+  }
+
+  return true;
+}
+
+bool SparseProblem::evaluate(const vector<double> &values,
+                             vector<double> *residuals,
+                             vector<double> *data,
+                             vector<int>    *indices,
+                             vector<int>    *indptr) const
+{
+  if (values.size() < columns_.size())
+  {
+    ROS_ERROR("SparseProblem: %zu values, expected %zu", values.size(), columns_.size());
+    return false;
+  }
+
+  residuals->assign(num_residuals_, 0.0);
+  data->clear();
+  indices->clear();
+  indptr->assign(1, 0);
+  indptr->reserve(num_residuals_ + 1);
+
+  vector<const double *> parameters;
+  vector<double *>       jacobians;
+  vector<double>         jacobian;
+
+  size_t row = 0;
+  for (size_t s = 0; s < sensors_.size(); s++)
+  {
+    const Sensor &sensor = sensors_[s];
+    size_t num_blocks = sensor.blocks.size();
+    size_t num_rows   = sensor.num_residuals;
+    if (num_rows == 0)
+      continue;
+
+    parameters.resize(num_blocks);
+    for (size_t k = 0; k < num_blocks; k++)
+      parameters[k] = &values[sensor.blocks[k]];
+
+    // only the free values (num_rows x 1 each)
+    jacobian.resize(num_rows * num_blocks);
+    jacobians.assign(num_blocks, NULL);
+    for (size_t f = 0; f < sensor.free.size(); f++)
+    {
+      int k = sensor.free[f].second;
+      jacobians[k] = &jacobian[num_rows * k];
+    }
+
+    if (!sensor.cost_function->Evaluate(&parameters[0], &(*residuals)[row], &jacobians[0]))
+      return false;
+
+    // CSR rows (columns sorted)
+    for (size_t r = 0; r < num_rows; r++)
+    {
+      for (size_t f = 0; f < sensor.free.size(); f++)
+      {
+        data->push_back(jacobian[num_rows * sensor.free[f].second + r]);
+        indices->push_back(sensor.free[f].first);
+      }
+      indptr->push_back(data->size());
+    }
+    row += num_rows;
+  }
+
+  return true;
+}
+
+void SparseProblem::clear()
+{
+  for (size_t s = 0; s < sensors_.size(); s++)
+    delete sensors_[s].cost_function;
+  sensors_.clear();
+  num_residuals_ = 0;
+}
+
+}
@@ -0,0 +1,189 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+/**
+ * Python module (sparse_problem_cpp) of SparseProblem, used by ErrorCalc
+ * (opt_runner.py). Sequences can be lists, tuples or numpy arrays, the
+ * results are numpy arrays (filled through the buffer protocol, the module
+ * does not link against numpy).
+ */
+
+#include "sparse_problem.h"
+
+#include <boost/python.hpp>
+#include <cstring>
+
+using namespace std;
+using namespace calib;
+namespace bp = boost::python;
+
+template <typename T>
+static void fromSequence(const bp::object &sequence, vector<T> *out)
+{
+  size_t size = bp::len(sequence);
+  out->resize(size);
+  for (size_t k = 0; k < size; k++)
+    (*out)[k] = bp::extract<T>(sequence[k]);
+}
+
+/// \brief Contiguous copy of a sequence of values (one memcpy for arrays)
+static void valuesFromSequence(const bp::object &sequence, vector<double> *out)
+{
+  bp::object array = bp::import("numpy").attr("ascontiguousarray")(sequence, "float64");
+
+  Py_buffer view;
+  if (PyObject_GetBuffer(array.ptr(), &view, PyBUF_C_CONTIGUOUS) != 0)
+    bp::throw_error_already_set();
+
+  out->resize(view.len / sizeof(double));
+  if (!out->empty())
+    memcpy(&(*out)[0], view.buf, out->size() * sizeof(double));
+  PyBuffer_Release(&view);
+}
+
+/// \brief numpy array (dtype: float64 or int32, as T) with a copy of in
+template <typename T>
+static bp::object toArray(const vector<T> &in, const char *dtype)
+{
+  bp::object array = bp::import("numpy").attr("empty")(in.size(), dtype);
+
+  Py_buffer view;
+  if (PyObject_GetBuffer(array.ptr(), &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) != 0)
+    bp::throw_error_already_set();
+
+  if (!in.empty())
+    memcpy(view.buf, &in[0], in.size() * sizeof(T));
+  PyBuffer_Release(&view);
+  return array;
+}
+
+/// \brief links: sequence of (params, axis, position, gearing)
+static void linksFromSequence(const bp::object &sequence, vector<SparseProblem::Link> *links)
+{
+  size_t size = bp::len(sequence);
+  links->clear();
+  for (size_t k = 0; k < size; k++)
+  {
+    bp::object link = sequence[k];
+    links->push_back(SparseProblem::Link(bp::extract<int>(link[0]),
+                                         bp::extract<int>(link[1]),
+                                         bp::extract<double>(link[2]),
+                                         bp::extract<int>(link[3])));
+  }
+}
+
+/// \brief board: (corners_x, corners_y, spacing, pose)
+static SparseProblem::Board boardFromSequence(const bp::object &board)
+{
+  return SparseProblem::Board(bp::extract<int>(board[0]), bp::extract<int>(board[1]),
+                              bp::extract<int>(board[2]), bp::extract<int>(board[3]));
+}
+
+static void setColumns(SparseProblem &problem, const bp::object &columns, int num_columns)
+{
+  vector<int> c;
+  fromSequence(columns, &c);
+  problem.setColumns(c, num_columns);
+}
+
+static void addCameraChain(SparseProblem &problem, const bp::object &links,
+                           const bp::object &P, int camera, double baseline_rgbd,
+                           const bp::object &board, const bp::object &measured)
+{
+  vector<SparseProblem::Link> l;
+  vector<double> p, m;
+  linksFromSequence(links, &l);
+  fromSequence(P, &p);
+  fromSequence(measured, &m);
+  if (p.size() != 12)
+  {
+    PyErr_SetString(PyExc_ValueError, "P must have 12 elements");
+    bp::throw_error_already_set();
+  }
+
+  problem.addCameraChain(l, &p[0], camera, baseline_rgbd, boardFromSequence(board), m);
+}
+
+static void addChain(SparseProblem &problem, const bp::object &links, const bp::object &board)
+{
+  vector<SparseProblem::Link> l;
+  linksFromSequence(links, &l);
+  problem.addChain(l, boardFromSequence(board));
+}
+
+/// \brief Residuals only (no Jacobian)
+static bp::object residuals(const SparseProblem &problem, const bp::object &values)
+{
+  vector<double> v, residuals;
+  valuesFromSequence(values, &v);
+  if (!problem.evaluate(v, &residuals))
+  {
+    PyErr_SetString(PyExc_RuntimeError, "SparseProblem evaluation failed");
+    bp::throw_error_already_set();
+  }
+
+  return toArray(residuals, "float64");
+}
+
+/// \brief (residuals, data, indices, indptr), as scipy.sparse.csr_matrix
+static bp::tuple evaluate(const SparseProblem &problem, const bp::object &values)
+{
+  vector<double> v, residuals, data;
+  vector<int> indices, indptr;
+  valuesFromSequence(values, &v);
+  if (!problem.evaluate(v, &residuals, &data, &indices, &indptr))
+  {
+    PyErr_SetString(PyExc_RuntimeError, "SparseProblem evaluation failed");
+    bp::throw_error_already_set();
+  }
+
+  return bp::make_tuple(toArray(residuals, "float64"), toArray(data, "float64"),
+                        toArray(indices, "int32"), toArray(indptr, "int32"));
+}
+
+BOOST_PYTHON_MODULE(sparse_problem_cpp)
+{
+  bp::class_<SparseProblem, boost::noncopyable>("SparseProblem")
+    .def("set_columns",      &setColumns)
+    .def("add_camera_chain", &addCameraChain)
+    .def("add_chain",        &addChain)
+    .def("residuals",        &residuals)
+    .def("evaluate",         &evaluate)
+    .def("num_residuals",    &SparseProblem::numResiduals)
+    .def("num_columns",      &SparseProblem::numColumns)
+    .def("clear",            &SparseProblem::clear);
+}
@@ -0,0 +1,141 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include "symbol_table.h"
+
+using namespace std;
+
+namespace calib
+{
+
+SymbolTable::SymbolTable() : frozen_(false)
+{
+}
+
+SymbolTable::SymbolTable(const SymbolTable &other)
+{
+  boost::mutex::scoped_lock lock(other.mutex_);
+  ids_    = other.ids_;
+  names_  = other.names_;
+  frozen_ = other.frozen_;
+}
+
+SymbolTable &SymbolTable::operator=(const SymbolTable &other)
+{
+  if (this == &other)
+    return *this;
+
+  map<string, int> ids;
+  deque<string>    names;
+  bool             frozen;
+  {
+    boost::mutex::scoped_lock lock(other.mutex_);
+    ids    = other.ids_;
+    names  = other.names_;
+    frozen = other.frozen_;
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  ids_.swap(ids);
+  names_.swap(names);
+  frozen_ = frozen;
+  return *this;
+}
+
+int SymbolTable::intern(const string &name)
+{
+  // frozen: read-only
+  if (frozen_)
+    return findUnlocked(name);
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  map<string, int>::const_iterator it = ids_.find(name);
+  if (it != ids_.end())
+    return it->second;
+
+  int id = names_.size();
+  ids_[name] = id;
+  names_.push_back(name);
+  return id;
+}
+
+int SymbolTable::findUnlocked(const string &name) const
+{
+  map<string, int>::const_iterator it = ids_.find(name);
+  if (it != ids_.end())
+    return it->second;
+  else
+    return -1;
+}
+
+int SymbolTable::find(const string &name) const
+{
+  if (frozen_)
+    return findUnlocked(name);
+
+  boost::mutex::scoped_lock lock(mutex_);
+  return findUnlocked(name);
+}
+
+const string &SymbolTable::name(int id) const
+{
+  if (frozen_)
+    return names_[id];
+
+  boost::mutex::scoped_lock lock(mutex_);
+  return names_[id];
+}
+
+size_t SymbolTable::size() const
+{
+  if (frozen_)
+    return names_.size();
+
+  boost::mutex::scoped_lock lock(mutex_);
+  return names_.size();
+}
+
+void SymbolTable::clear()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  ids_.clear();
+  names_.clear();
+  frozen_ = false;
+}
+
+}
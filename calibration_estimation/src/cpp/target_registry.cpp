@@ -0,0 +1,140 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+
+//! \author Pablo Speciale
+
+#include "target_registry.h"
+
+#include <ros/ros.h>
+#include <XmlRpcValue.h>
+
+using namespace std;
+using namespace cv;
+
+namespace calib
+{
+
+/// \brief Number (int or double) of a XmlRpc struct
+static bool readNumber(XmlRpc::XmlRpcValue &value, const string &key, double *number)
+{
+  if (!value.hasMember(key))
+    return false;
+
+  XmlRpc::XmlRpcValue &member = value[key];
+  if (member.getType() == XmlRpc::XmlRpcValue::TypeInt)
+    *number = static_cast<int>(member);
+  else if (member.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+    *number = static_cast<double>(member);
+  else
+    return false;
+
+  return true;
+}
+
+TargetRegistry::TargetRegistry()
+{
+  // PR2 checkerboards
+  add("large_cb_7x6", 7, 6, 0.108, 0.108);
+  add("small_cb_4x5", 4, 5, 0.0245, 0.0245);
+}
+
+void TargetRegistry::add(const string &id, int width, int height,
+                         double spacing_x, double spacing_y)
+{
+  boost::shared_ptr<Target> target(new Target());
+  target->id        = id;
+  target->width     = width;
+  target->height    = height;
+  target->spacing_x = spacing_x;
+  target->spacing_y = spacing_y;
+
+  // generate corners: (x,y,z)
+  target->corners.reserve(width * height);
+  for (int j = 0; j < height; j++)
+    for (int i = 0; i < width; i++)
+      target->corners.push_back(Point3d(i * spacing_x, j * spacing_y, 0));
+
+  targets_[id] = target;
+}
+
+bool TargetRegistry::readParam(const ros::NodeHandle &n, const string &param)
+{
+  XmlRpc::XmlRpcValue targets;
+  if (!n.getParam(param, targets))
+    return false;
+
+  if (targets.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+  {
+    ROS_ERROR("Parameter %s is not a map of targets", param.c_str());
+    return false;
+  }
+
+  bool ok = true;
+  for (XmlRpc::XmlRpcValue::iterator it = targets.begin(); it != targets.end(); ++it)
+  {
+    double corners_x, corners_y, spacing_x, spacing_y;
+    if (it->second.getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+        !readNumber(it->second, "corners_x", &corners_x) ||
+        !readNumber(it->second, "corners_y", &corners_y) ||
+        !readNumber(it->second, "spacing_x", &spacing_x))
+    {
+      ROS_ERROR("Target %s: corners_x, corners_y and spacing_x are needed", it->first.c_str());
+      ok = false;
+      continue;
+    }
+
+    if (!readNumber(it->second, "spacing_y", &spacing_y))
+      spacing_y = spacing_x;
+
+    add(it->first, int(corners_x), int(corners_y), spacing_x, spacing_y);
+  }
+
+  return ok;
+}
+
+TargetPtr TargetRegistry::get(const string &id) const
+{
+  map<string, TargetPtr>::const_iterator it = targets_.find(id);
+  if (it == targets_.end())
+  {
+    ROS_ERROR("Unknown target: %s", id.c_str());
+    return TargetPtr();
+  }
+
+  return it->second;
+}
+
+}
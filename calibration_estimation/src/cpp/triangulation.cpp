@@ -37,6 +37,9 @@
 #include "triangulation.h"
 
 #include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 using namespace std;
 using namespace cv;
@@ -106,4 +109,253 @@ void nViewTriangulate(const Mat_<double> &x, const vector<Matx34d> &Ps, Vec3d &X
   homogeneousToEuclidean(X_homog, X);
 }
 
+// Eigenvector of the smallest eigenvalue of a symmetric 4x4 matrix
+// (cyclic Jacobi method). A is overwritten.
+static void smallestEigenvector(double A[4][4], double v[4])
+{
+  double V[4][4] = { {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1} };
+
+  for (int sweep = 0; sweep < 30; sweep++)
+  {
+    // converged (off-diagonal elements relative to the diagonal)
+    double off = 0, diag = 0;
+    for (int p = 0; p < 4; p++)
+    {
+      diag += A[p][p] * A[p][p];
+      for (int q = p + 1; q < 4; q++)
+        off += A[p][q] * A[p][q];
+    }
+    if (off <= 1e-30 * diag)
+      break;
+
+    for (int p = 0; p < 3; p++)
+    {
+      for (int q = p + 1; q < 4; q++)
+      {
+        if (A[p][q] == 0.0)
+          continue;
+
+        // Jacobi rotation which annihilates A[p][q]
+        double theta = (A[q][q] - A[p][p]) / (2.0 * A[p][q]);
+        double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta*theta + 1.0));
+        double c = 1.0 / std::sqrt(t*t + 1.0);
+        double s = t * c;
+
+        for (int k = 0; k < 4; k++)
+        {
+          double akp = A[k][p], akq = A[k][q];
+          A[k][p] = c*akp - s*akq;
+          A[k][q] = s*akp + c*akq;
+        }
+        for (int k = 0; k < 4; k++)
+        {
+          double apk = A[p][k], aqk = A[q][k];
+          A[p][k] = c*apk - s*aqk;
+          A[q][k] = s*apk + c*aqk;
+        }
+        for (int k = 0; k < 4; k++)
+        {
+          double vkp = V[k][p], vkq = V[k][q];
+          V[k][p] = c*vkp - s*vkq;
+          V[k][q] = s*vkp + c*vkq;
+        }
+      }
+    }
+  }
+
+  // smallest eigenvalue
+  int m = 0;
+  for (int k = 1; k < 4; k++)
+    if (A[k][k] < A[m][m])
+      m = k;
+
+  for (int k = 0; k < 4; k++)
+    v[k] = V[k][m];
+}
+
+void nViewTriangulate(const double *x, const double *Ps,
+                      int nviews, int npoints,
+                      double *X)
+{
+  // Hartley normalization (HZ2 p107, p312), so that the 4x4 A'A is well
+  // conditioned. Image: the points of each view are centered and scaled to
+  // a mean distance of sqrt(2) (x' = T x, P' = T P); the rows of A are then
+  // divided by the scale, so the views keep the weights of the DLT above.
+  // World: X = c + sigma * X', with the centroid and mean distance of the
+  // camera centers (the points are unknown), i.e. P' = P U.
+  vector<double> center(2 * nviews), scale(nviews), P_norm(12 * nviews);
+  vector<double> C(3 * nviews);
+  int ncenters = 0;
+  double c[3] = { 0, 0, 0 };
+  for (int i = 0; i < nviews; i++)
+  {
+    const double *xi = x + 2*(size_t)i*npoints;
+
+    double cu = 0, cv = 0;
+    for (int j = 0; j < npoints; j++)
+    {
+      cu += xi[2*j];
+      cv += xi[2*j + 1];
+    }
+    cu /= std::max(npoints, 1);
+    cv /= std::max(npoints, 1);
+
+    double dist = 0;
+    for (int j = 0; j < npoints; j++)
+      dist += std::sqrt((xi[2*j] - cu)*(xi[2*j] - cu) + (xi[2*j + 1] - cv)*(xi[2*j + 1] - cv));
+    dist /= std::max(npoints, 1);
+
+    // a single point (or all equal): only the translation
+    double s = dist > 0 ? std::sqrt(2.0) / dist : 1.0;
+
+    // T P with the rows of A divided by s: the third row is divided by s
+    const double *P = Ps + 12*i;
+    double *Pn = &P_norm[12*i];
+    for (int k = 0; k < 4; k++)
+    {
+      Pn[k]     = P[k]     - cu * P[8 + k];
+      Pn[4 + k] = P[4 + k] - cv * P[8 + k];
+      Pn[8 + k] = P[8 + k] / s;
+    }
+
+    center[2*i]     = cu;
+    center[2*i + 1] = cv;
+    scale[i]        = s;
+
+    // camera center, C = -M^-1 p4 (M = P(:, 0:2)), unless M is singular
+    const double m00 = P[0], m01 = P[1], m02 = P[2];
+    const double m10 = P[4], m11 = P[5], m12 = P[6];
+    const double m20 = P[8], m21 = P[9], m22 = P[10];
+    const double a00 = m11*m22 - m12*m21, a01 = m02*m21 - m01*m22, a02 = m01*m12 - m02*m11;
+    const double a10 = m12*m20 - m10*m22, a11 = m00*m22 - m02*m20, a12 = m02*m10 - m00*m12;
+    const double a20 = m10*m21 - m11*m20, a21 = m01*m20 - m00*m21, a22 = m00*m11 - m01*m10;
+    const double det = m00*a00 + m01*a10 + m02*a20;
+    if (det != 0)
+    {
+      double *Ci = &C[3*ncenters++];
+      Ci[0] = -(a00*P[3] + a01*P[7] + a02*P[11]) / det;
+      Ci[1] = -(a10*P[3] + a11*P[7] + a12*P[11]) / det;
+      Ci[2] = -(a20*P[3] + a21*P[7] + a22*P[11]) / det;
+      for (int k = 0; k < 3; k++)
+        c[k] += Ci[k];
+    }
+  }
+
+  double sigma = 0;
+  for (int k = 0; k < 3; k++)
+    c[k] /= std::max(ncenters, 1);
+  for (int i = 0; i < ncenters; i++)
+    sigma += std::sqrt((C[3*i] - c[0])*(C[3*i] - c[0]) + (C[3*i + 1] - c[1])*(C[3*i + 1] - c[1]) +
+                       (C[3*i + 2] - c[2])*(C[3*i + 2] - c[2]));
+  sigma = sigma > 0 ? sigma / ncenters : 1.0;
+
+  for (int i = 0; i < nviews; i++)
+  {
+    for (int r = 0; r < 3; r++)
+    {
+      double *row = &P_norm[12*i + 4*r];
+      row[3] += row[0]*c[0] + row[1]*c[1] + row[2]*c[2];
+      row[0] *= sigma;
+      row[1] *= sigma;
+      row[2] *= sigma;
+    }
+  }
+
+  // points per block: the normal equations of a block are accumulated in
+  // structure-of-arrays form, so the inner loop (over points) is vectorized
+  const int BLOCK = 64;
+
+  // upper triangle of A'A (10 elements) for each point of the block
+  double N[10][BLOCK];
+
+  for (int begin = 0; begin < npoints; begin += BLOCK)
+  {
+    int n = std::min(BLOCK, npoints - begin);
+
+    for (int e = 0; e < 10; e++)
+      for (int j = 0; j < n; j++)
+        N[e][j] = 0.0;
+
+    // each view adds two rows to A (see nViewTriangulate above), in
+    // normalized coordinates:
+    //   r = u'*P'.row(2) - P'.row(0),  s = v'*P'.row(2) - P'.row(1)
+    for (int i = 0; i < nviews; i++)
+    {
+      const double *P  = &P_norm[12*i];
+      const double *xi = x + 2*((size_t)i*npoints + begin);
+      const double cu = center[2*i], cv = center[2*i + 1], sc = scale[i];
+
+      for (int j = 0; j < n; j++)
+      {
+        const double u = sc * (xi[2*j]     - cu);
+        const double v = sc * (xi[2*j + 1] - cv);
+
+        const double r0 = u*P[8] - P[0], r1 = u*P[9] - P[1], r2 = u*P[10] - P[2], r3 = u*P[11] - P[3];
+        const double s0 = v*P[8] - P[4], s1 = v*P[9] - P[5], s2 = v*P[10] - P[6], s3 = v*P[11] - P[7];
+
+        N[0][j] += r0*r0 + s0*s0;
+        N[1][j] += r0*r1 + s0*s1;
+        N[2][j] += r0*r2 + s0*s2;
+        N[3][j] += r0*r3 + s0*s3;
+        N[4][j] += r1*r1 + s1*s1;
+        N[5][j] += r1*r2 + s1*s2;
+        N[6][j] += r1*r3 + s1*s3;
+        N[7][j] += r2*r2 + s2*s2;
+        N[8][j] += r2*r3 + s2*s3;
+        N[9][j] += r3*r3 + s3*s3;
+      }
+    }
+
+    // null vector of A == eigenvector of the smallest eigenvalue of A'A
+    for (int j = 0; j < n; j++)
+    {
+      double A[4][4] = { { N[0][j], N[1][j], N[2][j], N[3][j] },
+                         { N[1][j], N[4][j], N[5][j], N[6][j] },
+                         { N[2][j], N[5][j], N[7][j], N[8][j] },
+                         { N[3][j], N[6][j], N[8][j], N[9][j] } };
+
+      double X_homog[4];
+      smallestEigenvector(A, X_homog);
+
+      double *Xj = X + 3*(begin + j);
+      Xj[0] = c[0] + sigma * X_homog[0] / X_homog[3];
+      Xj[1] = c[1] + sigma * X_homog[1] / X_homog[3];
+      Xj[2] = c[2] + sigma * X_homog[2] / X_homog[3];
+    }
+  }
+}
+
+void nViewTriangulate(const vector<vector<Point2d> > &x,
+                      const vector<Matx34d> &Ps,
+                      vector<Point3d> *X)
+{
+  CV_Assert(x.size() == Ps.size());
+
+  X->clear();
+  if (x.empty())
+    return;
+
+  int nviews  = x.size();
+  int npoints = x[0].size();
+
+  // contiguous copy of the measurements and projection matrixes
+  vector<double> x_data(2 * nviews * npoints);
+  vector<double> P_data(12 * nviews);
+  for (int i = 0; i < nviews; i++)
+  {
+    CV_Assert((int)x[i].size() == npoints);
+    for (int j = 0; j < npoints; j++)
+    {
+      x_data[2*(i*npoints + j)]     = x[i][j].x;
+      x_data[2*(i*npoints + j) + 1] = x[i][j].y;
+    }
+
+    std::copy(Ps[i].val, Ps[i].val + 12, &P_data[12*i]);
+  }
+
+  X->resize(npoints);
+  if (npoints > 0)
+    nViewTriangulate(&x_data[0], &P_data[0], nviews, npoints, &(*X)[0].x);
+}
+
 }
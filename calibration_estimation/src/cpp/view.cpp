@@ -43,6 +43,7 @@
 #include "auxiliar.h"
 
 #include <ros/ros.h>
+#include <opencv2/calib3d/calib3d.hpp>
 
 using namespace std;
 using namespace cv;
@@ -50,13 +51,31 @@ using namespace cv;
 namespace calib
 {
 
-// Static member allocation
-RobotState *View::robot_state_ = 0;
-std::vector<double *> View::camera_rot_;
-std::vector<double *> View::camera_trans_;
-std::vector<std::string> View::cameras_;
+// targets of a view without context (read-only)
+static const TargetRegistry default_target_registry;
 
-View::View()
+// camera frames of the views without context
+static SymbolTable default_frames;
+
+/// \brief Camera frame symbols of the context
+static SymbolTable &contextFrames(const CalibrationContext *context)
+{
+  return context != 0 ? context->frames : default_frames;
+}
+
+/// \brief Robot state of the context (0 if there is no context)
+static RobotState *contextRobotState(const CalibrationContext *context)
+{
+  if (context == 0 || context->robot_state == 0)
+  {
+    ROS_ERROR("robot_state unset, use View::setContext()");
+    return 0;
+  }
+  return context->robot_state;
+}
+
+View::View() :
+  context_(0), valid_(0), fk_tree_revision_(0)
 {
 }
 
@@ -64,64 +83,191 @@ View::~View()
 {
 }
 
-void View::setRobotState(RobotState *robot_state)
+bool View::updateView()
 {
-  robot_state_ = robot_state;
+  RobotState *robot_state = contextRobotState(context_);
+  if (robot_state == 0)
+    return false;
+
+  return updateView(robot_state);
 }
 
-void View::updateView()
+bool View::updateView(RobotState *robot_state)
 {
-  updateRobot();
-  generateCorners();
+  return updateView(robot_state, true);
+}
+
+bool View::updateView(RobotState *robot_state, bool find_poses)
+{
+  updateRobot(robot_state);
+  if (!updateMeasurements())
+    return false;
+
+  if (find_poses && !hasCbPoses())
+    findCbPoses();
+  updateKinematics(robot_state);
+  return true;
+}
+
+bool View::updateMeasurements()
+{
+  if (valid_ & STAGE_MEASUREMENTS)
+    return true;
+
+  if (!generateCorners())
+    return false;
+
   getCameraModels();
   getMeasurements();
-  findCbPoses();
-  getTransformedPoints();
   getFrameNames();
-  getPoses();
+  resizeCbPoses();
+  valid_ |= STAGE_MEASUREMENTS;
+  return true;
+}
+
+void View::updateKinematics(RobotState *robot_state)
+{
+  // the revision identifies the tree (unique across RobotStates)
+  if ((valid_ & STAGE_KINEMATICS) &&
+      fk_tree_revision_ == robot_state->getTreeRevision())
+    return;
+
+  getPoses(robot_state);
+  fk_tree_revision_ = robot_state->getTreeRevision();
+  valid_ |= STAGE_KINEMATICS;
+}
+
+void View::invalidate(unsigned stages)
+{
+  // later stages depend on the earlier ones
+  if (stages & STAGE_MEASUREMENTS)
+    stages |= STAGE_POSES | STAGE_KINEMATICS | STAGE_ERROR;
+  if (stages & STAGE_POSES)
+    stages |= STAGE_ERROR;
+
+  if ((stages & STAGE_POSES) && (valid_ & STAGE_MEASUREMENTS))
+    resizeCbPoses();
+
+  valid_ &= ~stages;
 }
 
 bool View::generateView(const Msg &msg)
+{
+  return generateView(msg, contextRobotState(context_));
+}
+
+bool View::generateView(const Msg &msg, RobotState *robot_state)
+{
+  return generateView(msg, robot_state, true);
+}
+
+bool View::generateView(const Msg &msg, RobotState *robot_state, bool find_poses)
 {
   // copy message (this class is a container)
   msg_ = msg;
+  invalidate();
 
-  if (robot_state_ != 0)
+  if (robot_state != 0)
+    return updateView(robot_state, find_poses);
+  else
   {
-    updateView();
-    return true;
+    ROS_ERROR("robot_state unset, use View::setContext()");
+    return false;
   }
-  else
+}
+
+bool View::restoreView(const Msg &msg, RobotState *robot_state)
+{
+  msg_ = msg;
+
+  if (robot_state == 0)
   {
-    ROS_ERROR("robot_state_ unset, use setRobotState()");
+    ROS_ERROR("robot_state unset, use View::setContext()");
     return false;
   }
+
+  if (rvec_.size() != msg_->M_cam.size() || tvec_.size() != rvec_.size())
+  {
+    ROS_ERROR("The board poses do not match the cameras of the message");
+    return false;
+  }
+
+  // updateView() without findCbPoses(): keep the given poses
+  vector<Mat> rvec(rvec_), tvec(tvec_);
+  vector<Points2D> expected_pts_2D(expected_pts_2D_);
+  vector<double> error(error_);
+
+  invalidate();
+  updateRobot(robot_state);
+  if (!updateMeasurements())
+    return false;
+
+  rvec_.swap(rvec);
+  tvec_.swap(tvec);
+  expected_pts_2D_.swap(expected_pts_2D);
+  error_.swap(error);
+  getTransformedPoints();
+  checkCbPoses();
+
+  updateKinematics(robot_state);
+
+  return true;
 }
 
 void View::updateRobot()
+{
+  RobotState *robot_state = contextRobotState(context_);
+  if (robot_state != 0)
+    updateRobot(robot_state);
+}
+
+void View::updateRobot(RobotState *robot_state)
 {
   // reset joints to zeros
-  View::robot_state_->reset();
+  robot_state->reset();
 
   // update joints
   size_t size = msg_->M_chain.size();
   for (size_t i = 0; i < size; i++)
   {
-    View::robot_state_->update(msg_->M_chain.at(i).chain_state.name,
-                               msg_->M_chain.at(i).chain_state.position);
+    robot_state->update(msg_->M_chain.at(i).chain_state.name,
+                        msg_->M_chain.at(i).chain_state.position);
+  }
+}
+
+void View::releaseRawData()
+{
+  if (!msg_)
+    return;
+
+  // swap with empty vectors (clear() keeps the capacity)
+  for (size_t i = 0; i < msg_->M_cam.size(); i++)
+  {
+    calibration_msgs::CameraMeasurement &cam = msg_->M_cam[i];
+    vector<uint8_t>().swap(cam.image.data);
+    vector<uint8_t>().swap(cam.image_rect.data);
+    vector<geometry_msgs::Point>().swap(cam.features.object_points);
+    vector<geometry_msgs::Point>().swap(cam.features.image_points);
   }
+  vector<calibration_msgs::LaserMeasurement>().swap(msg_->M_laser);
+}
+
+int View::getFrameId(const string &camera_frame) const
+{
+  return contextFrames(context_).find(camera_frame);
 }
 
 bool View::isVisible(const string &camera_frame)
 {
-  return find(frame_name_.begin(), frame_name_.end(), camera_frame) != frame_name_.end();
+  return isVisible(getFrameId(camera_frame));
 }
 
 int View::getCamIdx(const string &camera_frame)
 {
-  if (isVisible(camera_frame))
+  int cam_idx = getCamIdx(getFrameId(camera_frame));
+  if (cam_idx >= 0)
   {
-    return frame_id_[camera_frame];
+    return cam_idx;
   }
   else
   {
@@ -141,15 +287,21 @@ void View::generateIndexes(const vector<string> &cameras,
   }
 }
 
+void View::generateIndexes(const vector<int> &camera_ids,
+                           vector<int> *idx) const
+{
+  idx->clear();
+  for (size_t i = 0; i < camera_ids.size(); i++)
+    idx->push_back(getCamIdx(camera_ids[i]));
+}
+
 bool View::triangulation(const vector<string>   &cameras,
                          const vector<double *> &camera_rot,
                          const vector<double *> &camera_trans)
 {
-  updateView();
-  updateRobot();
+  // clear triangulated points
+  triang_pts_3D_.clear();
 
-//   // clear triangulated points
-//   triang_pts_3D_.clear();
 //
 //   int npoints = board_model_pts_3D_.size();
 //   for (size_t j = 0; j < npoints; j++)
@@ -192,10 +344,9 @@ bool View::triangulation(const vector<string>   &cameras,
   if (idx.size() < 2)
     return false;
 
-  KDL::Frame T0 = pose_father_[idx[0]]*pose_rel_[idx[0]];
-
-  // get projection matrixes
-  vector<Matx34d> Ps;
+  // get projection matrixes (and measurements) of the visible cameras
+  vector<Matx34d>  Ps;
+  vector<Points2D> points_2d;
   for (size_t i = 0; i < idx.size(); i++)
   {
     int cam_idx = idx[i];
@@ -226,41 +377,14 @@ bool View::triangulation(const vector<string>   &cameras,
 
     // add to vector
     Ps.push_back(P);
+    points_2d.push_back(measured_pts_2D_[cam_idx]);
   }
 
+  if (Ps.empty())
+    return false;
 
-  // j: point
-  // i: visible seleted camera
-  //! create an vector the point correspondences in views where there is data
-  for (size_t j = 0; j < board_model_pts_3D_.size(); j++)
-  {
-    vector<Point2d> points_2d;
-    points_2d.clear();
-
-    for (size_t i = 0; i < idx.size(); i++)
-    {
-      int cam_idx = idx[i];
-      if (cam_idx < 0) // not visible
-        continue;
-
-      vector<Point2d> &measured_pts_2D = measured_pts_2D_[cam_idx];
-      Point2d current_point_2d = measured_pts_2D[j];
-      points_2d.push_back(current_point_2d);
-    }
-
-    if (points_2d.empty())
-      continue;
-
-    Vec3d X;
-    Mat_<double> x = Mat(points_2d);
-
-    // transpose
-    Mat_<double> y;
-    cv::transpose(x,y);
-
-    nViewTriangulate(y, Ps, X);
-    triang_pts_3D_.push_back(X);
-  }
+  //! triangulate all the board corners at once
+  nViewTriangulate(points_2d, Ps, &triang_pts_3D_);
 
   if( !triang_pts_3D_.empty() )
     calc_error();
@@ -280,6 +404,31 @@ void setZero(vector<double> &v, size_t size)
 
 void View::calc_error()
 {
+  if (context_ == 0)
+  {
+    ROS_ERROR("View without context, use View::setContext()");
+    return;
+  }
+
+  const vector<string>   &cameras      = context_->cameras;
+  const vector<double *> &camera_rot   = context_->camera_rot;
+  const vector<double *> &camera_trans = context_->camera_trans;
+
+  // camera parameters used by the error (STAGE_ERROR key)
+  vector<double> params;
+  for (size_t i = 0; i < cameras.size() && i < camera_rot.size() && i < camera_trans.size(); i++)
+  {
+    params.insert(params.end(), camera_rot[i], camera_rot[i] + 4);
+    params.insert(params.end(), camera_trans[i], camera_trans[i] + 3);
+  }
+
+  if ((valid_ & STAGE_ERROR) && params == error_params_ && cameras == error_cameras_)
+    return;
+
+  error_params_.swap(params);
+  error_cameras_ = cameras;
+  valid_ |= STAGE_ERROR;
+
   size_t size = cam_model_.size();
   proj_pts_2D_.clear();
   triang_error_.clear();
@@ -305,7 +454,7 @@ void View::calc_error()
 
   // generate idx mapping
   vector<int> idx;
-  generateIndexes(cameras_, &idx);
+  generateIndexes(context_->camera_ids, &idx);
 
   // not enougth visible cameras for triangulation
   if (idx.size() < 2)
@@ -321,13 +470,13 @@ void View::calc_error()
 
     // get rotation
     Matx33d R;
-    deserialize(camera_rot_[i], &R);
+    deserialize(camera_rot[i], &R);
     Mat rvec;
     Rodrigues(R, rvec);
 
     // get translation
     Vec3d tvec;
-    deserialize(camera_trans_[i], &tvec);
+    deserialize(camera_trans[i], &tvec);
 //
 //
 //       KDL::Frame Ti = pose_father_[i]*pose_rel_[i];
@@ -355,7 +504,7 @@ void View::calc_error()
 //       PRINT(tvec_[i])
     indivual_error_.push_back(indivual_error);
     proj_pts_2D_.push_back(expected_pts_2D);
-    triang_error_.push_back(err / board_model_pts_3D_.size());
+    triang_error_.push_back(err / target_->corners.size());
   }
 
 //   }
@@ -363,11 +512,21 @@ void View::calc_error()
 //   PRINT(triang_error_ )
 }
 
-void View::generateCorners()
+bool View::generateCorners()
 {
-  ChessBoard cb;
-  getCheckboardSize(msg_->target_id, &cb);
-  cb.generateCorners(&board_model_pts_3D_);
+  const TargetRegistry *target_registry = &default_target_registry;
+  if (context_ != 0 && context_->target_registry != 0)
+    target_registry = context_->target_registry;
+
+  target_ = target_registry->get(msg_->target_id);
+  if (!target_)
+  {
+    ROS_ERROR("Sample %s: unknown target %s, view skipped",
+              msg_->sample_id.c_str(), msg_->target_id.c_str());
+    return false;
+  }
+
+  return true;
 }
 
 void View::getCameraModels()
@@ -421,31 +580,99 @@ void View::getMeasurements()
   }
 }
 
+void View::resizeCbPoses()
+{
+  size_t size = measured_pts_2D_.size();
+  rvec_.assign(size, Mat());
+  tvec_.assign(size, Mat());
+  expected_pts_2D_.assign(size, Points2D());
+  error_.assign(size, 0.0);
+  board_transformed_pts_3D_.assign(size, Mat());
+
+  // new (empty) poses, calc_error() has to be computed again
+  valid_ &= ~(STAGE_POSES | STAGE_ERROR);
+}
+
+bool View::hasCbPoses() const
+{
+  return (valid_ & STAGE_POSES) != 0;
+}
+
+bool View::checkCbPoses()
+{
+  valid_ &= ~STAGE_POSES;
+  if (!(valid_ & STAGE_MEASUREMENTS) || rvec_.size() != measured_pts_2D_.size())
+    return false;
+
+  for (size_t i = 0; i < rvec_.size(); i++)
+  {
+    if (rvec_[i].empty() || tvec_[i].empty())
+      return false;
+  }
+
+  valid_ |= STAGE_POSES;
+  return true;
+}
+
 void View::findCbPoses()
 {
-  // clean vectors
-  rvec_.clear();
-  tvec_.clear();
-  expected_pts_2D_.clear();
-  error_.clear();
+  resizeCbPoses();
 
   size_t size = measured_pts_2D_.size();
   for (size_t i = 0; i < size; i++)
-  {
-    Mat rvec, tvec;
-    Points2D expected_pts_2D;
-    Mat D; // empty for rectified cameras
-    // Mat D = cam_model.distortionCoeffs();  // for non-rectified cameras
-    double error = findChessboardPose(board_model_pts_3D_, measured_pts_2D_[i],
-                                      cam_model_[i].intrinsicMatrix(), D,
-                                      rvec, tvec, expected_pts_2D);
+    findCbPose(i);
 
-    // add to vector
-    rvec_.push_back(rvec);
-    tvec_.push_back(tvec);
-    expected_pts_2D_.push_back(expected_pts_2D);
-    error_.push_back(error);
+  checkCbPoses();
+}
+
+void View::findCbPose(size_t i, int method,
+                      const Mat &rvec_guess, const Mat &tvec_guess)
+{
+  Mat rvec, tvec;
+  bool use_guess = !rvec_guess.empty() && !tvec_guess.empty();
+  if (use_guess)
+  {
+    rvec = rvec_guess.clone();
+    tvec = tvec_guess.clone();
   }
+
+  Mat D; // empty for rectified cameras
+  // Mat D = cam_model.distortionCoeffs();  // for non-rectified cameras
+  error_[i] = findChessboardPose(target_->corners, measured_pts_2D_[i],
+                                 cam_model_[i].intrinsicMatrix(), D,
+                                 rvec, tvec, expected_pts_2D_[i],
+                                 method, use_guess);
+  rvec_[i] = rvec;
+  tvec_[i] = tvec;
+
+  // Transform points
+  transform3DPoints(Mat(target_->corners), rvec, tvec,
+                    &board_transformed_pts_3D_[i]);
+}
+
+bool View::predictCbPose(size_t from, size_t to, Mat *rvec, Mat *tvec) const
+{
+  if (from >= rvec_.size() || to >= rvec_.size() || rvec_[from].empty() ||
+      from >= pose_rel_.size() || to >= pose_rel_.size())
+    return false;
+
+  // camera -> root
+  KDL::Frame F_from = pose_father_[from] * pose_rel_[from];
+  KDL::Frame F_to   = pose_father_[to]   * pose_rel_[to];
+
+  // board -> camera 'from'
+  Mat R;
+  Rodrigues(rvec_[from], R);
+  KDL::Frame board_from;
+  cv2kdl(R, tvec_[from], &board_from);
+
+  // board -> camera 'to'
+  KDL::Frame board_to = F_to.Inverse() * F_from * board_from;
+
+  Mat R_to;
+  kdl2cv(board_to, R_to, *tvec);
+  Rodrigues(R_to, *rvec);
+  return true;
 }
 
 // void View::triangulation()
@@ -455,12 +682,14 @@ void View::findCbPoses()
 
 void View::getTransformedPoints()
 {
+  board_transformed_pts_3D_.clear();
+
   size_t size = cam_model_.size();
   for (size_t i = 0; i < size; i++)
   {
     // Transform points
     Mat board_transformed_pts_3D;
-    transform3DPoints(Mat(board_model_pts_3D_),
+    transform3DPoints(Mat(target_->corners),
                       rvec_[i],
                       tvec_[i],
                       &board_transformed_pts_3D);
@@ -474,7 +703,7 @@ void View::getFrameNames()
 {
   frame_name_.clear();
 
-  frame_id_.clear();        // frame_name -> frame_id_
+  frame_ids_.clear();       // frame_name -> frame id (context frames)
   camera_to_frame_.clear(); // camera_ids -> frame_name
 
   for (size_t i = 0; i < msg_->M_cam.size(); i++)
@@ -510,40 +739,66 @@ void View::getFrameNames()
     frame_name_.push_back(current_frame);
 
     // generate maps
-    frame_id_[current_frame] = i;
+    frame_ids_.push_back(contextFrames(context_).intern(current_frame));
     camera_to_frame_[current_camera_id] = current_frame;
   }
+
+  // flat lookup by frame id
+  int num_frames = 0;
+  for (size_t i = 0; i < frame_ids_.size(); i++)
+    num_frames = max(num_frames, frame_ids_[i] + 1);
+
+  cam_idx_.assign(num_frames, -1);
+  visibility_.clear();
+  visibility_.resize(num_frames);
+  for (size_t i = 0; i < frame_ids_.size(); i++)
+  {
+    cam_idx_[frame_ids_[i]] = i;
+    visibility_.set(frame_ids_[i]);
+  }
 }
 
-void View::getPoses()
+void View::getPoses(RobotState *robot_state)
 {
+  pose_rel_.clear();
+  pose_father_.clear();
+
   for (size_t i = 0; i < msg_->M_cam.size(); i++)
   {
-    // get relative pose (camera to its father)
-    KDL::Frame pose;
-    robot_state_->getRelativePose(frame_name_[i], &pose);
-    pose_rel_.push_back(pose);
-    const string link_root = robot_state_->getLinkRoot(frame_name_[i]);
+    KDL::Frame pose, pose_f;
+    int link_idx = robot_state->getLinkIndex(frame_name_[i]);
+    if (link_idx > 0)
+    {
+      // get relative pose (camera to its father)
+      robot_state->getRelativePose(link_idx, &pose);
 
-    // get father pose (father to tree root)
-    KDL::Frame pose_f;
-    robot_state_->getFK(link_root, &pose_f);
+      // get father pose (father to tree root)
+      robot_state->getFK(robot_state->getParentIndex(link_idx), &pose_f);
+    }
+    else
+      ROS_ERROR("Link name could not been found");
+
+    pose_rel_.push_back(pose);
     pose_father_.push_back(pose_f);
   }
 }
 
 void View::output()
 {
-  for (size_t i = 0; i < cameras_.size(); i++)
-    PRINT(measured_pts_2D_[getCamIdx(cameras_[i])])
+  if (context_ == 0)
+    return;
 
-  for (size_t i = 0; i < cameras_.size(); i++)
+  const vector<string> &cameras = context_->cameras;
+  for (size_t i = 0; i < cameras.size(); i++)
+    PRINT(measured_pts_2D_[getCamIdx(cameras[i])])
+
+  for (size_t i = 0; i < cameras.size(); i++)
     PRINT(proj_pts_2D_[i])
 
-  for (size_t i = 0; i < cameras_.size(); i++)
+  for (size_t i = 0; i < cameras.size(); i++)
     PRINT(triang_error_[i])
 
-  for (size_t i = 0; i < cameras_.size(); i++)
+  for (size_t i = 0; i < cameras.size(); i++)
     PRINT(indivual_error_[i])
 }
 
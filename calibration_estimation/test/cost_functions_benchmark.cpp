@@ -0,0 +1,188 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+/**
+ * Benchmark: ReprojectionErrorAnalytic vs ReprojectionErrorWithQuaternions
+ * (AutoDiff). It reports the time for evaluating residuals + jacobians and
+ * for solving a synthetic problem (6 cameras, 7x6 board).
+ *
+ * usage: cost_functions_benchmark [num_views]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include <ros/time.h>
+
+#include "cost_functions.h"
+
+using namespace std;
+using namespace calib;
+
+static double uniform(double min, double max)
+{
+  return min + (max - min) * (rand() / double(RAND_MAX));
+}
+
+/// \brief Time (seconds) to evaluate 'cost_functions' 'repetitions' times
+static double timeEvaluate(const vector<ceres::CostFunction *> &cost_functions,
+                           double const* const* parameters,
+                           int repetitions)
+{
+  double residuals[2];
+  double J_rot[8], J_trans[6], J_point[6];
+  double *jacobians[3] = { J_rot, J_trans, J_point };
+
+  ros::WallTime start = ros::WallTime::now();
+  for (int r = 0; r < repetitions; r++)
+    for (size_t i = 0; i < cost_functions.size(); i++)
+      cost_functions[i]->Evaluate(parameters, residuals, jacobians);
+
+  return (ros::WallTime::now() - start).toSec();
+}
+
+/// \brief Time (seconds) to solve a synthetic calibration problem
+static double timeSolve(bool analytic, int num_views, int num_cameras, int num_points)
+{
+  srand(0);
+
+  // cameras: first one is [I|0], the rest are perturbed
+  vector<double> camera_rot(4 * num_cameras), camera_trans(3 * num_cameras);
+  for (int i = 0; i < num_cameras; i++)
+  {
+    double *q = &camera_rot[4*i];
+    q[0] = 1.0;
+    q[1] = q[2] = q[3] = (i == 0) ? 0.0 : uniform(-0.02, 0.02);
+
+    double *t = &camera_trans[3*i];
+    t[0] = (i == 0) ? 0.0 : uniform(-0.2, 0.2);
+    t[1] = (i == 0) ? 0.0 : uniform(-0.05, 0.05);
+    t[2] = (i == 0) ? 0.0 : uniform(-0.05, 0.05);
+  }
+
+  // points (board corners in front of the cameras) + noisy observations
+  vector<double> points(3 * num_views * num_points);
+  ceres::Problem problem;
+  for (int v = 0; v < num_views; v++)
+  {
+    for (int j = 0; j < num_points; j++)
+    {
+      double *X = &points[3 * (v * num_points + j)];
+      X[0] = uniform(-0.5, 0.5);
+      X[1] = uniform(-0.4, 0.4);
+      X[2] = uniform( 1.5, 3.0);
+
+      for (int i = 0; i < num_cameras; i++)
+      {
+        double u = 525.0 * X[0] / X[2] + 320.0 + uniform(-0.5, 0.5);
+        double w = 525.0 * X[1] / X[2] + 240.0 + uniform(-0.5, 0.5);
+
+        ceres::CostFunction *cost_function;
+        if (analytic)
+          cost_function = ReprojectionErrorAnalytic::Create(u, w, 525, 525, 320, 240);
+        else
+          cost_function = ReprojectionErrorWithQuaternions::Create(u, w, 525, 525, 320, 240);
+
+        problem.AddResidualBlock(cost_function, NULL,
+                                 &camera_rot[4*i], &camera_trans[3*i], X);
+      }
+    }
+  }
+  problem.SetParameterBlockConstant(&camera_rot[0]);
+  problem.SetParameterBlockConstant(&camera_trans[0]);
+
+  ceres::Solver::Options options;
+  options.linear_solver_type = ceres::DENSE_SCHUR;
+  options.max_num_iterations = 20;
+  options.minimizer_progress_to_stdout = false;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(options, &problem, &summary);
+
+  return summary.total_time_in_seconds;
+}
+
+int main(int argc, char **argv)
+{
+  int num_views   = (argc > 1) ? atoi(argv[1]) : 100;
+  int num_cameras = 6;
+  int num_points  = 7 * 6;
+
+  //! Jacobian evaluation
+  const int num_residuals = 10000;
+  const int repetitions   = 50;
+
+  double q[4] = { 0.99, 0.05, -0.03, 0.02 };
+  double t[3] = { 0.1, -0.05, 0.02 };
+  double X[3] = { 0.2, 0.1, 2.0 };
+  const double *parameters[3] = { q, t, X };
+
+  vector<ceres::CostFunction *> autodiff, analytic;
+  for (int i = 0; i < num_residuals; i++)
+  {
+    double u = uniform(0, 640), w = uniform(0, 480);
+    autodiff.push_back(ReprojectionErrorWithQuaternions::Create(u, w, 525, 525, 320, 240));
+    analytic.push_back(ReprojectionErrorAnalytic::Create(u, w, 525, 525, 320, 240));
+  }
+
+  double t_autodiff = timeEvaluate(autodiff, parameters, repetitions);
+  double t_analytic = timeEvaluate(analytic, parameters, repetitions);
+
+  printf("Evaluate (%d residual blocks x %d, with jacobians)\n", num_residuals, repetitions);
+  printf("  AutoDiff: %8.4f s\n", t_autodiff);
+  printf("  Analytic: %8.4f s\n", t_analytic);
+  printf("  Speedup:  %8.2fx\n\n", t_autodiff / t_analytic);
+
+  for (int i = 0; i < num_residuals; i++)
+  {
+    delete autodiff[i];
+    delete analytic[i];
+  }
+
+  //! Full solve
+  double s_autodiff = timeSolve(false, num_views, num_cameras, num_points);
+  double s_analytic = timeSolve(true,  num_views, num_cameras, num_points);
+
+  printf("Solve (%d views, %d cameras, %d points per view)\n", num_views, num_cameras, num_points);
+  printf("  AutoDiff: %8.4f s\n", s_autodiff);
+  printf("  Analytic: %8.4f s\n", s_analytic);
+  printf("  Speedup:  %8.2fx\n", s_autodiff / s_analytic);
+
+  return 0;
+}
@@ -0,0 +1,432 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "cost_functions.h"
+
+using namespace calib;
+
+static const double eps = 1e-9;
+
+// uniform random number in [min, max]
+static double uniform(double min, double max)
+{
+  return min + (max - min) * (rand() / double(RAND_MAX));
+}
+
+// random camera ([R|t]) and point in front of the camera
+static void randomParameters(double q[4], double t[3], double X[3])
+{
+  for (int i = 0; i < 4; i++)
+    q[i] = uniform(-1.0, 1.0);
+
+  t[0] = uniform(-0.5, 0.5);
+  t[1] = uniform(-0.5, 0.5);
+  t[2] = uniform( 2.0, 4.0);
+
+  for (int i = 0; i < 3; i++)
+    X[i] = uniform(-0.5, 0.5);
+}
+
+// evaluate both cost functions and compare residuals and jacobians
+static void compare(const ceres::CostFunction &analytic,
+                    const ceres::CostFunction &autodiff,
+                    double const* const* parameters,
+                    bool with_point_jacobian = true)
+{
+  double r_analytic[2], r_autodiff[2];
+  double J_analytic[3][8], J_autodiff[3][8];
+  double *jac_analytic[3] = { J_analytic[0], J_analytic[1], J_analytic[2] };
+  double *jac_autodiff[3] = { J_autodiff[0], J_autodiff[1], J_autodiff[2] };
+
+  // constant point block (ceres passes NULL for constant blocks)
+  if (!with_point_jacobian)
+  {
+    jac_analytic[2] = NULL;
+    jac_autodiff[2] = NULL;
+  }
+
+  ASSERT_TRUE(analytic.Evaluate(parameters, r_analytic, jac_analytic));
+  ASSERT_TRUE(autodiff.Evaluate(parameters, r_autodiff, jac_autodiff));
+
+  EXPECT_NEAR(r_analytic[0], r_autodiff[0], eps);
+  EXPECT_NEAR(r_analytic[1], r_autodiff[1], eps);
+
+  const int block_size[3] = { 4, 3, 3 };
+  for (int b = 0; b < 3; b++)
+  {
+    if (jac_analytic[b] == NULL)
+      continue;
+
+    for (int i = 0; i < 2 * block_size[b]; i++)
+    {
+      double tol = eps * std::max(1.0, std::abs(J_autodiff[b][i]));
+      EXPECT_NEAR(J_analytic[b][i], J_autodiff[b][i], tol)
+        << "block: " << b << ", entry: " << i;
+    }
+  }
+}
+
+TEST(ReprojectionErrorAnalytic, matchesAutoDiff)
+{
+  srand(0);
+  for (int n = 0; n < 100; n++)
+  {
+    double q[4], t[3], X[3];
+    randomParameters(q, t, X);
+
+    // normalized quaternion
+    double norm = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    for (int i = 0; i < 4; i++)
+      q[i] /= norm;
+
+    double observed_x = uniform(0, 640);
+    double observed_y = uniform(0, 480);
+
+    ceres::CostFunction *analytic =
+        ReprojectionErrorAnalytic::Create(observed_x, observed_y, 525, 520, 320, 240);
+    ceres::CostFunction *autodiff =
+        ReprojectionErrorWithQuaternions::Create(observed_x, observed_y, 525, 520, 320, 240);
+
+    const double *parameters[3] = { q, t, X };
+    compare(*analytic, *autodiff, parameters);
+
+    delete analytic;
+    delete autodiff;
+  }
+}
+
+TEST(ReprojectionErrorAnalytic, nonUnitQuaternion)
+{
+  srand(1);
+  for (int n = 0; n < 100; n++)
+  {
+    double q[4], t[3], X[3];
+    randomParameters(q, t, X);
+
+    // scaled quaternion (the optimizer does not keep it unit)
+    double scale = uniform(0.5, 2.0);
+    for (int i = 0; i < 4; i++)
+      q[i] *= scale;
+
+    ceres::CostFunction *analytic =
+        ReprojectionErrorAnalytic::Create(100, 200, 1000, 1000, 512, 384);
+    ceres::CostFunction *autodiff =
+        ReprojectionErrorWithQuaternions::Create(100, 200, 1000, 1000, 512, 384);
+
+    const double *parameters[3] = { q, t, X };
+    compare(*analytic, *autodiff, parameters);
+
+    delete analytic;
+    delete autodiff;
+  }
+}
+
+TEST(ReprojectionErrorAnalytic, constantPoint)
+{
+  srand(2);
+  double q[4], t[3], X[3];
+  randomParameters(q, t, X);
+
+  ceres::CostFunction *analytic =
+      ReprojectionErrorAnalytic::Create(320, 240, 525, 525, 320, 240);
+  ceres::CostFunction *autodiff =
+      ReprojectionErrorWithQuaternions::Create(320, 240, 525, 525, 320, 240);
+
+  const double *parameters[3] = { q, t, X };
+  compare(*analytic, *autodiff, parameters, false);
+
+  // only residuals
+  double r[2];
+  EXPECT_TRUE(analytic->Evaluate(parameters, r, NULL));
+
+  delete analytic;
+  delete autodiff;
+}
+
+TEST(BoardPoseReprojectionError, matchesTransformedPoint)
+{
+  srand(3);
+  for (int k = 0; k < 20; k++)
+  {
+    double q[4], t[3], corner[3];
+    randomParameters(q, t, corner);
+
+    // board pose: identity rotation + translation, then a random one
+    double board_q[4] = { 1, 0, 0, 0 };
+    double board_t[3] = { uniform(-0.2, 0.2), uniform(-0.2, 0.2), uniform(0.5, 1.0) };
+    if (k > 0)
+      for (int i = 0; i < 4; i++)
+        board_q[i] = uniform(-1.0, 1.0);
+
+    // corner in the reference camera frame
+    double X[3];
+    ceres::QuaternionRotatePoint(board_q, corner, X);
+    for (int i = 0; i < 3; i++)
+      X[i] += board_t[i];
+
+    ceres::CostFunction *board =
+        BoardPoseReprojectionError::Create(330, 250, 525, 520, 320, 240, corner);
+    ceres::CostFunction *point =
+        ReprojectionErrorWithQuaternions::Create(330, 250, 525, 520, 320, 240);
+
+    const double *board_parameters[4] = { q, t, board_q, board_t };
+    const double *point_parameters[3] = { q, t, X };
+
+    double r_board[2], r_point[2];
+    ASSERT_TRUE(board->Evaluate(board_parameters, r_board, NULL));
+    ASSERT_TRUE(point->Evaluate(point_parameters, r_point, NULL));
+
+    EXPECT_NEAR(r_board[0], r_point[0], eps);
+    EXPECT_NEAR(r_board[1], r_point[1], eps);
+
+    delete board;
+    delete point;
+  }
+}
+
+TEST(BoardViewReprojectionError, matchesPerCorner)
+{
+  srand(4);
+  const int width = 4, height = 5, num_corners = width * height;
+
+  double q[4], t[3], X[3];
+  randomParameters(q, t, X);
+  double board_q[4] = { 1.0, uniform(-0.2, 0.2), uniform(-0.2, 0.2), uniform(-0.2, 0.2) };
+  double board_t[3] = { uniform(-0.2, 0.2), uniform(-0.2, 0.2), uniform(0.5, 1.0) };
+
+  // board model and observations
+  double corners[3*num_corners], observed[2*num_corners];
+  for (int j = 0; j < num_corners; j++)
+  {
+    corners[3*j]   = 0.0245 * (j % width);
+    corners[3*j+1] = 0.0245 * (j / width);
+    corners[3*j+2] = 0.0;
+    observed[2*j]   = uniform(0, 640);
+    observed[2*j+1] = uniform(0, 480);
+  }
+
+  ceres::CostFunction *fused =
+      createBoardViewReprojectionError(width, height, observed, 525, 520, 320, 240, corners);
+  ASSERT_TRUE(fused != NULL);
+  EXPECT_TRUE(createBoardViewReprojectionError(5, 5, observed, 525, 520, 320, 240, corners) == NULL);
+
+  const double *parameters[4] = { q, t, board_q, board_t };
+  const int sizes[4] = { 4, 3, 4, 3 };
+
+  double r_fused[2*num_corners];
+  double J_fused[4][2*num_corners*4];
+  double *jac_fused[4] = { J_fused[0], J_fused[1], J_fused[2], J_fused[3] };
+  ASSERT_TRUE(fused->Evaluate(parameters, r_fused, jac_fused));
+
+  for (int j = 0; j < num_corners; j++)
+  {
+    ceres::CostFunction *corner =
+        BoardPoseReprojectionError::Create(observed[2*j], observed[2*j+1],
+                                           525, 520, 320, 240, &corners[3*j]);
+
+    double r[2], J[4][2*4];
+    double *jac[4] = { J[0], J[1], J[2], J[3] };
+    ASSERT_TRUE(corner->Evaluate(parameters, r, jac));
+
+    // rows 2j, 2j+1 of the fused block
+    for (int k = 0; k < 2; k++)
+    {
+      EXPECT_NEAR(r[k], r_fused[2*j+k], eps);
+      for (int b = 0; b < 4; b++)
+        for (int c = 0; c < sizes[b]; c++)
+          EXPECT_NEAR(J[b][k*sizes[b] + c], J_fused[b][(2*j+k)*sizes[b] + c], 1e-6);
+    }
+
+    delete corner;
+  }
+
+  delete fused;
+}
+
+// random fixed transform (row-major rotation, translation)
+static void randomFrame(double R[9], double t[3])
+{
+  double q[4], X[3];
+  randomParameters(q, t, X);
+  ceres::QuaternionToRotation(q, R);
+}
+
+// chain: fixed, revolute, fixed, prismatic, fixed (offset blocks 0 and 1)
+static void randomChain(KinematicChain *chain)
+{
+  const double axes[2][3] = { { 0.0, 0.0, 1.0 }, { 0.6, 0.0, 0.8 } };
+
+  chain->joints.resize(2);
+  for (int k = 0; k < 2; k++)
+  {
+    ChainJoint &joint = chain->joints[k];
+    randomFrame(joint.rotation, joint.translation);
+    for (int i = 0; i < 3; i++)
+      joint.axis[i] = axes[k][i];
+    joint.prismatic = (k == 1);
+    joint.position  = uniform(-1.0, 1.0);
+    joint.offset    = k;
+  }
+  randomFrame(chain->tip_rotation, chain->tip_translation);
+}
+
+TEST(ChainReprojectionError, matchesBoardPoseWithoutJoints)
+{
+  srand(5);
+  const int num_corners = 6;
+
+  double q[4], t[3], X[3];
+  randomParameters(q, t, X);
+  double board_q[4] = { 1.0, uniform(-0.2, 0.2), uniform(-0.2, 0.2), uniform(-0.2, 0.2) };
+  double board_t[3] = { uniform(-0.2, 0.2), uniform(-0.2, 0.2), uniform(0.5, 1.0) };
+
+  std::vector<double> corners(3*num_corners), observed(2*num_corners);
+  for (int j = 0; j < num_corners; j++)
+  {
+    corners[3*j]   = 0.1 * (j % 3);
+    corners[3*j+1] = 0.1 * (j / 3);
+    corners[3*j+2] = 0.0;
+    observed[2*j]   = uniform(0, 640);
+    observed[2*j+1] = uniform(0, 480);
+  }
+
+  // identity chains: the target link is camera 0
+  KinematicChain identity;
+  for (int k = 0; k < 9; k++)
+    identity.tip_rotation[k] = (k % 4 == 0) ? 1.0 : 0.0;
+  identity.tip_translation[0] = identity.tip_translation[1] = identity.tip_translation[2] = 0.0;
+
+  ceres::CostFunction *chain =
+      ChainReprojectionError::Create(ChainReprojectionError(observed, corners, 525, 520, 320, 240,
+                                                            identity, identity), 0);
+
+  const double *parameters[4] = { q, t, board_q, board_t };
+  std::vector<double> r_chain(2*num_corners);
+  ASSERT_TRUE(chain->Evaluate(parameters, &r_chain[0], NULL));
+
+  for (int j = 0; j < num_corners; j++)
+  {
+    ceres::CostFunction *corner =
+        BoardPoseReprojectionError::Create(observed[2*j], observed[2*j+1],
+                                           525, 520, 320, 240, &corners[3*j]);
+    double r[2];
+    ASSERT_TRUE(corner->Evaluate(parameters, r, NULL));
+    EXPECT_NEAR(r[0], r_chain[2*j], eps);
+    EXPECT_NEAR(r[1], r_chain[2*j+1], eps);
+    delete corner;
+  }
+
+  delete chain;
+}
+
+TEST(ChainReprojectionError, jointOffsets)
+{
+  srand(6);
+
+  // camera i = camera 0
+  double q[4] = { 1.0, 0.0, 0.0, 0.0 };
+  double t[3] = { 0.0, 0.0, 0.0 };
+  double board_q[4] = { 1.0, 0.1, -0.1, 0.05 };
+  double board_t[3] = { 0.05, -0.02, 0.1 };
+
+  std::vector<double> corners(3, 0.1), observed(2);
+  observed[0] = 330;
+  observed[1] = 250;
+
+  // board on a two joints chain, camera 0 on the same chain (no offsets)
+  // 3 meters behind the target link
+  KinematicChain camera_chain, target_chain;
+  randomChain(&target_chain);
+  camera_chain = target_chain;
+  for (int k = 0; k < 2; k++)
+    camera_chain.joints[k].offset = -1;
+  for (int r = 0; r < 3; r++)
+    camera_chain.tip_translation[r] -= 3.0 * camera_chain.tip_rotation[3*r+2];
+
+  const ChainReprojectionError error(observed, corners, 525, 520, 320, 240,
+                                     camera_chain, target_chain);
+  ceres::CostFunction *cost = ChainReprojectionError::Create(error, 2);
+
+  // an offset is the same as measuring q + offset
+  double offsets[2] = { 0.05, -0.01 };
+  const double *parameters[6] = { q, t, board_q, board_t, &offsets[0], &offsets[1] };
+
+  double r[2], J_offset[2][2];
+  double *jacobians[6] = { NULL, NULL, NULL, NULL, J_offset[0], J_offset[1] };
+  ASSERT_TRUE(cost->Evaluate(parameters, r, jacobians));
+
+  ChainReprojectionError measured = error;
+  for (int k = 0; k < 2; k++)
+  {
+    measured.target_chain.joints[k].position += offsets[k];
+    measured.target_chain.joints[k].offset = -1;
+  }
+  ceres::CostFunction *cost_measured = ChainReprojectionError::Create(measured, 0);
+
+  double r_measured[2];
+  ASSERT_TRUE(cost_measured->Evaluate(parameters, r_measured, NULL));
+  EXPECT_NEAR(r[0], r_measured[0], eps);
+  EXPECT_NEAR(r[1], r_measured[1], eps);
+
+  // exact derivatives (central differences as reference)
+  const double h = 1e-6;
+  for (int k = 0; k < 2; k++)
+  {
+    double r_plus[2], r_minus[2];
+    offsets[k] += h;
+    ASSERT_TRUE(cost->Evaluate(parameters, r_plus, NULL));
+    offsets[k] -= 2*h;
+    ASSERT_TRUE(cost->Evaluate(parameters, r_minus, NULL));
+    offsets[k] += h;
+
+    for (int i = 0; i < 2; i++)
+      EXPECT_NEAR((r_plus[i] - r_minus[i]) / (2*h), J_offset[k][i], 1e-4);
+  }
+
+  delete cost;
+  delete cost_measured;
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,181 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <map>
+
+#include "data.h"
+
+using namespace std;
+using namespace calib;
+
+/// \brief Message with the joints 'arm_joint' (arm chain, left out when it
+/// is zero) and 'head_pan', 'head_tilt' (head chain)
+static Msg measurement(double arm, double pan, double tilt)
+{
+  Msg msg(new calibration_msgs::RobotMeasurement());
+
+  if (arm != 0.0)
+  {
+    calibration_msgs::ChainMeasurement chain;
+    chain.chain_id = "arm_chain";
+    chain.chain_state.name.push_back("arm_joint");
+    chain.chain_state.position.push_back(arm);
+    msg->M_chain.push_back(chain);
+  }
+
+  calibration_msgs::ChainMeasurement chain;
+  chain.chain_id = "head_chain";
+  chain.chain_state.name.push_back("head_pan");
+  chain.chain_state.name.push_back("head_tilt");
+  chain.chain_state.position.push_back(pan);
+  chain.chain_state.position.push_back(tilt);
+  msg->M_chain.push_back(chain);
+  return msg;
+}
+
+/// \brief Number of joints that differ between two messages (missing = 0)
+static int changedJoints(const Msg &a, const Msg &b)
+{
+  map<string, double> qa, qb;
+  for (size_t c = 0; c < a->M_chain.size(); c++)
+    for (size_t j = 0; j < a->M_chain[c].chain_state.name.size(); j++)
+      qa[a->M_chain[c].chain_state.name[j]] = a->M_chain[c].chain_state.position[j];
+  for (size_t c = 0; c < b->M_chain.size(); c++)
+    for (size_t j = 0; j < b->M_chain[c].chain_state.name.size(); j++)
+      qb[b->M_chain[c].chain_state.name[j]] = b->M_chain[c].chain_state.position[j];
+
+  const char *joints[] = { "arm_joint", "head_pan", "head_tilt" };
+  int changes = 0;
+  for (int j = 0; j < 3; j++)
+    if (fabs(qa[joints[j]] - qb[joints[j]]) > 1e-9)
+      changes++;
+  return changes;
+}
+
+/// \brief The corners of a cube in joint space, in an order where
+/// consecutive messages change 1 to 3 joints
+static vector<Msg> cubeMeasurements()
+{
+  double q[8][3] = { {0, 0, 0}, {0.5, 0.5, 0.5}, {0, 0.5, 0.5}, {0.5, 0, 0.5},
+                     {0, 0, 0.5}, {0.5, 0.5, 0}, {0, 0.5, 0}, {0.5, 0, 0} };
+  vector<Msg> msgs;
+  for (int k = 0; k < 8; k++)
+    msgs.push_back(measurement(q[k][0], q[k][1], q[k][2]));
+  return msgs;
+}
+
+TEST(JointSpaceOrder, fewestJoints)
+{
+  vector<Msg> msgs = cubeMeasurements();
+
+  int changes = 0;
+  for (size_t k = 1; k < msgs.size(); k++)
+    changes += changedJoints(msgs[k-1], msgs[k]);
+  EXPECT_EQ(changes, 13);
+
+  // a permutation starting at the first message, one joint per step
+  vector<size_t> order;
+  Data::jointSpaceOrder(msgs, &order);
+  ASSERT_EQ(order.size(), msgs.size());
+  EXPECT_EQ(order[0], 0u);
+
+  vector<char> seen(msgs.size(), 0);
+  for (size_t k = 0; k < order.size(); k++)
+  {
+    ASSERT_LT(order[k], msgs.size());
+    EXPECT_FALSE(seen[order[k]]);
+    seen[order[k]] = 1;
+  }
+
+  for (size_t k = 1; k < order.size(); k++)
+    EXPECT_EQ(changedJoints(msgs[order[k-1]], msgs[order[k]]), 1) << "step " << k;
+}
+
+TEST(JointSpaceOrder, tolerance)
+{
+  // view 2 moves two joints by 0.04, view 1 one joint by 0.4
+  vector<Msg> msgs;
+  msgs.push_back(measurement(0.0, 0.1, 0.2));
+  msgs.push_back(measurement(0.0, 0.1, 0.6));
+  msgs.push_back(measurement(0.0, 0.14, 0.24));
+
+  vector<size_t> order;
+  Data::jointSpaceOrder(msgs, &order);
+  ASSERT_EQ(order.size(), 3u);
+  EXPECT_EQ(order[1], 1u);
+  EXPECT_EQ(order[2], 2u);
+
+  // with a larger tolerance, view 2 does not change any joint
+  Data::jointSpaceOrder(msgs, &order, 0.05);
+  ASSERT_EQ(order.size(), 3u);
+  EXPECT_EQ(order[1], 2u);
+  EXPECT_EQ(order[2], 1u);
+}
+
+TEST(JointSpaceOrder, empty)
+{
+  vector<Msg> msgs;
+  vector<size_t> order(3, 0);
+  Data::jointSpaceOrder(msgs, &order);
+  EXPECT_TRUE(order.empty());
+}
+
+TEST(Data, processingOrder)
+{
+  vector<Msg> msgs = cubeMeasurements();
+  vector<size_t> order, expected;
+
+  // message order by default
+  Data data;
+  data.processingOrder(msgs, &order);
+  for (size_t k = 0; k < msgs.size(); k++)
+    expected.push_back(k);
+  EXPECT_EQ(order, expected);
+
+  data.setViewOrdering(true);
+  data.processingOrder(msgs, &order);
+  Data::jointSpaceOrder(msgs, &expected);
+  EXPECT_EQ(order, expected);
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
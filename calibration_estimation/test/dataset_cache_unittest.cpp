@@ -0,0 +1,316 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+
+#include "data.h"
+#include "dataset_cache.h"
+#include "robot_state.h"
+
+using namespace std;
+using namespace cv;
+using namespace calib;
+
+// two cameras on a moving head
+static const string urdf_string =
+  "<robot name='test'>"
+  "  <link name='base_link'/> <link name='head'/>"
+  "  <link name='camera_a'/> <link name='camera_b'/>"
+  "  <joint name='head_joint' type='revolute'>"
+  "    <parent link='base_link'/> <child link='head'/>"
+  "    <origin xyz='0 0 1.2' rpy='0 0 0'/> <axis xyz='0 0 1'/>"
+  "    <limit lower='-3' upper='3' effort='10' velocity='1'/>"
+  "  </joint>"
+  "  <joint name='camera_a_joint' type='fixed'>"
+  "    <parent link='head'/> <child link='camera_a'/>"
+  "    <origin xyz='0.1 0.05 0' rpy='-1.57 0 -1.57'/>"
+  "  </joint>"
+  "  <joint name='camera_b_joint' type='fixed'>"
+  "    <parent link='head'/> <child link='camera_b'/>"
+  "    <origin xyz='0.1 -0.05 0' rpy='-1.57 0 -1.57'/>"
+  "  </joint>"
+  "</robot>";
+
+static const double fx = 525.0, fy = 525.0, cx = 319.5, cy = 239.5;
+
+/// \brief Camera measurement of the PR2 large checkerboard (7x6) parallel to
+/// the image plane at t (camera frame)
+static calibration_msgs::CameraMeasurement cameraMeasurement(const string &frame,
+                                                            double tx, double ty, double tz)
+{
+  calibration_msgs::CameraMeasurement m;
+  m.camera_id = frame;
+  m.cam_info.header.frame_id = frame;
+  m.cam_info.width  = 640;
+  m.cam_info.height = 480;
+  m.cam_info.distortion_model = "plumb_bob";
+  m.cam_info.D.assign(5, 0.0);
+  double K[9]  = { fx, 0, cx,  0, fy, cy,  0, 0, 1 };
+  double R[9]  = { 1, 0, 0,  0, 1, 0,  0, 0, 1 };
+  double P[12] = { fx, 0, cx, 0,  0, fy, cy, 0,  0, 0, 1, 0 };
+  copy(K, K + 9,  m.cam_info.K.begin());
+  copy(R, R + 9,  m.cam_info.R.begin());
+  copy(P, P + 12, m.cam_info.P.begin());
+
+  for (int j = 0; j < 6; j++)
+  {
+    for (int i = 0; i < 7; i++)
+    {
+      geometry_msgs::Point pt;
+      pt.x = fx * (i * 0.108 + tx) / tz + cx;
+      pt.y = fy * (j * 0.108 + ty) / tz + cy;
+      pt.z = 0;
+      m.image_points.push_back(pt);
+    }
+  }
+  return m;
+}
+
+static Msg measurement(int k)
+{
+  Msg msg(new calibration_msgs::RobotMeasurement());
+  ostringstream id;
+  id << "sample_" << k;
+  msg->sample_id = id.str();
+  msg->target_id = "large_cb_7x6";
+
+  msg->M_cam.push_back(cameraMeasurement("camera_a", -0.3 + 0.05*k, -0.25, 1.5));
+  msg->M_cam.push_back(cameraMeasurement("camera_b", -0.2 + 0.05*k, -0.25, 1.6));
+
+  calibration_msgs::ChainMeasurement chain;
+  chain.chain_id = "head_chain";
+  chain.chain_state.name.push_back("head_joint");
+  chain.chain_state.position.push_back(0.1 * k);
+  msg->M_chain.push_back(chain);
+  return msg;
+}
+
+class DatasetCacheTest : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    ASSERT_TRUE(model_.initString(urdf_string));
+    robot_state_.initFromURDF(model_);
+
+    ostringstream ss;
+    ss << "/tmp/dataset_cache_unittest_" << getpid() << ".dataset";
+    filename_ = ss.str();
+
+    setUp(&data_);
+    for (int k = 0; k < 3; k++)
+      data_.addMeasurement(measurement(k));
+    ASSERT_EQ(data_.size(), 3u);
+  }
+
+  virtual void TearDown()
+  {
+    remove(filename_.c_str());
+  }
+
+  /// \brief Data with the same configuration as data_
+  void setUp(Data *data)
+  {
+    data->setRobotState(&robot_state_);
+    PoseInitializer pose_initializer;
+    pose_initializer.setNumThreads(1);
+    pose_initializer.setFKSeed(false);  // the board poses are not consistent with the FK
+    data->setPoseInitializer(pose_initializer);
+  }
+
+  /// \brief Replace the cache by its first 'size' bytes
+  void truncate(size_t size)
+  {
+    ifstream in(filename_.c_str(), ios::binary);
+    vector<char> content(size);
+    in.read(&content[0], size);
+    ASSERT_EQ(size_t(in.gcount()), size);
+    in.close();
+
+    ofstream out(filename_.c_str(), ios::binary | ios::trunc);
+    out.write(&content[0], size);
+  }
+
+  size_t fileSize()
+  {
+    ifstream in(filename_.c_str(), ios::binary | ios::ate);
+    return in.tellg();
+  }
+
+  urdf::Model model_;
+  RobotState  robot_state_;
+  Data        data_;
+  string      filename_;
+};
+
+TEST_F(DatasetCacheTest, roundTrip)
+{
+  DatasetCache cache(filename_);
+  ASSERT_TRUE(cache.write(42, data_));
+
+  Data data;
+  setUp(&data);
+  map<string, int> sample_id;
+  ASSERT_TRUE(cache.load(42, &data, &sample_id));
+  ASSERT_EQ(data.size(), data_.size());
+
+  for (size_t v = 0; v < data.size(); v++)
+  {
+    const View &expected = data_.view_[v];
+    const View &view = data.view_[v];
+    EXPECT_EQ(view.msg_->sample_id, expected.msg_->sample_id);
+    EXPECT_EQ(sample_id[view.msg_->sample_id], int(v));
+    EXPECT_TRUE(view.hasCbPoses());
+
+    ASSERT_EQ(view.rvec_.size(), 2u);
+    for (size_t i = 0; i < view.rvec_.size(); i++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        EXPECT_EQ(view.rvec_[i].at<double>(k), expected.rvec_[i].at<double>(k));
+        EXPECT_EQ(view.tvec_[i].at<double>(k), expected.tvec_[i].at<double>(k));
+      }
+      EXPECT_EQ(view.error_[i], expected.error_[i]);
+      ASSERT_EQ(view.expected_pts_2D_[i].size(), expected.expected_pts_2D_[i].size());
+      for (size_t j = 0; j < view.expected_pts_2D_[i].size(); j++)
+        EXPECT_EQ(view.expected_pts_2D_[i][j], expected.expected_pts_2D_[i][j]);
+    }
+  }
+
+  // the board was found where it was generated
+  EXPECT_NEAR(data.view_[0].tvec_[0].at<double>(2), 1.5, 1e-6);
+}
+
+TEST_F(DatasetCacheTest, bagHashMismatch)
+{
+  DatasetCache cache(filename_);
+  ASSERT_TRUE(cache.write(42, data_));
+
+  Data data;
+  setUp(&data);
+  EXPECT_FALSE(cache.load(43, &data));
+  EXPECT_EQ(data.size(), 0u);
+}
+
+TEST_F(DatasetCacheTest, configHashMismatch)
+{
+  DatasetCache cache(filename_);
+  ASSERT_TRUE(cache.write(42, data_));
+
+  // another PnP method
+  Data data;
+  setUp(&data);
+  data.pose_initializer_.setMethod(PNP_EPNP);
+  EXPECT_NE(DatasetCache::hashConfig(data), DatasetCache::hashConfig(data_));
+  EXPECT_FALSE(cache.load(42, &data));
+  EXPECT_EQ(data.size(), 0u);
+
+  // another target definition
+  TargetRegistry targets;
+  targets.add("large_cb_7x6", 7, 6, 0.1, 0.1);
+  Data data2;
+  setUp(&data2);
+  data2.setTargetRegistry(&targets);
+  EXPECT_FALSE(cache.load(42, &data2));
+  EXPECT_EQ(data2.size(), 0u);
+}
+
+TEST_F(DatasetCacheTest, truncated)
+{
+  DatasetCache cache(filename_);
+  ASSERT_TRUE(cache.write(42, data_));
+  size_t size = fileSize();
+
+  // inside the header, and inside the last view: nothing is added
+  size_t sizes[] = { 16, size - 1, size / 2 };
+  for (int k = 0; k < 3; k++)
+  {
+    ASSERT_TRUE(cache.write(42, data_));
+    truncate(sizes[k]);
+
+    Data data;
+    setUp(&data);
+    EXPECT_FALSE(cache.load(42, &data)) << "size " << sizes[k];
+    EXPECT_EQ(data.size(), 0u);
+  }
+}
+
+TEST_F(DatasetCacheTest, corrupted)
+{
+  DatasetCache cache(filename_);
+  ASSERT_TRUE(cache.write(42, data_));
+
+  // bad magic
+  {
+    fstream file(filename_.c_str(), ios::binary | ios::in | ios::out);
+    file.write("XXXX", 4);
+  }
+  Data data;
+  setUp(&data);
+  EXPECT_FALSE(cache.load(42, &data));
+  EXPECT_EQ(data.size(), 0u);
+
+  // message size of the first view (after the 32 bytes header) too large
+  ASSERT_TRUE(cache.write(42, data_));
+  {
+    fstream file(filename_.c_str(), ios::binary | ios::in | ios::out);
+    file.seekp(32);
+    boost::uint32_t msg_size = 0xffffff00u;
+    file.write(reinterpret_cast<const char *>(&msg_size), sizeof(msg_size));
+  }
+  EXPECT_FALSE(cache.load(42, &data));
+  EXPECT_EQ(data.size(), 0u);
+}
+
+TEST_F(DatasetCacheTest, missingPoses)
+{
+  // a view without board pose is not cached (and no file is left)
+  data_.view_[1].rvec_[1] = Mat();
+  DatasetCache cache(filename_);
+  EXPECT_FALSE(cache.write(42, data_));
+  EXPECT_FALSE(ifstream(filename_.c_str()).good());
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,472 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+/**
+ * Microbenchmarks of the estimation math kernels, using synthetic inputs of
+ * realistic size: 7x6 and 4x5 boards, 6 cameras and a PR2-sized robot tree.
+ * Each kernel is run 'repetitions' times and the time per call is reported,
+ * so changes in these paths can be measured.
+ *
+ * usage: kernels_benchmark [repetitions]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <sstream>
+
+#include <ros/time.h>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "cost_functions.h"
+#include "triangulation.h"
+#include "projection.h"
+#include "chessboard.h"
+#include "robot_state.h"
+
+using namespace std;
+using namespace cv;
+using namespace calib;
+
+static const int NUM_CAMERAS = 6;
+
+static double sink = 0; // results are accumulated here (not optimized away)
+
+static double uniform(double min, double max)
+{
+  return min + (max - min) * (rand() / double(RAND_MAX));
+}
+
+static void report(const char *kernel, const char *input, double seconds, long calls)
+{
+  printf("  %-36s %-12s %12.1f ns/call\n", kernel, input, 1e9 * seconds / calls);
+}
+
+/// \brief Synthetic rig: 6 cameras looking at one board
+struct Rig
+{
+  Matx33d         K;
+  vector<Matx34d> Ps;                 // K*[R|t]
+  vector<double>  camera_rot;         // 4 x NUM_CAMERAS (quaternion)
+  vector<double>  camera_trans;       // 3 x NUM_CAMERAS
+  vector<Mat>     rvec, tvec;         // board pose in each camera
+
+  vector<Point3d>          board;     // model points
+  vector<Point3d>          points;    // board points in the frame of camera 0
+  vector<vector<Point2d> > measured;  // camera -> noisy image points
+
+  Rig(int width, int height, double square_size)
+  {
+    K = Matx33d(525, 0, 320, 0, 525, 240, 0, 0, 1);
+
+    ChessBoard cb;
+    cb.setSize(width, height, square_size);
+    cb.generateCorners(&board);
+
+    // board pose (camera 0)
+    Matx33d R_board;
+    Rodrigues(Vec3d(0.1, -0.2, 0.05), R_board);
+    Vec3d t_board(-0.2, -0.1, 1.5);
+    for (size_t j = 0; j < board.size(); j++)
+      points.push_back(Point3d(R_board * Vec3d(board[j].x, board[j].y, board[j].z) + t_board));
+
+    for (int i = 0; i < NUM_CAMERAS; i++)
+    {
+      // camera i: small rotation and baseline
+      Vec3d r(uniform(-0.05, 0.05), uniform(-0.05, 0.05), uniform(-0.05, 0.05));
+      Vec3d t = (i == 0) ? Vec3d(0, 0, 0) : Vec3d(uniform(-0.3, 0.3), uniform(-0.1, 0.1), uniform(-0.1, 0.1));
+      if (i == 0)
+        r = Vec3d(0, 0, 0);
+
+      Matx33d R;
+      Rodrigues(r, R);
+
+      Matx34d P;
+      hconcat(K*R, K*t, P);
+      Ps.push_back(P);
+
+      double theta = norm(r);
+      double s = (theta > 0) ? sin(theta / 2) / theta : 0.5;
+      camera_rot.push_back(cos(theta / 2));
+      camera_rot.push_back(s * r(0));
+      camera_rot.push_back(s * r(1));
+      camera_rot.push_back(s * r(2));
+      camera_trans.push_back(t(0));
+      camera_trans.push_back(t(1));
+      camera_trans.push_back(t(2));
+
+      // board pose in camera i
+      Matx33d R_i = R * R_board;
+      Vec3d   t_i = R * t_board + t;
+      Mat rvec_i;
+      Rodrigues(Mat(R_i), rvec_i);
+      rvec.push_back(rvec_i);
+      tvec.push_back(Mat(t_i).clone());
+
+      // measurements
+      vector<Point2d> pts;
+      for (size_t j = 0; j < points.size(); j++)
+      {
+        Vec3d p = P * Vec4d(points[j].x, points[j].y, points[j].z, 1.0);
+        pts.push_back(Point2d(p(0)/p(2) + uniform(-0.3, 0.3),
+                              p(1)/p(2) + uniform(-0.3, 0.3)));
+      }
+      measured.push_back(pts);
+    }
+  }
+};
+
+static void benchmarkBoard(const char *name, int width, int height, double square_size,
+                           int repetitions)
+{
+  Rig rig(width, height, square_size);
+  int num_points = rig.board.size();
+
+  printf("\nBoard %s: %d points, %d cameras\n", name, num_points, NUM_CAMERAS);
+
+  //! calc_residuals (one board, all cameras)
+  {
+    double residuals[2];
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < repetitions; r++)
+      for (int i = 0; i < NUM_CAMERAS; i++)
+        for (int j = 0; j < num_points; j++)
+        {
+          calc_residuals(rig.measured[i][j].x, rig.measured[i][j].y,
+                         rig.K(0,0), rig.K(1,1), rig.K(0,2), rig.K(1,2),
+                         &rig.camera_rot[4*i], &rig.camera_trans[3*i],
+                         &rig.points[j].x, residuals);
+          sink += residuals[0];
+        }
+    double t = (ros::WallTime::now() - start).toSec();
+    report("calc_residuals", "per residual", t, long(repetitions) * NUM_CAMERAS * num_points);
+  }
+
+  //! cost functions: residuals + jacobians
+  {
+    vector<ceres::CostFunction *> autodiff, analytic;
+    for (int i = 0; i < NUM_CAMERAS; i++)
+      for (int j = 0; j < num_points; j++)
+      {
+        autodiff.push_back(ReprojectionErrorWithQuaternions::Create(rig.measured[i][j].x, rig.measured[i][j].y,
+                                                                    rig.K(0,0), rig.K(1,1), rig.K(0,2), rig.K(1,2)));
+        analytic.push_back(ReprojectionErrorAnalytic::Create(rig.measured[i][j].x, rig.measured[i][j].y,
+                                                             rig.K(0,0), rig.K(1,1), rig.K(0,2), rig.K(1,2)));
+      }
+
+    double residuals[2];
+    double J_rot[8], J_trans[6], J_point[6];
+    double *jacobians[3] = { J_rot, J_trans, J_point };
+
+    const vector<ceres::CostFunction *> *cost_functions[2] = { &autodiff, &analytic };
+    const char *names[2] = { "ReprojectionErrorWithQuaternions", "ReprojectionErrorAnalytic" };
+    for (int c = 0; c < 2; c++)
+    {
+      ros::WallTime start = ros::WallTime::now();
+      for (int r = 0; r < repetitions; r++)
+        for (int i = 0; i < NUM_CAMERAS; i++)
+          for (int j = 0; j < num_points; j++)
+          {
+            const double *parameters[3] = { &rig.camera_rot[4*i], &rig.camera_trans[3*i], &rig.points[j].x };
+            (*cost_functions[c])[i*num_points + j]->Evaluate(parameters, residuals, jacobians);
+            sink += J_rot[0];
+          }
+      double t = (ros::WallTime::now() - start).toSec();
+      report(names[c], "per residual", t, long(repetitions) * NUM_CAMERAS * num_points);
+    }
+
+    for (size_t k = 0; k < autodiff.size(); k++)
+    {
+      delete autodiff[k];
+      delete analytic[k];
+    }
+  }
+
+  //! nViewTriangulate (whole board, 6 cameras)
+  {
+    vector<Point3d> X;
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < repetitions; r++)
+    {
+      nViewTriangulate(rig.measured, rig.Ps, &X);
+      sink += X[0].x;
+    }
+    double t = (ros::WallTime::now() - start).toSec();
+    report("nViewTriangulate", "per board", t, repetitions);
+  }
+
+  //! computeReprojectionErrors (one camera)
+  {
+    Mat D, expected;
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < repetitions; r++)
+    {
+      int i = r % NUM_CAMERAS;
+      sink += computeReprojectionErrors(rig.board, rig.measured[i], rig.K, D,
+                                        rig.rvec[i], rig.tvec[i], expected);
+    }
+    double t = (ros::WallTime::now() - start).toSec();
+    report("computeReprojectionErrors", "per camera", t, repetitions);
+  }
+
+  //! transform3DPoints (one camera)
+  {
+    Mat board(rig.board), transformed;
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < repetitions; r++)
+    {
+      int i = r % NUM_CAMERAS;
+      transform3DPoints(board, rig.rvec[i], rig.tvec[i], &transformed);
+      sink += transformed.at<double>(0);
+    }
+    double t = (ros::WallTime::now() - start).toSec();
+    report("transform3DPoints", "per camera", t, repetitions);
+  }
+
+  //! findChessboardPose (PnP + error, one camera), for each method
+  const int methods[] = { PNP_ITERATIVE, PNP_EPNP, PNP_PLANAR };
+  const char *method_names[] = { "findChessboardPose iterative",
+                                 "findChessboardPose epnp",
+                                 "findChessboardPose planar" };
+  for (int m = 0; m < 3; m++)
+  {
+    Mat D, rvec, tvec;
+    vector<Point2d> expected;
+    int pnp_repetitions = max(1, repetitions / 10);
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < pnp_repetitions; r++)
+    {
+      int i = r % NUM_CAMERAS;
+      sink += findChessboardPose(rig.board, rig.measured[i], rig.K, D,
+                                 rvec, tvec, expected, methods[m]);
+    }
+    double t = (ros::WallTime::now() - start).toSec();
+    report(method_names[m], "per camera", t, pnp_repetitions);
+  }
+}
+
+/// \brief URDF joint
+static void addJoint(ostringstream &urdf, const string &name, const string &type,
+                     const string &parent, const string &child)
+{
+  urdf << "<link name='" << child << "'/>"
+       << "<joint name='" << name << "' type='" << type << "'>"
+       << "<parent link='" << parent << "'/> <child link='" << child << "'/>"
+       << "<origin xyz='" << uniform(-0.2, 0.2) << " " << uniform(-0.2, 0.2) << " " << uniform(0, 0.3)
+       << "' rpy='" << uniform(-0.5, 0.5) << " " << uniform(-0.5, 0.5) << " " << uniform(-0.5, 0.5) << "'/>";
+  if (type != "fixed")
+    urdf << "<axis xyz='0 0 1'/> <limit lower='-3' upper='3' effort='10' velocity='1'/>";
+  urdf << "</joint>";
+}
+
+/// \brief Synthetic robot with the structure and size of a PR2: base with 4
+/// casters, torso, head with the 6 cameras, two 7-DoF arms with grippers,
+/// tilting laser and fixed sensor frames (~90 links, ~40 moving joints)
+static string pr2LikeUrdf(vector<string> *joint_names, vector<string> *camera_frames)
+{
+  ostringstream urdf;
+  urdf << "<robot name='pr2_like'> <link name='base_footprint'/>";
+  addJoint(urdf, "base_footprint_joint", "fixed", "base_footprint", "base_link");
+
+  // casters: rotation + 2 wheels
+  const char *casters[4] = { "fl", "fr", "bl", "br" };
+  for (int c = 0; c < 4; c++)
+  {
+    string p = string(casters[c]) + "_caster";
+    addJoint(urdf, p + "_rotation_joint", "continuous", "base_link", p + "_rotation_link");
+    addJoint(urdf, p + "_l_wheel_joint", "continuous", p + "_rotation_link", p + "_l_wheel_link");
+    addJoint(urdf, p + "_r_wheel_joint", "continuous", p + "_rotation_link", p + "_r_wheel_link");
+    joint_names->push_back(p + "_rotation_joint");
+    joint_names->push_back(p + "_l_wheel_joint");
+    joint_names->push_back(p + "_r_wheel_joint");
+  }
+  addJoint(urdf, "base_laser_joint", "fixed", "base_link", "base_laser_link");
+  addJoint(urdf, "base_bellow_joint", "fixed", "base_link", "base_bellow_link");
+
+  // torso
+  addJoint(urdf, "torso_lift_joint", "prismatic", "base_link", "torso_lift_link");
+  joint_names->push_back("torso_lift_joint");
+  addJoint(urdf, "imu_joint", "fixed", "torso_lift_link", "imu_link");
+
+  // tilting laser
+  addJoint(urdf, "laser_tilt_mount_joint", "revolute", "torso_lift_link", "laser_tilt_mount_link");
+  addJoint(urdf, "laser_tilt_joint", "fixed", "laser_tilt_mount_link", "laser_tilt_link");
+  joint_names->push_back("laser_tilt_mount_joint");
+
+  // head and cameras (mount -> frame -> optical frame)
+  addJoint(urdf, "head_pan_joint", "revolute", "torso_lift_link", "head_pan_link");
+  addJoint(urdf, "head_tilt_joint", "revolute", "head_pan_link", "head_tilt_link");
+  addJoint(urdf, "head_plate_frame_joint", "fixed", "head_tilt_link", "head_plate_frame");
+  joint_names->push_back("head_pan_joint");
+  joint_names->push_back("head_tilt_joint");
+
+  const char *cameras[NUM_CAMERAS] = { "narrow_stereo_l", "narrow_stereo_r", "wide_stereo_l",
+                                       "wide_stereo_r", "head_mount_kinect", "high_def" };
+  for (int c = 0; c < NUM_CAMERAS; c++)
+  {
+    string p = cameras[c];
+    addJoint(urdf, p + "_mount_joint", "fixed", "head_plate_frame", p + "_mount_link");
+    addJoint(urdf, p + "_frame_joint", "fixed", p + "_mount_link", p + "_frame");
+    addJoint(urdf, p + "_optical_frame_joint", "fixed", p + "_frame", p + "_optical_frame");
+    camera_frames->push_back(p + "_optical_frame");
+  }
+
+  // arms: 7 DoF, gripper (4 finger joints) and tool frames
+  const char *arm_joints[7] = { "shoulder_pan", "shoulder_lift", "upper_arm_roll", "elbow_flex",
+                                "forearm_roll", "wrist_flex", "wrist_roll" };
+  const char *sides[2] = { "l", "r" };
+  for (int s = 0; s < 2; s++)
+  {
+    string side = sides[s];
+    string parent = "torso_lift_link";
+    for (int k = 0; k < 7; k++)
+    {
+      string link = side + "_" + arm_joints[k] + "_link";
+      addJoint(urdf, side + "_" + arm_joints[k] + "_joint", "revolute", parent, link);
+      joint_names->push_back(side + "_" + arm_joints[k] + "_joint");
+      parent = link;
+    }
+    addJoint(urdf, side + "_forearm_cam_joint", "fixed", side + "_forearm_roll_link", side + "_forearm_cam_frame");
+    addJoint(urdf, side + "_gripper_palm_joint", "fixed", parent, side + "_gripper_palm_link");
+    addJoint(urdf, side + "_gripper_tool_joint", "fixed", side + "_gripper_palm_link", side + "_gripper_tool_frame");
+    addJoint(urdf, side + "_gripper_led_joint", "fixed", side + "_gripper_palm_link", side + "_gripper_led_frame");
+
+    const char *fingers[2] = { "l", "r" };
+    for (int f = 0; f < 2; f++)
+    {
+      string finger = side + "_gripper_" + fingers[f] + "_finger";
+      addJoint(urdf, finger + "_joint", "revolute", side + "_gripper_palm_link", finger + "_link");
+      addJoint(urdf, finger + "_tip_joint", "revolute", finger + "_link", finger + "_tip_link");
+      addJoint(urdf, finger + "_tip_frame_joint", "fixed", finger + "_tip_link", finger + "_tip_frame");
+      joint_names->push_back(finger + "_joint");
+      joint_names->push_back(finger + "_tip_joint");
+    }
+  }
+
+  urdf << "</robot>";
+  return urdf.str();
+}
+
+static void benchmarkFK(int repetitions)
+{
+  vector<string> joint_names, camera_frames;
+  urdf::Model model;
+  if (!model.initString(pr2LikeUrdf(&joint_names, &camera_frames)))
+  {
+    printf("Could not parse the synthetic URDF\n");
+    return;
+  }
+
+  RobotState robot_state;
+  robot_state.initFromURDF(model);
+
+  printf("\nRobotState: %zu links, %zu moving joints\n",
+         robot_state.getNrOfLinks(), joint_names.size());
+
+  // joint configurations (as in the views: all the joints change)
+  const int num_states = 64;
+  vector<vector<double> > positions(num_states, vector<double>(joint_names.size()));
+  for (int s = 0; s < num_states; s++)
+    for (size_t k = 0; k < joint_names.size(); k++)
+      positions[s][k] = uniform(-1.0, 1.0);
+
+  KDL::Frame pose;
+
+  //! new joint state + FK of the 6 cameras (by name)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < repetitions; r++)
+    {
+      robot_state.update(joint_names, positions[r % num_states]);
+      for (int c = 0; c < NUM_CAMERAS; c++)
+      {
+        robot_state.getFK(camera_frames[c], &pose);
+        sink += pose.p(0);
+      }
+    }
+    double t = (ros::WallTime::now() - start).toSec();
+    report("update + getFK(name) x6", "per state", t, repetitions);
+  }
+
+  //! same joint state, FK of the 6 cameras by index (cached poses)
+  {
+    vector<int> camera_idx;
+    for (int c = 0; c < NUM_CAMERAS; c++)
+      camera_idx.push_back(robot_state.getLinkIndex(camera_frames[c]));
+
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < repetitions; r++)
+      for (int c = 0; c < NUM_CAMERAS; c++)
+      {
+        robot_state.getFK(camera_idx[c], &pose);
+        sink += pose.p(0);
+      }
+    double t = (ros::WallTime::now() - start).toSec();
+    report("getFK(idx) cached", "per link", t, long(repetitions) * NUM_CAMERAS);
+  }
+
+  //! new joint state + FK of all the links
+  {
+    ros::WallTime start = ros::WallTime::now();
+    for (int r = 0; r < repetitions; r++)
+    {
+      robot_state.update(joint_names, positions[r % num_states]);
+      const vector<KDL::Frame> &poses = robot_state.getFK();
+      sink += poses.back().p(0);
+    }
+    double t = (ros::WallTime::now() - start).toSec();
+    report("update + getFK() all links", "per state", t, repetitions);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int repetitions = (argc > 1) ? atoi(argv[1]) : 10000;
+
+  srand(0);
+
+  printf("Estimation kernels (%d repetitions)\n", repetitions);
+
+  benchmarkBoard("large_cb_7x6", 7, 6, 0.108,  repetitions);
+  benchmarkBoard("small_cb_4x5", 4, 5, 0.0245, repetitions);
+  benchmarkFK(repetitions);
+
+  printf("\n(checksum %g)\n", sink);
+
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+
+#include "data.h"
+#include "observation_store.h"
+#include "robot_state.h"
+
+using namespace std;
+using namespace calib;
+
+// two cameras on a fixed head
+static const string urdf_string =
+  "<robot name='test'>"
+  "  <link name='base_link'/> <link name='camera_a'/> <link name='camera_b'/>"
+  "  <joint name='camera_a_joint' type='fixed'>"
+  "    <parent link='base_link'/> <child link='camera_a'/>"
+  "    <origin xyz='0 0.05 1' rpy='-1.57 0 -1.57'/>"
+  "  </joint>"
+  "  <joint name='camera_b_joint' type='fixed'>"
+  "    <parent link='base_link'/> <child link='camera_b'/>"
+  "    <origin xyz='0 -0.05 1' rpy='-1.57 0 -1.57'/>"
+  "  </joint>"
+  "</robot>";
+
+/// \brief Measurement of the PR2 small checkerboard (4x5), the pixel of
+/// corner j is (offset + j, offset - j)
+static calibration_msgs::CameraMeasurement cameraMeasurement(const string &frame,
+                                                            double f, double offset)
+{
+  calibration_msgs::CameraMeasurement m;
+  m.camera_id = frame;
+  m.cam_info.header.frame_id = frame;
+  m.cam_info.width  = 640;
+  m.cam_info.height = 480;
+  m.cam_info.distortion_model = "plumb_bob";
+  m.cam_info.D.assign(5, 0.0);
+  double K[9]  = { f, 0, 320,  0, f + 1, 240,  0, 0, 1 };
+  double R[9]  = { 1, 0, 0,  0, 1, 0,  0, 0, 1 };
+  double P[12] = { f, 0, 320, 0,  0, f + 1, 240, 0,  0, 0, 1, 0 };
+  copy(K, K + 9,  m.cam_info.K.begin());
+  copy(R, R + 9,  m.cam_info.R.begin());
+  copy(P, P + 12, m.cam_info.P.begin());
+
+  for (int j = 0; j < 20; j++)
+  {
+    geometry_msgs::Point pt;
+    pt.x = offset + j;
+    pt.y = offset - j;
+    pt.z = 0;
+    m.image_points.push_back(pt);
+  }
+  return m;
+}
+
+static Msg measurement(const string &sample_id)
+{
+  Msg msg(new calibration_msgs::RobotMeasurement());
+  msg->sample_id = sample_id;
+  msg->target_id = "small_cb_4x5";
+  return msg;
+}
+
+class ObservationStoreTest : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    ASSERT_TRUE(model_.initString(urdf_string));
+    robot_state_.initFromURDF(model_);
+    data_.setRobotState(&robot_state_);
+
+    PoseInitializer pose_initializer;
+    pose_initializer.setNumThreads(1);
+    data_.setPoseInitializer(pose_initializer);
+
+    // view 0: both cameras (camera_b first in the message), view 1: camera_a
+    // only, view 2: camera_b with other intrinsics
+    Msg msg0 = measurement("0");
+    msg0->M_cam.push_back(cameraMeasurement("camera_b", 500, 200));
+    msg0->M_cam.push_back(cameraMeasurement("camera_a", 600, 300));
+    data_.addMeasurement(msg0);
+
+    Msg msg1 = measurement("1");
+    msg1->M_cam.push_back(cameraMeasurement("camera_a", 600, 310));
+    data_.addMeasurement(msg1);
+
+    Msg msg2 = measurement("2");
+    msg2->M_cam.push_back(cameraMeasurement("camera_b", 510, 220));
+    data_.addMeasurement(msg2);
+
+    ASSERT_EQ(data_.size(), 3u);
+  }
+
+  /// \brief Store of all the views of data_
+  void build(const vector<string> &cameras, ObservationStore *store)
+  {
+    store->clear(cameras);
+    for (size_t v = 0; v < data_.size(); v++)
+      store->addView(data_.view_[v]);
+  }
+
+  urdf::Model model_;
+  RobotState  robot_state_;
+  Data        data_;
+};
+
+TEST_F(ObservationStoreTest, empty)
+{
+  ObservationStore store;
+  EXPECT_EQ(store.size(), 0u);
+  EXPECT_EQ(store.numViews(), 0u);
+  EXPECT_EQ(store.numCameras(), 0u);
+}
+
+TEST_F(ObservationStoreTest, columns)
+{
+  // camera_c is not seen by any view
+  vector<string> cameras;
+  cameras.push_back("camera_a");
+  cameras.push_back("camera_b");
+  cameras.push_back("camera_c");
+
+  ObservationStore store;
+  build(cameras, &store);
+
+  ASSERT_EQ(store.numViews(), 3u);
+  EXPECT_EQ(store.numCameras(), 3u);
+  EXPECT_EQ(store.size(), 80u);
+
+  // rows of each view
+  EXPECT_EQ(store.viewBegin(0), 0u);
+  EXPECT_EQ(store.viewEnd(0),   40u);
+  EXPECT_EQ(store.viewBegin(1), 40u);
+  EXPECT_EQ(store.viewEnd(1),   60u);
+  EXPECT_EQ(store.viewBegin(2), 60u);
+  EXPECT_EQ(store.viewEnd(2),   80u);
+
+  // view 0: sorted by camera (store order, not message order), then corner
+  for (size_t k = 0; k < 40; k++)
+  {
+    int camera = k / 20, corner = k % 20;
+    double offset = camera == 0 ? 300 : 200;
+    EXPECT_EQ(store.view(k), 0);
+    EXPECT_EQ(store.camera(k), camera);
+    EXPECT_EQ(store.corner(k), corner);
+    EXPECT_EQ(store.u(k), offset + corner);
+    EXPECT_EQ(store.v(k), offset - corner);
+  }
+
+  // view 1: camera_a, view 2: camera_b
+  EXPECT_EQ(store.view(45), 1);
+  EXPECT_EQ(store.camera(45), 0);
+  EXPECT_EQ(store.corner(45), 5);
+  EXPECT_EQ(store.u(45), 315.0);
+  EXPECT_EQ(store.view(79), 2);
+  EXPECT_EQ(store.camera(79), 1);
+  EXPECT_EQ(store.corner(79), 19);
+  EXPECT_EQ(store.v(79), 201.0);
+}
+
+TEST_F(ObservationStoreTest, intrinsics)
+{
+  vector<string> cameras;
+  cameras.push_back("camera_b");
+  cameras.push_back("camera_c");
+
+  ObservationStore store;
+  build(cameras, &store);
+
+  // cameras not in the list are ignored (view 1 has no rows)
+  EXPECT_EQ(store.size(), 40u);
+  EXPECT_EQ(store.viewBegin(1), store.viewEnd(1));
+  EXPECT_EQ(store.cameraFrame(0), "camera_b");
+
+  // fx, fy, cx, cy of the first view seeing the camera
+  ASSERT_TRUE(store.hasIntrinsics(0));
+  EXPECT_FALSE(store.hasIntrinsics(1));
+  const double *k = store.intrinsics(0);
+  EXPECT_EQ(k[0], 500.0);
+  EXPECT_EQ(k[1], 501.0);
+  EXPECT_EQ(k[2], 320.0);
+  EXPECT_EQ(k[3], 240.0);
+
+  // clear() forgets the observations and the intrinsics
+  store.clear(cameras);
+  EXPECT_EQ(store.size(), 0u);
+  EXPECT_EQ(store.numViews(), 0u);
+  EXPECT_FALSE(store.hasIntrinsics(0));
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+
+#include "optimization.h"
+
+using namespace std;
+using namespace calib;
+
+// six cameras (PR2), 42 corners per board (7x6)
+TEST(AutoLinearSolver, denseSchur)
+{
+  // a few views: still eliminated
+  EXPECT_EQ("dense_schur", Optimization::autoLinearSolver(6, 20, 0, 120));
+  EXPECT_EQ("dense_schur", Optimization::autoLinearSolver(2, 0, 20, 40));
+
+  // board pose, 100 views
+  EXPECT_EQ("dense_schur", Optimization::autoLinearSolver(6, 100, 0, 600));
+
+  // free points, 100 views
+  EXPECT_EQ("dense_schur", Optimization::autoLinearSolver(6, 0, 4200, 25200));
+}
+
+TEST(AutoLinearSolver, sparseSchur)
+{
+  // 30 cameras: reduced camera system of 210 parameters
+  EXPECT_EQ("sparse_schur", Optimization::autoLinearSolver(30, 100, 0, 3000));
+  EXPECT_EQ("sparse_schur", Optimization::autoLinearSolver(21, 0, 4200, 50000));
+}
+
+TEST(AutoLinearSolver, iterativeSchur)
+{
+  // per corner residuals: 1000 views, 6 cameras
+  EXPECT_EQ("iterative_schur", Optimization::autoLinearSolver(6, 0, 42000, 252000));
+
+  // many eliminated parameters (even with fused residual blocks)
+  EXPECT_EQ("iterative_schur", Optimization::autoLinearSolver(6, 60000, 0, 100000));
+  EXPECT_EQ("iterative_schur", Optimization::autoLinearSolver(30, 0, 120000, 150000));
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,177 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+
+#include "parameter_store.h"
+
+using namespace std;
+using namespace cv;
+using namespace calib;
+
+static vector<Point3d> boardPoints(size_t num_points, double z)
+{
+  vector<Point3d> points(num_points);
+  for (size_t j = 0; j < num_points; j++)
+    points[j] = Point3d(0.1 * j, -0.2 * j, z);
+  return points;
+}
+
+static void expectPoints(ParameterStore &store, size_t view, const vector<Point3d> &points)
+{
+  ASSERT_EQ(store.numPoints(view), points.size());
+  for (size_t j = 0; j < points.size(); j++)
+  {
+    EXPECT_EQ(store.point(view, j)[0], points[j].x);
+    EXPECT_EQ(store.point(view, j)[1], points[j].y);
+    EXPECT_EQ(store.point(view, j)[2], points[j].z);
+  }
+}
+
+TEST(ParameterStore, cameras)
+{
+  ParameterStore store;
+  store.setNumCameras(3);
+  EXPECT_EQ(store.numCameras(), 3u);
+
+  // contiguous buffers, zero initialized
+  EXPECT_EQ(store.cameraRotation(1), store.cameraRotation(0) + 4);
+  EXPECT_EQ(store.cameraTranslation(2), store.cameraTranslation(0) + 6);
+  for (int k = 0; k < 4; k++)
+    EXPECT_EQ(store.cameraRotation(2)[k], 0.0);
+
+  vector<double *> rot, trans;
+  store.getCameraBlocks(&rot, &trans);
+  ASSERT_EQ(rot.size(), 3u);
+  ASSERT_EQ(trans.size(), 3u);
+  EXPECT_EQ(rot[2], store.cameraRotation(2));
+  EXPECT_EQ(trans[1], store.cameraTranslation(1));
+}
+
+TEST(ParameterStore, views)
+{
+  ParameterStore store;
+  vector<Point3d> p0 = boardPoints(42, 1.0);
+  vector<Point3d> p1 = boardPoints(20, 2.0);
+  EXPECT_EQ(store.addView(p0), 0u);
+  EXPECT_EQ(store.addView(p1), 1u);
+  EXPECT_EQ(store.numViews(), 2u);
+
+  expectPoints(store, 0, p0);
+  expectPoints(store, 1, p1);
+
+  // the points of a view are contiguous
+  EXPECT_EQ(store.point(0, 41), store.point(0, 0) + 3*41);
+
+  vector<double *> blocks;
+  store.getPointBlocks(1, &blocks);
+  ASSERT_EQ(blocks.size(), 20u);
+  EXPECT_EQ(blocks[5], store.point(1, 5));
+}
+
+TEST(ParameterStore, stablePointers)
+{
+  // the blocks given to ceres never move, also when new chunks are needed
+  // (4096 points per chunk, larger views get their own chunk)
+  ParameterStore store;
+  vector<Point3d> p0 = boardPoints(42, 1.0);
+  store.addView(p0);
+  double *first = store.point(0, 0);
+  size_t board = store.addBoardPose();
+  double *board_rot = store.boardRotation(board);
+
+  for (int v = 0; v < 200; v++)
+    store.addView(boardPoints(42, 3.0));
+  vector<Point3d> large = boardPoints(5000, 4.0);
+  size_t large_view = store.addView(large);
+
+  EXPECT_EQ(store.point(0, 0), first);
+  EXPECT_EQ(store.boardRotation(board), board_rot);
+  expectPoints(store, 0, p0);
+  expectPoints(store, large_view, large);
+}
+
+TEST(ParameterStore, boardPoses)
+{
+  ParameterStore store;
+  EXPECT_EQ(store.addBoardPose(), 0u);
+  EXPECT_EQ(store.addBoardPose(), 1u);
+  EXPECT_EQ(store.numBoardPoses(), 2u);
+
+  // identity: rotation[4] (quaternion), translation[3]
+  EXPECT_EQ(store.boardTranslation(1), store.boardRotation(1) + 4);
+  EXPECT_EQ(store.boardRotation(1)[0], 1.0);
+  for (int k = 1; k < 4; k++)
+    EXPECT_EQ(store.boardRotation(1)[k], 0.0);
+  for (int k = 0; k < 3; k++)
+    EXPECT_EQ(store.boardTranslation(1)[k], 0.0);
+}
+
+TEST(ParameterStore, jointOffsets)
+{
+  ParameterStore store;
+  store.setNumJointOffsets(3);
+  EXPECT_EQ(store.numJointOffsets(), 3u);
+  EXPECT_EQ(*store.jointOffset(2), 0.0);
+  EXPECT_EQ(store.jointOffset(2), store.jointOffset(0) + 2);
+}
+
+TEST(ParameterStore, clearReusesMemory)
+{
+  ParameterStore store;
+  store.setNumCameras(2);
+  store.setNumJointOffsets(1);
+  store.addView(boardPoints(42, 1.0));
+  store.addBoardPose();
+  double *first = store.point(0, 0);
+
+  store.clear();
+  EXPECT_EQ(store.numCameras(), 0u);
+  EXPECT_EQ(store.numViews(), 0u);
+  EXPECT_EQ(store.numBoardPoses(), 0u);
+  EXPECT_EQ(store.numJointOffsets(), 0u);
+
+  vector<Point3d> p0 = boardPoints(30, 5.0);
+  store.addView(p0);
+  EXPECT_EQ(store.point(0, 0), first);
+  expectPoints(store, 0, p0);
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,417 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+
+#include <kdl_parser/kdl_parser.hpp>
+#include <kdl/treefksolverpos_recursive.hpp>
+
+#include "robot_state.h"
+#include "optimization.h"
+
+using namespace std;
+using namespace calib;
+
+static const double eps = 1e-12;
+
+// small robot: two branches, revolute, prismatic and fixed joints
+static const string urdf_string =
+  "<robot name='test'>"
+  "  <link name='base_link'/> <link name='torso'/> <link name='head'/>"
+  "  <link name='camera'/> <link name='arm'/> <link name='gripper'/>"
+  "  <joint name='torso_joint' type='prismatic'>"
+  "    <parent link='base_link'/> <child link='torso'/>"
+  "    <origin xyz='0 0 0.8' rpy='0 0 0'/> <axis xyz='0 0 1'/>"
+  "    <limit lower='0' upper='0.3' effort='10' velocity='1'/>"
+  "  </joint>"
+  "  <joint name='head_joint' type='revolute'>"
+  "    <parent link='torso'/> <child link='head'/>"
+  "    <origin xyz='0.1 0 0.4' rpy='0 0.2 0'/> <axis xyz='0 0 1'/>"
+  "    <limit lower='-3' upper='3' effort='10' velocity='1'/>"
+  "  </joint>"
+  "  <joint name='camera_joint' type='fixed'>"
+  "    <parent link='head'/> <child link='camera'/>"
+  "    <origin xyz='0.05 0.02 0.1' rpy='-1.57 0 -1.57'/>"
+  "  </joint>"
+  "  <joint name='arm_joint' type='revolute'>"
+  "    <parent link='torso'/> <child link='arm'/>"
+  "    <origin xyz='0 -0.2 0.1' rpy='0.1 0 0'/> <axis xyz='0 1 0'/>"
+  "    <limit lower='-3' upper='3' effort='10' velocity='1'/>"
+  "  </joint>"
+  "  <joint name='gripper_joint' type='continuous'>"
+  "    <parent link='arm'/> <child link='gripper'/>"
+  "    <origin xyz='0.4 0 0' rpy='0 0 0'/> <axis xyz='1 0 0'/>"
+  "  </joint>"
+  "</robot>";
+
+static void expectEqual(const KDL::Frame &f1, const KDL::Frame &f2)
+{
+  for (int i = 0; i < 3; i++)
+  {
+    EXPECT_NEAR(f1.p(i), f2.p(i), eps);
+    for (int j = 0; j < 3; j++)
+      EXPECT_NEAR(f1.M(i,j), f2.M(i,j), eps);
+  }
+}
+
+// forward kinematic computed by KDL (recursive solver)
+static void kdlFK(const urdf::Model &model,
+                  const map<string, double> &positions,
+                  const string &link_name,
+                  KDL::Frame *pose)
+{
+  KDL::Tree tree;
+  ASSERT_TRUE(kdl_parser::treeFromUrdfModel(model, tree));
+
+  KDL::JntArray q(tree.getNrOfJoints());
+  KDL::SetToZero(q);
+
+  const KDL::SegmentMap &segments = tree.getSegments();
+  for (KDL::SegmentMap::const_iterator it = segments.begin(); it != segments.end(); it++)
+  {
+    const KDL::Joint &joint = it->second.segment.getJoint();
+    if (joint.getType() != KDL::Joint::None)
+      q(it->second.q_nr) = positions.find(joint.getName())->second;
+  }
+
+  KDL::TreeFkSolverPos_recursive solver(tree);
+  ASSERT_GE(solver.JntToCart(q, *pose, link_name), 0);
+}
+
+TEST(RobotState, compiledTreeOrder)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState robot_state;
+  robot_state.initFromURDF(model);
+
+  EXPECT_EQ(robot_state.getNrOfLinks(), 6u);
+  EXPECT_EQ(robot_state.getLinkIndex("base_link"), 0);
+  EXPECT_EQ(robot_state.getLinkIndex("not_a_link"), -1);
+
+  // parents before children
+  EXPECT_LT(robot_state.getLinkIndex("torso"), robot_state.getLinkIndex("head"));
+  EXPECT_LT(robot_state.getLinkIndex("head"),  robot_state.getLinkIndex("camera"));
+  EXPECT_LT(robot_state.getLinkIndex("arm"),   robot_state.getLinkIndex("gripper"));
+}
+
+TEST(RobotState, forwardKinematic)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState robot_state;
+  robot_state.initFromURDF(model);
+
+  const double positions[][4] = { { 0.0,  0.0, 0.0,  0.0 },
+                                  { 0.1,  0.5, -0.3, 1.2 },
+                                  { 0.25, -2.0, 1.1, -0.7 } };
+
+  const char *links[] = { "base_link", "torso", "head", "camera", "arm", "gripper" };
+
+  for (int n = 0; n < 3; n++)
+  {
+    robot_state.update("torso_joint",   positions[n][0]);
+    robot_state.update("head_joint",    positions[n][1]);
+    robot_state.update("arm_joint",     positions[n][2]);
+    robot_state.update("gripper_joint", positions[n][3]);
+
+    for (int l = 0; l < 6; l++)
+    {
+      KDL::Frame expected, by_name, by_idx;
+      kdlFK(model, robot_state.getJointPositions(), links[l], &expected);
+
+      EXPECT_TRUE(robot_state.getFK(links[l], &by_name));
+      EXPECT_TRUE(robot_state.getFK(robot_state.getLinkIndex(links[l]), &by_idx));
+
+      expectEqual(by_name, expected);
+      expectEqual(by_idx,  expected);
+      expectEqual(robot_state.getFK()[robot_state.getLinkIndex(links[l])], expected);
+    }
+  }
+
+  KDL::Frame pose;
+  EXPECT_FALSE(robot_state.getFK("not_a_link", &pose));
+  EXPECT_FALSE(robot_state.getFK(100, &pose));
+}
+
+TEST(RobotState, cacheInvalidation)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState robot_state;
+  robot_state.initFromURDF(model);
+
+  KDL::Frame before, after;
+  robot_state.getFK("gripper", &before);
+
+  // joint change
+  robot_state.update("arm_joint", 0.5);
+  robot_state.getFK("gripper", &after);
+  EXPECT_FALSE(KDL::Equal(before, after, 1e-6));
+
+  // reset
+  robot_state.reset();
+  robot_state.getFK("gripper", &after);
+  expectEqual(before, after);
+
+  // tree change (new fixed frame)
+  urdf::Pose pose = robot_state.getUrdfPose("camera");
+  pose.position.x += 1.0;
+  robot_state.setUrdfPose("camera", pose);
+  robot_state.getFK("camera", &before);
+  robot_state.updateTree();
+  robot_state.getFK("camera", &after);
+  EXPECT_FALSE(KDL::Equal(before, after, 1e-6));
+}
+
+TEST(RobotState, indexes)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState robot_state;
+  robot_state.initFromURDF(model);
+
+  // joints: same result by name and by index
+  int arm_joint = robot_state.getJointIndex("arm_joint");
+  ASSERT_GE(arm_joint, 0);
+  EXPECT_EQ("arm_joint", robot_state.getJointNameByIndex(arm_joint));
+  EXPECT_EQ(-1, robot_state.getJointIndex("unknown_joint"));
+  EXPECT_TRUE(robot_state.update(arm_joint, 0.4));
+  EXPECT_EQ(0.4, robot_state.getJointPositions()["arm_joint"]);
+
+  // links
+  int arm = robot_state.getLinkIndex("arm");
+  ASSERT_GT(arm, 0);
+  EXPECT_EQ("arm", robot_state.getLinkNameByIndex(arm));
+  EXPECT_EQ(robot_state.getLinkIndex("torso"), robot_state.getParentIndex(arm));
+  EXPECT_EQ(arm_joint, robot_state.getLinkJointIndex(arm));
+  EXPECT_EQ(-1, robot_state.getLinkJointIndex(robot_state.getLinkIndex("camera")));
+
+  KDL::Frame by_name, by_index;
+  robot_state.getRelativePose("arm", &by_name);
+  robot_state.getRelativePose(arm, &by_index);
+  expectEqual(by_name, by_index);
+}
+
+TEST(RobotState, deltaFK)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState robot_state, reference;
+  robot_state.initFromURDF(model);
+  reference.initFromURDF(model);
+
+  robot_state.update("head_joint", 0.3);
+  robot_state.getFK();
+  EXPECT_EQ(robot_state.getNrOfLinks(), robot_state.getNrOfUpdatedLinks());
+
+  // leaf joint: only its link
+  robot_state.update("gripper_joint", 0.7);
+  robot_state.getFK();
+  EXPECT_EQ(1u, robot_state.getNrOfUpdatedLinks());
+
+  // joint with children: head and camera
+  robot_state.update("head_joint", -0.2);
+  robot_state.getFK();
+  EXPECT_EQ(2u, robot_state.getNrOfUpdatedLinks());
+
+  // same values again (as View::updateRobot() does): nothing to recompute
+  robot_state.reset();
+  robot_state.update("head_joint", -0.2);
+  robot_state.update("gripper_joint", 0.7);
+  robot_state.getFK();
+  EXPECT_EQ(0u, robot_state.getNrOfUpdatedLinks());
+
+  // same poses as a full forward pass
+  reference.update("head_joint", -0.2);
+  reference.update("gripper_joint", 0.7);
+  const vector<KDL::Frame> &poses = robot_state.getFK();
+  for (size_t i = 0; i < poses.size(); i++)
+  {
+    KDL::Frame expected;
+    ASSERT_TRUE(reference.getFK(i, &expected));
+    expectEqual(expected, poses[i]);
+  }
+}
+
+TEST(RobotState, setJointOrigin)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState patched, rebuilt;
+  patched.initFromURDF(model);
+  rebuilt.initFromURDF(model);
+
+  patched.update("arm_joint", 0.5);
+  rebuilt.update("arm_joint", 0.5);
+  patched.getFK();  // valid cache, only subtrees are recomputed
+
+  // fixed joint (leaf) and revolute joint (with children)
+  urdf::Pose pose = patched.getUrdfPose("camera");
+  pose.position.x += 1.0;
+  unsigned long revision = patched.getTreeRevision();
+  EXPECT_TRUE(patched.setJointOrigin("camera", pose));
+  EXPECT_GT(patched.getTreeRevision(), revision);
+  rebuilt.setUrdfPose("camera", pose);
+
+  pose = patched.getUrdfPose("arm");
+  pose.position.z -= 0.3;
+  pose.rotation.setFromRPY(0.2, -0.1, 0.3);
+  EXPECT_TRUE(patched.setJointOrigin("arm", pose));
+  rebuilt.setUrdfPose("arm", pose);
+  rebuilt.updateTree();
+
+  // same poses as rebuilding the whole tree
+  const vector<KDL::Frame> &poses = patched.getFK();
+  ASSERT_EQ(rebuilt.getNrOfLinks(), poses.size());
+  for (size_t i = 0; i < poses.size(); i++)
+  {
+    KDL::Frame expected;
+    ASSERT_TRUE(rebuilt.getFK(i, &expected));
+    expectEqual(expected, poses[i]);
+  }
+
+  // the root has no joint origin
+  EXPECT_FALSE(patched.setJointOrigin("base_link", pose));
+}
+
+TEST(RobotState, treeRevision)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  // unique across RobotStates (the View kinematic cache is keyed on it)
+  RobotState *robot_state = new RobotState();
+  robot_state->initFromURDF(model);
+  unsigned long revision = robot_state->getTreeRevision();
+  EXPECT_NE(0u, revision);
+  delete robot_state;
+
+  RobotState other;
+  other.initFromURDF(model);
+  EXPECT_NE(revision, other.getTreeRevision());
+}
+
+TEST(RobotState, jointOffset)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState calibrated, measured;
+  calibrated.initFromURDF(model);
+  measured.initFromURDF(model);
+
+  calibrated.update("torso_joint", 0.1);
+  calibrated.update("arm_joint", 0.5);
+  calibrated.getFK();  // valid cache, only subtrees are recomputed
+
+  // an offset is the same as measuring position + offset
+  calibrated.setJointOffset(calibrated.getJointIndex("torso_joint"), 0.02);
+  calibrated.setJointOffset(calibrated.getJointIndex("arm_joint"), -0.1);
+  measured.update("torso_joint", 0.12);
+  measured.update("arm_joint", 0.4);
+
+  EXPECT_NEAR(calibrated.getCalibratedPosition(calibrated.getJointIndex("arm_joint")), 0.4, eps);
+
+  const vector<KDL::Frame> &poses = calibrated.getFK();
+  for (size_t i = 0; i < poses.size(); i++)
+  {
+    KDL::Frame expected;
+    ASSERT_TRUE(measured.getFK(i, &expected));
+    expectEqual(expected, poses[i]);
+  }
+}
+
+TEST(RobotState, kinematicChain)
+{
+  urdf::Model model;
+  ASSERT_TRUE(model.initString(urdf_string));
+
+  RobotState robot_state;
+  robot_state.initFromURDF(model);
+
+  robot_state.update("torso_joint",   0.15);
+  robot_state.update("head_joint",    0.5);
+  robot_state.update("arm_joint",     -0.3);
+  robot_state.update("gripper_joint", 1.2);
+
+  // measured positions (joint index), offsets of the RobotState
+  vector<double> positions;
+  robot_state.getJointPositions(&positions);
+
+  const double offsets[] = { 0.03, -0.2, 0.1, 0.05 };  // torso, head, arm, gripper
+  const char *offset_joints[] = { "torso_joint", "head_joint", "arm_joint", "gripper_joint" };
+  for (int j = 0; j < 4; j++)
+    robot_state.setJointOffset(robot_state.getJointIndex(offset_joints[j]), offsets[j]);
+
+  // torso and gripper offsets as parameters, the rest from the RobotState
+  vector<int> offset_idx(robot_state.getNrOfJoints(), -1);
+  offset_idx[robot_state.getJointIndex("torso_joint")]   = 0;
+  offset_idx[robot_state.getJointIndex("gripper_joint")] = 1;
+  const double *parameters[2] = { &offsets[0], &offsets[3] };
+
+  const char *links[] = { "base_link", "torso", "head", "camera", "arm", "gripper" };
+  for (int l = 0; l < 6; l++)
+  {
+    KinematicChain chain;
+    Optimization::buildChain(robot_state, robot_state.getLinkIndex(links[l]),
+                             positions, offset_idx, &chain);
+
+    double R[9], t[3];
+    chainTransform(chain, parameters, R, t);
+
+    KDL::Frame expected;
+    ASSERT_TRUE(robot_state.getFK(links[l], &expected));
+    for (int r = 0; r < 3; r++)
+    {
+      EXPECT_NEAR(expected.p(r), t[r], 1e-9);
+      for (int c = 0; c < 3; c++)
+        EXPECT_NEAR(expected.M(r, c), R[3*r+c], 1e-9);
+    }
+  }
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+#include <cmath>
+
+#include "sparse_problem.h"
+
+using namespace std;
+using namespace calib;
+
+// values: transform A (0..5), joint transform B (6..11), gearing (12),
+// camera shifts (13..16), spacing (17, 18), board pose (19..24)
+static const int NUM_VALUES = 25;
+
+static void defaultValues(vector<double> *values)
+{
+  const double v[NUM_VALUES] = { 0.1, -0.05, 0.3,  0.02, 0.1, -0.03,   // A
+                                 0.0,  0.2,  0.1,  0.05, 0.0,  0.1,    // B
+                                 1.05,                                 // gearing
+                                 0.5,  2.0, -1.0,  1.5,                // camera
+                                 0.1,  0.12,                           // spacing
+                                 0.2, -0.1,  2.5,  0.1, -0.2, 0.05 };  // board pose
+  values->assign(v, v + NUM_VALUES);
+}
+
+static void pinhole(double P[12])
+{
+  const double p[12] = { 525, 0, 320, 0,
+                         0, 525, 240, 0,
+                         0,   0,   1, 0 };
+  for (int k = 0; k < 12; k++)
+    P[k] = p[k];
+}
+
+TEST(SparseProblem, projectsBoard)
+{
+  // no links, no shifts: camera in the root frame
+  vector<double> values(NUM_VALUES, 0.0);
+  values[17] = values[18] = 0.1;  // spacing
+  values[21] = 2.0;               // board 2 m in front of the camera
+
+  vector<int> columns(NUM_VALUES, -1);
+  SparseProblem problem;
+  problem.setColumns(columns, 0);
+
+  double P[12];
+  pinhole(P);
+  vector<double> measured(2 * 6, 0.0);
+  problem.addCameraChain(vector<SparseProblem::Link>(), P, 13, 0.0,
+                         SparseProblem::Board(3, 2, 17, 19), measured);
+
+  vector<double> r, data;
+  vector<int> indices, indptr;
+  ASSERT_TRUE(problem.evaluate(values, &r, &data, &indices, &indptr));
+  ASSERT_EQ(r.size(), 12u);
+  EXPECT_TRUE(data.empty());
+  EXPECT_EQ(indptr.size(), 13u);
+
+  for (int n = 0; n < 6; n++)
+  {
+    EXPECT_NEAR(r[2*n],   320 + 525 * 0.1 * (n % 3) / 2.0, 1e-9);
+    EXPECT_NEAR(r[2*n+1], 240 + 525 * 0.1 * (n / 3) / 2.0, 1e-9);
+  }
+}
+
+TEST(SparseProblem, jacobian)
+{
+  vector<double> values;
+  defaultValues(&values);
+
+  // transform A is fixed, the rest is free (the board pose at the end)
+  vector<int> columns(NUM_VALUES, -1);
+  int num_columns = 0;
+  for (int k = 6; k < NUM_VALUES; k++)
+    columns[k] = num_columns++;
+
+  vector<SparseProblem::Link> links;
+  links.push_back(SparseProblem::Link(0));              // fixed
+  links.push_back(SparseProblem::Link(6, -5, 0.3, 12)); // pitch joint (opposite)
+  links.push_back(SparseProblem::Link(6, 3, 0.1, 12));  // prismatic joint (z)
+
+  double P[12];
+  pinhole(P);
+  vector<double> measured(2 * 4, 100.0);
+
+  SparseProblem problem;
+  problem.setColumns(columns, num_columns);
+  problem.addCameraChain(links, P, 13, 0.0, SparseProblem::Board(2, 2, 17, 19), measured);
+  problem.addChain(links, SparseProblem::Board(2, 2, 17, 19));
+  ASSERT_EQ(problem.numResiduals(), 8u + 12u);
+
+  vector<double> r, data;
+  vector<int> indices, indptr;
+  ASSERT_TRUE(problem.evaluate(values, &r, &data, &indices, &indptr));
+  ASSERT_EQ(indptr.size(), problem.numResiduals() + 1);
+
+  // dense Jacobian from the CSR matrix (sorted columns in each row)
+  vector<vector<double> > J(r.size(), vector<double>(num_columns, 0.0));
+  for (size_t row = 0; row < r.size(); row++)
+    for (int k = indptr[row]; k < indptr[row+1]; k++)
+    {
+      if (k > indptr[row])
+        EXPECT_LT(indices[k-1], indices[k]);
+      J[row][indices[k]] = data[k];
+    }
+
+  // central differences
+  const double h = 1e-6;
+  vector<double> r_plus, r_minus, unused_data;
+  vector<int> unused_indices, unused_indptr;
+  for (int k = 0; k < NUM_VALUES; k++)
+  {
+    if (columns[k] < 0)
+      continue;
+
+    vector<double> plus = values, minus = values;
+    plus[k]  += h;
+    minus[k] -= h;
+    problem.evaluate(plus,  &r_plus,  &unused_data, &unused_indices, &unused_indptr);
+    problem.evaluate(minus, &r_minus, &unused_data, &unused_indices, &unused_indptr);
+
+    for (size_t row = 0; row < r.size(); row++)
+      EXPECT_NEAR(J[row][columns[k]], (r_plus[row] - r_minus[row]) / (2*h),
+                  1e-4 * (1.0 + fabs(J[row][columns[k]])))
+        << "value " << k << ", row " << row;
+  }
+}
+
+TEST(SparseProblem, chainResidual)
+{
+  vector<double> values;
+  defaultValues(&values);
+
+  // the board pose is the one of the chain (only a fixed transform)
+  for (int k = 0; k < 6; k++)
+    values[19+k] = values[k];
+
+  vector<int> columns(NUM_VALUES, 0);
+  SparseProblem problem;
+  problem.setColumns(columns, 1);
+  problem.addChain(vector<SparseProblem::Link>(1, SparseProblem::Link(0)),
+                   SparseProblem::Board(4, 3, 17, 19));
+
+  vector<double> r, data;
+  vector<int> indices, indptr;
+  ASSERT_TRUE(problem.evaluate(values, &r, &data, &indices, &indptr));
+  ASSERT_EQ(r.size(), 3u * 12u);
+  for (size_t k = 0; k < r.size(); k++)
+    EXPECT_NEAR(r[k], 0.0, 1e-12);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,347 @@
+#!/usr/bin/env python
+# Software License Agreement (BSD License)
+#
+# Copyright (c) 2013, Willow Garage, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+#  * Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+#  * Redistributions in binary form must reproduce the above
+#    copyright notice, this list of conditions and the following
+#    disclaimer in the documentation and/or other materials provided
+#    with the distribution.
+#  * Neither the name of Willow Garage, Inc. nor the names of its
+#    contributors may be used to endorse or promote products derived
+#    from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+# ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+
+
+import roslib; roslib.load_manifest('calibration_estimation')
+
+import sys
+import unittest
+import rospy
+import numpy
+import yaml
+
+from calibration_estimation.sensors.chain_sensor import ChainSensor
+from calibration_estimation.sensors.camera_chain_sensor import CameraChainSensor
+from calibration_estimation.sensors.multi_sensor import MultiSensor
+from calibration_estimation.urdf_params import UrdfParams
+from calibration_estimation.opt_runner import ErrorCalc, SparseProblem, build_opt_vector
+
+from calibration_msgs.msg import *
+from sensor_msgs.msg import JointState, CameraInfo
+from geometry_msgs.msg import Point
+
+from numpy import *
+
+def loadSystem():
+    urdf = '''
+<robot>
+  <link name="base_link"/>
+  <joint name="j0" type="fixed">
+    <origin xyz="0 0 0" rpy="0 0 0"/>
+    <parent link="base_link"/>
+    <child link="j0_link"/>
+  </joint>
+  <link name="j0_link"/>
+  <joint name="j1" type="revolute">
+    <axis xyz="0 0 1"/>
+    <origin xyz="1 0 0" rpy="0 0 0"/>
+    <parent link="j0_link"/>
+    <child link="j1_link"/>
+  </joint>
+  <link name="j1_link"/>
+  <joint name="j2" type="revolute">
+    <axis xyz="0 0 1"/>
+    <origin xyz="1 0 0" rpy="0 0 0"/>
+    <parent link="j1_link"/>
+    <child link="j2_link"/>
+  </joint>
+  <link name="j2_link"/>
+</robot>
+'''
+    config = yaml.load('''
+sensors:
+  chains:
+    chainA:
+      sensor_id: chainA
+      root: j0_link
+      tip: j1_link
+      cov:
+        joint_angles: [1]
+      gearing: [1.0]
+    chainB:
+      sensor_id: chainB
+      root: j0_link
+      tip: j2_link
+      cov:
+        joint_angles: [1, 1]
+      gearing: [1.0, 1.0]
+  rectified_cams: {}
+  tilting_lasers: {}
+transforms:
+  chainA_cb: [0.1, 0, 0, 0, 0, 0]
+  chainB_cb: [0, 0.1, 0, 0, 0, 0]
+checkerboards:
+  boardA:
+    corners_x: 2
+    corners_y: 2
+    spacing_x: 1
+    spacing_y: 1
+''')
+
+    free_dict = yaml.load('''
+chains:
+  chainA:
+    gearing: [1]
+  chainB:
+    gearing: [0, 1]
+tilting_lasers: {}
+rectified_cams: {}
+transforms:
+  j1: [1, 1, 0, 0, 0, 1]
+  chainB_cb: [1, 0, 1, 0, 1, 0]
+checkerboards:
+  boardA:
+    spacing_x: 1
+    spacing_y: 1
+''')
+
+    return config["sensors"]["chains"], UrdfParams(urdf, config), free_dict
+
+def buildMultisensors(config, robot_params):
+    multisensors = []
+    positions = [ ([0.3], [0.2, -0.4]),
+                  ([-0.5], [0.7, 0.1]) ]
+    for position_a, position_b in positions:
+        multisensor = MultiSensor(None)
+        multisensor.sensors = [ ChainSensor(config["chainA"],
+                                            ChainMeasurement(chain_id="chainA",
+                                                             chain_state=JointState(position=position_a)),
+                                            "boardA"),
+                                ChainSensor(config["chainB"],
+                                            ChainMeasurement(chain_id="chainB",
+                                                             chain_state=JointState(position=position_b)),
+                                            "boardA") ]
+        multisensor.checkerboard = "boardA"
+        multisensor.update_config(robot_params)
+        multisensors.append(multisensor)
+    return multisensors
+
+def loadCameraSystem():
+    # j2 has a rotated origin: the joint chain uses its angle-axis values as
+    # roll, pitch, yaw (link_T), the backend has to do the same
+    urdf = '''
+<robot>
+  <link name="base_link"/>
+  <joint name="j0" type="fixed">
+    <origin xyz="0 0 0.5" rpy="0 0 0"/>
+    <parent link="base_link"/>
+    <child link="j0_link"/>
+  </joint>
+  <link name="j0_link"/>
+  <joint name="j1" type="revolute">
+    <axis xyz="0 0 1"/>
+    <origin xyz="0.2 0 0" rpy="0 0 0"/>
+    <parent link="j0_link"/>
+    <child link="j1_link"/>
+  </joint>
+  <link name="j1_link"/>
+  <joint name="j2" type="revolute">
+    <axis xyz="0 0 1"/>
+    <origin xyz="0.5 0 0" rpy="0.1 -0.15 0.3"/>
+    <parent link="j1_link"/>
+    <child link="j2_link"/>
+  </joint>
+  <link name="j2_link"/>
+  <joint name="camA_joint" type="fixed">
+    <origin xyz="0.1 0 0" rpy="-1.5708 0 -1.5708"/>
+    <parent link="j2_link"/>
+    <child link="camA_frame"/>
+  </joint>
+  <link name="camA_frame"/>
+  <joint name="camB_joint" type="fixed">
+    <origin xyz="0.1 0.05 0" rpy="-1.5708 0 -1.5708"/>
+    <parent link="j1_link"/>
+    <child link="camB_frame"/>
+  </joint>
+  <link name="camB_frame"/>
+</robot>
+'''
+    config = yaml.load('''
+sensors:
+  chains:
+    chainA:
+      sensor_id: chainA
+      root: j0_link
+      tip: j1_link
+      cov:
+        joint_angles: [1]
+      gearing: [1.0]
+    chainB:
+      sensor_id: chainB
+      root: j0_link
+      tip: j2_link
+      cov:
+        joint_angles: [1, 1]
+      gearing: [1.0, 1.0]
+  rectified_cams:
+    camA:
+      chain_id: chainB
+      frame_id: camA_frame
+      baseline_shift: 0.0
+      f_shift: 0.0
+      cx_shift: 0.0
+      cy_shift: 0.0
+      cov: {u: 0.25, v: 0.25}
+    camB:
+      chain_id: chainA
+      frame_id: camB_frame
+      baseline_shift: 0.0
+      baseline_rgbd: 0.075
+      f_shift: 0.0
+      cx_shift: 0.0
+      cy_shift: 0.0
+      cov: {u: 0.25, v: 0.25, x: 0.25}
+  tilting_lasers: {}
+transforms: {}
+checkerboards:
+  boardA:
+    corners_x: 3
+    corners_y: 2
+    spacing_x: 0.1
+    spacing_y: 0.1
+''')
+
+    free_dict = yaml.load('''
+chains:
+  chainA:
+    gearing: [1]
+  chainB:
+    gearing: [1, 1]
+tilting_lasers: {}
+rectified_cams:
+  camA:
+    baseline_shift: 1
+    f_shift: 1
+    cx_shift: 1
+    cy_shift: 1
+  camB:
+    baseline_shift: 1
+    f_shift: 1
+    cx_shift: 0
+    cy_shift: 1
+transforms:
+  j1: [1, 1, 1, 1, 1, 1]
+  j2: [1, 1, 1, 1, 1, 1]
+  camA_joint: [1, 1, 1, 1, 1, 1]
+  camB_joint: [0, 1, 1, 1, 0, 1]
+checkerboards:
+  boardA:
+    spacing_x: 1
+    spacing_y: 1
+''')
+
+    return UrdfParams(urdf, config), free_dict
+
+def buildCameraMultisensors(robot_params):
+    # monocular camera on chainB, rgbd camera (z is the depth) on chainA
+    P_mono = [525.0, 0.0, 319.5, 0.0, 0.0, 525.0, 239.5, 0.0, 0.0, 0.0, 1.0, 0.0]
+    P_rgbd = [570.0, 0.0, 314.5, -42.75, 0.0, 570.0, 235.5, 0.0, 0.0, 0.0, 1.0, 0.0]
+    samples = [ ([0.1], [0.05, -0.2],
+                 [(380, 283), (374, 253), (369, 224), (349, 288), (344, 258), (339, 229)],
+                 [(342, 210, 2.2), (340, 184, 2.21), (338, 158, 2.21),
+                  (316, 211, 2.2), (314, 186, 2.21), (313, 160, 2.22)]),
+                ([-0.15], [-0.1, 0.25],
+                 [(681, 376), (677, 330), (674, 285), (628, 373), (626, 329), (623, 285)],
+                 [(277, 265, 1.91), (279, 236, 1.91), (281, 206, 1.9),
+                  (247, 264, 1.89), (249, 234, 1.88), (251, 203, 1.88)]) ]
+    multisensors = []
+    for position_a, position_b, points_mono, points_rgbd in samples:
+        M_chain_a = ChainMeasurement(chain_id="chainA", chain_state=JointState(position=position_a))
+        M_chain_b = ChainMeasurement(chain_id="chainB", chain_state=JointState(position=position_b))
+        M_mono = CameraMeasurement(camera_id="camA",
+                                   image_points=[Point(x, y, 0) for x, y in points_mono],
+                                   cam_info=CameraInfo(P=P_mono))
+        M_rgbd = CameraMeasurement(camera_id="camB",
+                                   image_points=[Point(x, y, z) for x, y, z in points_rgbd],
+                                   cam_info=CameraInfo(P=P_rgbd))
+        multisensor = MultiSensor(None)
+        multisensor.sensors = [ CameraChainSensor({"sensor_id": "camA", "chain_id": "chainB",
+                                                   "frame_id": "camA_frame"},
+                                                  M_mono, M_chain_b),
+                                CameraChainSensor({"sensor_id": "camB", "chain_id": "chainA",
+                                                   "frame_id": "camB_frame", "baseline_rgbd": 0.075},
+                                                  M_rgbd, M_chain_a) ]
+        multisensor.checkerboard = "boardA"
+        multisensor.update_config(robot_params)
+        multisensors.append(multisensor)
+    return multisensors
+
+class TestSparseProblem(unittest.TestCase):
+    def check_parity(self, robot_params, free_dict, multisensors, pose_guess_arr):
+        # compiled backend, and the numpy implementation as reference
+        calc = ErrorCalc(robot_params, free_dict, multisensors, False)
+        self.assertTrue(calc.is_sparse())
+        reference = ErrorCalc(robot_params, free_dict, multisensors, False)
+        reference._sparse_problem = None
+
+        opt_all = build_opt_vector(robot_params, free_dict, pose_guess_arr)
+        opt_all += 0.01 * numpy.sin(numpy.arange(len(opt_all)))  # away from the initial config
+
+        r = calc.calculate_error(opt_all)
+        r_reference = reference.calculate_error(opt_all)
+        self.assertEqual(r.shape, r_reference.shape)
+        self.assertAlmostEqual(numpy.linalg.norm(r - r_reference), 0.0, 9)
+
+        # exact jacobian vs forward differences (epsilon 1e-6)
+        J = calc.calculate_jacobian(opt_all).toarray()
+        J_reference = reference.calculate_jacobian(opt_all)
+        self.assertEqual(J.shape, J_reference.shape)
+        return J, J_reference
+
+    @unittest.skipIf(SparseProblem is None, "sparse_problem_cpp module not built")
+    def test_parity(self):
+        config, robot_params, free_dict = loadSystem()
+        multisensors = buildMultisensors(config, robot_params)
+
+        pose_guess_arr = array([[1.5, 0.2, 0.1, 0.1, -0.2, 0.3],
+                                [1.2, -0.3, 0.2, -0.1, 0.1, 0.2]])
+        J, J_reference = self.check_parity(robot_params, free_dict, multisensors, pose_guess_arr)
+        self.assertAlmostEqual(numpy.abs(J - J_reference).max(), 0.0, 4)
+
+    @unittest.skipIf(SparseProblem is None, "sparse_problem_cpp module not built")
+    def test_camera_parity(self):
+        robot_params, free_dict = loadCameraSystem()
+        multisensors = buildCameraMultisensors(robot_params)
+        self.assertEqual([s.terms_per_sample for s in multisensors[0].sensors], [2, 3])
+
+        pose_guess_arr = array([[2.5, 0.1, 0.6, 0.0, -1.5, 0.1],
+                                [2.2, -0.2, 0.4, 0.1, -1.6, 0.0]])
+        J, J_reference = self.check_parity(robot_params, free_dict, multisensors, pose_guess_arr)
+        # pixel residuals: the forward differences are relative to the scale
+        scale = max(1.0, numpy.abs(J_reference).max())
+        self.assertAlmostEqual(numpy.abs(J - J_reference).max() / scale, 0.0, 4)
+
+if __name__ == '__main__':
+    import rostest
+    rostest.unitrun('calibration_estimation', 'test_SparseProblem', TestSparseProblem)
@@ -0,0 +1,187 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <sstream>
+
+#include "symbol_table.h"
+
+using namespace std;
+using namespace calib;
+
+static string frameName(int k)
+{
+  ostringstream ss;
+  ss << "frame_" << k;
+  return ss.str();
+}
+
+TEST(SymbolTable, denseIds)
+{
+  SymbolTable table;
+  EXPECT_EQ(table.size(), 0u);
+  EXPECT_EQ(table.intern("base_link"), 0);
+  EXPECT_EQ(table.intern("head"), 1);
+  EXPECT_EQ(table.intern("base_link"), 0);
+  EXPECT_EQ(table.intern("camera"), 2);
+  EXPECT_EQ(table.size(), 3u);
+
+  EXPECT_EQ(table.find("head"), 1);
+  EXPECT_EQ(table.find("not_a_link"), -1);
+  EXPECT_EQ(table.size(), 3u); // find() does not intern
+
+  EXPECT_EQ(table.name(0), "base_link");
+  EXPECT_EQ(table.name(2), "camera");
+}
+
+TEST(SymbolTable, stableNames)
+{
+  // name() references survive new names
+  SymbolTable table;
+  const string &first = table.name(table.intern("first"));
+  for (int k = 0; k < 1000; k++)
+    table.intern(frameName(k));
+  EXPECT_EQ(first, "first");
+}
+
+TEST(SymbolTable, frozen)
+{
+  SymbolTable table;
+  table.intern("a");
+  table.intern("b");
+  EXPECT_FALSE(table.frozen());
+
+  table.freeze();
+  EXPECT_TRUE(table.frozen());
+  EXPECT_EQ(table.intern("b"), 1);   // known names still resolve
+  EXPECT_EQ(table.intern("c"), -1);  // no new names
+  EXPECT_EQ(table.find("c"), -1);
+  EXPECT_EQ(table.size(), 2u);
+  EXPECT_EQ(table.name(0), "a");
+
+  // clear() unfreezes
+  table.clear();
+  EXPECT_FALSE(table.frozen());
+  EXPECT_EQ(table.size(), 0u);
+  EXPECT_EQ(table.intern("c"), 0);
+}
+
+TEST(SymbolTable, copy)
+{
+  SymbolTable table;
+  table.intern("a");
+  table.intern("b");
+  table.freeze();
+
+  SymbolTable copy(table);
+  EXPECT_TRUE(copy.frozen());
+  EXPECT_EQ(copy.find("b"), 1);
+
+  SymbolTable assigned;
+  assigned.intern("x");
+  assigned = table;
+  EXPECT_TRUE(assigned.frozen());
+  EXPECT_EQ(assigned.size(), 2u);
+  EXPECT_EQ(assigned.find("x"), -1);
+  EXPECT_EQ(assigned.name(1), "b");
+}
+
+static void internNames(SymbolTable *table, int num_names, vector<int> *ids)
+{
+  ids->resize(num_names);
+  for (int k = 0; k < num_names; k++)
+    (*ids)[k] = table->intern(frameName(k));
+}
+
+static void findNames(const SymbolTable *table, int num_names, int *errors)
+{
+  *errors = 0;
+  for (int r = 0; r < 100; r++)
+  {
+    for (int k = 0; k < num_names; k++)
+    {
+      int id = table->find(frameName(k));
+      if (id < 0 || table->name(id) != frameName(k))
+        (*errors)++;
+    }
+  }
+}
+
+TEST(SymbolTable, concurrentIntern)
+{
+  // every thread gets the same id for each name and the ids stay dense
+  const int num_threads = 8, num_names = 500;
+  SymbolTable table;
+  vector<vector<int> > ids(num_threads);
+
+  boost::thread_group threads;
+  for (int t = 0; t < num_threads; t++)
+    threads.create_thread(boost::bind(&internNames, &table, num_names, &ids[t]));
+  threads.join_all();
+
+  ASSERT_EQ(table.size(), size_t(num_names));
+  for (int t = 1; t < num_threads; t++)
+    EXPECT_EQ(ids[t], ids[0]);
+  for (int k = 0; k < num_names; k++)
+    EXPECT_EQ(table.name(ids[0][k]), frameName(k));
+}
+
+TEST(SymbolTable, concurrentFrozenLookups)
+{
+  const int num_threads = 8, num_names = 200;
+  SymbolTable table;
+  for (int k = 0; k < num_names; k++)
+    table.intern(frameName(k));
+  table.freeze();
+
+  vector<int> errors(num_threads);
+  boost::thread_group threads;
+  for (int t = 0; t < num_threads; t++)
+    threads.create_thread(boost::bind(&findNames, &table, num_names, &errors[t]));
+  threads.join_all();
+
+  for (int t = 0; t < num_threads; t++)
+    EXPECT_EQ(errors[t], 0);
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,161 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+/**
+ * Benchmark: per-point nViewTriangulate (SVD, as View::triangulation used to
+ * call it) vs the batched version, for 7x6 boards seen by 6 cameras. The
+ * accuracy of both (RMS error to the true points) is also compared, it fails
+ * if the batched one is more than 5% worse.
+ *
+ * usage: triangulation_benchmark [num_views]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include <ros/time.h>
+
+#include "triangulation.h"
+
+using namespace std;
+using namespace cv;
+using namespace calib;
+
+static double uniform(double min, double max)
+{
+  return min + (max - min) * (rand() / double(RAND_MAX));
+}
+
+int main(int argc, char **argv)
+{
+  int num_views   = (argc > 1) ? atoi(argv[1]) : 1000;
+  int num_cameras = 6;
+  int num_points  = 7 * 6;
+
+  srand(0);
+
+  // cameras
+  Matx33d K(525, 0, 320, 0, 525, 240, 0, 0, 1);
+  vector<Matx34d> Ps;
+  for (int i = 0; i < num_cameras; i++)
+  {
+    Vec3d t(uniform(-0.3, 0.3), uniform(-0.1, 0.1), uniform(-0.1, 0.1));
+    Matx34d P;
+    hconcat(K, K*t, P);
+    Ps.push_back(P);
+  }
+
+  // views: measurements of each camera
+  vector<vector<vector<Point2d> > > views(num_views);
+  vector<vector<Point3d> > truth(num_views, vector<Point3d>(num_points));
+  for (int v = 0; v < num_views; v++)
+  {
+    views[v].assign(num_cameras, vector<Point2d>(num_points));
+    for (int j = 0; j < num_points; j++)
+    {
+      Vec4d X(uniform(-0.5, 0.5), uniform(-0.4, 0.4), uniform(1.5, 3.0), 1.0);
+      truth[v][j] = Point3d(X(0), X(1), X(2));
+      for (int i = 0; i < num_cameras; i++)
+      {
+        Vec3d p = Ps[i] * X;
+        views[v][i][j] = Point2d(p(0)/p(2) + uniform(-0.5, 0.5),
+                                 p(1)/p(2) + uniform(-0.5, 0.5));
+      }
+    }
+  }
+
+  //! per point (SVD)
+  vector<vector<Point3d> > X_single(num_views);
+  ros::WallTime start = ros::WallTime::now();
+  for (int v = 0; v < num_views; v++)
+  {
+    for (int j = 0; j < num_points; j++)
+    {
+      vector<Point2d> points_2d;
+      for (int i = 0; i < num_cameras; i++)
+        points_2d.push_back(views[v][i][j]);
+
+      Mat_<double> x = Mat(points_2d);
+      Mat_<double> y;
+      cv::transpose(x, y);
+
+      Vec3d X;
+      nViewTriangulate(y, Ps, X);
+      X_single[v].push_back(X);
+    }
+  }
+  double t_single = (ros::WallTime::now() - start).toSec();
+
+  //! batched
+  vector<vector<Point3d> > X_batch(num_views);
+  start = ros::WallTime::now();
+  for (int v = 0; v < num_views; v++)
+    nViewTriangulate(views[v], Ps, &X_batch[v]);
+  double t_batch = (ros::WallTime::now() - start).toSec();
+
+  // accuracy (all views) and difference
+  double max_diff = 0, err_single = 0, err_batch = 0;
+  for (int v = 0; v < num_views; v++)
+  {
+    for (int j = 0; j < num_points; j++)
+    {
+      Point3d d = X_single[v][j] - X_batch[v][j];
+      max_diff = max(max_diff, sqrt(d.dot(d)));
+
+      Point3d e_single = X_single[v][j] - truth[v][j];
+      Point3d e_batch  = X_batch[v][j]  - truth[v][j];
+      err_single += e_single.dot(e_single);
+      err_batch  += e_batch.dot(e_batch);
+    }
+  }
+  int num_total = max(num_views * num_points, 1);
+  err_single = sqrt(err_single / num_total);
+  err_batch  = sqrt(err_batch / num_total);
+
+  printf("Triangulation (%d views, %d cameras, %d points per view)\n",
+         num_views, num_cameras, num_points);
+  printf("  Per point (SVD): %8.4f s\n", t_single);
+  printf("  Batched:         %8.4f s\n", t_batch);
+  printf("  Speedup:         %8.2fx\n", t_single / t_batch);
+  printf("  Max difference:  %g\n", max_diff);
+  printf("  RMS error (SVD): %g\n", err_single);
+  printf("  RMS error:       %g\n", err_batch);
+
+  return err_batch <= 1.05 * err_single ? 0 : 1;
+}
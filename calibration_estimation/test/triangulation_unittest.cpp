@@ -0,0 +1,208 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2013, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+
+//! \author Pablo Speciale
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <cmath>
+
+#include "triangulation.h"
+
+using namespace std;
+using namespace cv;
+using namespace calib;
+
+static double uniform(double min, double max)
+{
+  return min + (max - min) * (rand() / double(RAND_MAX));
+}
+
+// 'ncameras' cameras looking at 'npoints' random points (noise in pixels),
+// the whole scene translated by 'origin'
+static void generateData(int ncameras, int npoints, double noise,
+                         vector<Matx34d> *Ps,
+                         vector<Point3d> *X,
+                         vector<vector<Point2d> > *x,
+                         const Vec3d &origin = Vec3d(0, 0, 0))
+{
+  Matx33d K(525, 0, 320,
+            0, 525, 240,
+            0,   0,   1);
+
+  Ps->clear();
+  for (int i = 0; i < ncameras; i++)
+  {
+    // small rotation around Y and translation
+    double a = uniform(-0.1, 0.1);
+    Matx33d R( cos(a), 0, sin(a),
+                    0, 1,      0,
+              -sin(a), 0, cos(a));
+    Vec3d t(uniform(-0.3, 0.3), uniform(-0.1, 0.1), uniform(-0.1, 0.1));
+
+    Matx34d P;
+    hconcat(K*R, K*(t - R*origin), P);
+    Ps->push_back(P);
+  }
+
+  X->resize(npoints);
+  for (int j = 0; j < npoints; j++)
+    (*X)[j] = Point3d(origin(0) + uniform(-0.5, 0.5),
+                      origin(1) + uniform(-0.4, 0.4),
+                      origin(2) + uniform(1.5, 3.0));
+
+  x->assign(ncameras, vector<Point2d>(npoints));
+  for (int i = 0; i < ncameras; i++)
+  {
+    for (int j = 0; j < npoints; j++)
+    {
+      Vec4d X_homog((*X)[j].x, (*X)[j].y, (*X)[j].z, 1.0);
+      Vec3d p = (*Ps)[i] * X_homog;
+      (*x)[i][j] = Point2d(p(0)/p(2) + uniform(-noise, noise),
+                           p(1)/p(2) + uniform(-noise, noise));
+    }
+  }
+}
+
+TEST(Triangulation, batchedExact)
+{
+  srand(0);
+  vector<Matx34d> Ps;
+  vector<Point3d> X, X_batch;
+  vector<vector<Point2d> > x;
+  generateData(6, 42, 0.0, &Ps, &X, &x);
+
+  nViewTriangulate(x, Ps, &X_batch);
+
+  ASSERT_EQ(X_batch.size(), X.size());
+  for (size_t j = 0; j < X.size(); j++)
+  {
+    EXPECT_NEAR(X_batch[j].x, X[j].x, 1e-9);
+    EXPECT_NEAR(X_batch[j].y, X[j].y, 1e-9);
+    EXPECT_NEAR(X_batch[j].z, X[j].z, 1e-9);
+  }
+}
+
+// single point version (SVD) of point j
+static Vec3d triangulateSVD(const vector<vector<Point2d> > &x,
+                            const vector<Matx34d> &Ps, size_t j)
+{
+  Mat_<double> xj(2, x.size());
+  for (size_t i = 0; i < x.size(); i++)
+  {
+    xj(0, i) = x[i][j].x;
+    xj(1, i) = x[i][j].y;
+  }
+
+  Vec3d X_svd;
+  nViewTriangulate(xj, Ps, X_svd);
+  return X_svd;
+}
+
+static double distance(const Point3d &a, const Vec3d &b)
+{
+  Point3d d = a - Point3d(b(0), b(1), b(2));
+  return sqrt(d.dot(d));
+}
+
+TEST(Triangulation, batchedMatchesSVD)
+{
+  srand(1);
+  for (int ncameras = 2; ncameras <= 6; ncameras++)
+  {
+    vector<Matx34d> Ps;
+    vector<Point3d> X, X_batch;
+    vector<vector<Point2d> > x;
+    generateData(ncameras, 100, 0.5, &Ps, &X, &x);
+
+    nViewTriangulate(x, Ps, &X_batch);
+
+    // the normalization changes the algebraic error being minimized, the
+    // points move much less than their error and are as accurate
+    ASSERT_EQ(X_batch.size(), X.size());
+    double err_batch = 0, err_svd = 0;
+    for (size_t j = 0; j < X.size(); j++)
+    {
+      Vec3d X_svd = triangulateSVD(x, Ps, j);
+      Vec3d X_true(X[j].x, X[j].y, X[j].z);
+
+      EXPECT_LT(distance(X_batch[j], X_svd), 5e-3);
+      err_batch += pow(distance(X_batch[j], X_true), 2);
+      err_svd   += pow(distance(Point3d(X_svd(0), X_svd(1), X_svd(2)), X_true), 2);
+    }
+    EXPECT_LE(sqrt(err_batch / X.size()), 1.05 * sqrt(err_svd / X.size()));
+  }
+}
+
+TEST(Triangulation, batchedFarFromOrigin)
+{
+  // A'A of the raw coordinates loses the points far from the world origin
+  srand(2);
+  for (int ncameras = 2; ncameras <= 6; ncameras++)
+  {
+    vector<Matx34d> Ps;
+    vector<Point3d> X, X_batch;
+    vector<vector<Point2d> > x;
+    generateData(ncameras, 42, 0.0, &Ps, &X, &x, Vec3d(1e4, 1e4, 1e4));
+
+    nViewTriangulate(x, Ps, &X_batch);
+
+    ASSERT_EQ(X_batch.size(), X.size());
+    for (size_t j = 0; j < X.size(); j++)
+    {
+      Vec3d X_true(X[j].x, X[j].y, X[j].z);
+      Vec3d X_svd = triangulateSVD(x, Ps, j);
+
+      EXPECT_LT(distance(X_batch[j], X_true), 1e-8);
+      EXPECT_LE(distance(X_batch[j], X_true),
+                distance(Point3d(X_svd(0), X_svd(1), X_svd(2)), X_true) + 1e-9);
+    }
+  }
+}
+
+TEST(Triangulation, batchedEmpty)
+{
+  vector<Matx34d> Ps;
+  vector<Point3d> X;
+  vector<vector<Point2d> > x;
+
+  nViewTriangulate(x, Ps, &X);
+  EXPECT_TRUE(X.empty());
+}
+
+int main(int argc, char **argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}